@@ -7,6 +7,8 @@
 #include <mutex>
 #include <vector>
 
+#include "port_reactor.h"
+
 class TBinarySemaphoreSignal
 {
 public:
@@ -22,9 +24,27 @@ public:
     {
         std::unique_lock<std::mutex> lock(Mutex);
 
-        return Cond.wait_until(lock, until, [this]() {
+        auto signaled = [this]() {
             return std::any_of(Signals.begin(), Signals.end(), [](PBinarySemaphoreSignal item) { return item->value; });
-        });
+        };
+        if (!TPortReactor::InFiber()) {
+            return Cond.wait_until(lock, until, signaled);
+        }
+
+        // Other ports of the reactor are served while waiting
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(until - Clock::now());
+        while (!signaled()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            FiberWaiters.push_back(TPortReactor::GetWaiter());
+            lock.unlock();
+            TPortReactor::Suspend(-1, 0, deadline);
+            lock.lock();
+            FiberWaiters.clear();
+        }
+        return true;
     }
 
     bool GetSignalValue(PBinarySemaphoreSignal signal)
@@ -41,6 +61,9 @@ public:
         std::lock_guard<std::mutex> lock(Mutex);
         signal->value = true;
         Cond.notify_all();
+        for (const auto& waiter: FiberWaiters) {
+            waiter.WakeUp();
+        }
     }
 
     PBinarySemaphoreSignal MakeSignal()
@@ -56,6 +79,7 @@ private:
     std::vector<PBinarySemaphoreSignal> Signals;
     std::mutex Mutex;
     std::condition_variable Cond;
+    std::vector<TPortReactor::TWaiter> FiberWaiters;
 };
 
 typedef std::shared_ptr<TBinarySemaphore> PBinarySemaphore;
@@ -0,0 +1,206 @@
+#include "device_capabilities_cache.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+#include <wblib/json_utils.h>
+
+#define LOG(logger) ::logger.Log() << "[capabilities cache] "
+
+namespace
+{
+    std::string GetDeviceKey(const TSerialDevice& device)
+    {
+        const auto& type = device.DeviceConfig()->DeviceType;
+        return device.Port()->GetDescription(false) + ":" + (type.empty() ? device.Protocol()->GetName() : type) +
+               ":" + device.DeviceConfig()->SlaveId;
+    }
+
+    bool WriteFile(int fd, const std::string& data)
+    {
+        size_t written = 0;
+        while (written < data.size()) {
+            auto res = write(fd, data.data() + written, data.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += res;
+        }
+        // The file must be on disk before rename, otherwise power loss can leave an empty file instead of both
+        return fsync(fd) == 0;
+    }
+}
+
+Json::Value CapabilitiesToJson(const TDeviceCapabilities& capabilities)
+{
+    Json::Value res(Json::objectValue);
+    if (!capabilities.Signature.empty()) {
+        res["signature"] = capabilities.Signature;
+    }
+    if (!capabilities.SupportsHoles) {
+        res["supports_holes"] = false;
+    }
+    for (auto type: capabilities.SingleWriteTypes) {
+        res["single_write_types"].append(type);
+    }
+    for (const auto& reg: capabilities.Registers) {
+        res[(reg.second == TRegisterAvailability::AVAILABLE) ? "available" : "unavailable"].append(reg.first);
+    }
+    for (const auto& limits: capabilities.ReadLimits) {
+        Json::Value item(Json::arrayValue);
+        item.append(Json::UInt64(limits.second.AcceptedLength));
+        item.append(Json::UInt64(limits.second.RejectedLength));
+        item.append(Json::UInt64(limits.second.AcceptedHole));
+        item.append(Json::UInt64(limits.second.RejectedHole));
+        res["read_limits"][std::to_string(limits.first)] = item;
+    }
+    for (const auto& splits: capabilities.ReadSplits) {
+        auto& item = res["read_splits"][std::to_string(splits.first)];
+        for (auto addr: splits.second) {
+            item.append(addr);
+        }
+    }
+    return res;
+}
+
+TDeviceCapabilities CapabilitiesFromJson(const Json::Value& data)
+{
+    TDeviceCapabilities res;
+    WBMQTT::JSON::Get(data, "signature", res.Signature);
+    WBMQTT::JSON::Get(data, "supports_holes", res.SupportsHoles);
+    for (const auto& type: data["single_write_types"]) {
+        res.SingleWriteTypes.insert(type.asInt());
+    }
+    for (const auto& reg: data["available"]) {
+        res.Registers[reg.asString()] = TRegisterAvailability::AVAILABLE;
+    }
+    for (const auto& reg: data["unavailable"]) {
+        res.Registers[reg.asString()] = TRegisterAvailability::UNAVAILABLE;
+    }
+    const auto& readLimits = data["read_limits"];
+    for (auto it = readLimits.begin(); it != readLimits.end(); ++it) {
+        const auto& item = *it;
+        if (!item.isArray() || item.size() != 4) {
+            continue;
+        }
+        res.ReadLimits[std::stoi(it.name())] = TLearnedReadLimits{item[0].asUInt64(),
+                                                                   item[1].asUInt64(),
+                                                                   item[2].asUInt64(),
+                                                                   item[3].asUInt64()};
+    }
+    const auto& readSplits = data["read_splits"];
+    for (auto it = readSplits.begin(); it != readSplits.end(); ++it) {
+        auto& splits = res.ReadSplits[std::stoi(it.name())];
+        for (const auto& addr: *it) {
+            splits.insert(addr.asUInt());
+        }
+    }
+    return res;
+}
+
+TDeviceCapabilitiesCache::TDeviceCapabilitiesCache(const std::string& filePath)
+    : FilePath(filePath),
+      Devices(Json::objectValue),
+      Changed(false)
+{}
+
+void TDeviceCapabilitiesCache::Load()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    std::ifstream f(FilePath);
+    if (!f.is_open()) {
+        return;
+    }
+    try {
+        auto data = WBMQTT::JSON::Parse(f);
+        if (data.isObject()) {
+            Devices = data;
+            Changed = false;
+            return;
+        }
+        LOG(Warn) << FilePath << " is not a JSON object, it is ignored";
+    } catch (const std::exception& e) {
+        LOG(Warn) << "Can't load " << FilePath << ": " << e.what();
+    }
+}
+
+void TDeviceCapabilitiesCache::Save()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (!Changed) {
+        return;
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    auto tmpPath = FilePath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG(Warn) << "Can't open " << tmpPath << ": " << strerror(errno);
+        return;
+    }
+    bool written = WriteFile(fd, Json::writeString(builder, Devices));
+    if (close(fd) != 0 || !written) {
+        LOG(Warn) << "Can't write " << tmpPath << ": " << strerror(errno);
+        return;
+    }
+    if (std::rename(tmpPath.c_str(), FilePath.c_str()) != 0) {
+        LOG(Warn) << "Can't rename " << tmpPath << " to " << FilePath;
+        return;
+    }
+    Changed = false;
+}
+
+void TDeviceCapabilitiesCache::Restore(TSerialDevice& device) const
+{
+    TDeviceCapabilities capabilities;
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        auto key = GetDeviceKey(device);
+        if (!Devices.isMember(key)) {
+            return;
+        }
+        try {
+            capabilities = CapabilitiesFromJson(Devices[key]);
+        } catch (const std::exception& e) {
+            LOG(Warn) << "Can't restore capabilities of " << device.ToString() << ": " << e.what();
+            return;
+        }
+    }
+    device.SetCapabilities(capabilities);
+    LOG(Debug) << "Capabilities of " << device.ToString() << " are restored";
+}
+
+void TDeviceCapabilitiesCache::Update(const TSerialDevice& device)
+{
+    auto capabilities = device.GetCapabilities();
+    if (capabilities.Signature.empty()) {
+        // A replaced device can't be detected without signature,
+        // so restrictions learned from the old one would never be checked again
+        capabilities.SupportsHoles = true;
+        capabilities.SingleWriteTypes.clear();
+        capabilities.ReadLimits.clear();
+        capabilities.ReadSplits.clear();
+        for (auto it = capabilities.Registers.begin(); it != capabilities.Registers.end();) {
+            if (it->second == TRegisterAvailability::UNAVAILABLE) {
+                it = capabilities.Registers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    auto data = CapabilitiesToJson(capabilities);
+    std::unique_lock<std::mutex> lock(Mutex);
+    auto key = GetDeviceKey(device);
+    if (Devices[key] != data) {
+        Devices[key] = data;
+        Changed = true;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include <wblib/json/json.h>
+
+#include "serial_device.h"
+
+/**
+ * @brief Storage of device capabilities learned by polling: availability of registers,
+ *        support of holes in read requests, Modbus read limits and split points.
+ *        Keeps them in a file to skip learning after restart.
+ *        Devices are identified by port, device type or protocol and slave id.
+ *        Methods can be called from any thread.
+ */
+class TDeviceCapabilitiesCache
+{
+public:
+    TDeviceCapabilitiesCache(const std::string& filePath);
+
+    //! Load capabilities from the file. Errors are logged and result in an empty cache
+    void Load();
+
+    //! Write capabilities to the file if they are changed since last save
+    void Save();
+
+    //! Apply stored capabilities to the device
+    void Restore(TSerialDevice& device) const;
+
+    /**
+     * @brief Store current capabilities of the device.
+     *        If the device has no signature, only available registers are stored,
+     *        as a replaced device or updated firmware can't be detected.
+     */
+    void Update(const TSerialDevice& device);
+
+private:
+    std::string FilePath;
+    Json::Value Devices;
+    bool Changed;
+    mutable std::mutex Mutex;
+};
+
+typedef std::shared_ptr<TDeviceCapabilitiesCache> PDeviceCapabilitiesCache;
+
+Json::Value CapabilitiesToJson(const TDeviceCapabilities& capabilities);
+TDeviceCapabilities CapabilitiesFromJson(const Json::Value& data);
@@ -1,4 +1,5 @@
 #include "modbus_device.h"
+#include "log.h"
 #include "modbus_common.h"
 
 #define LOG(logger) logger.Log() << "[modbus] "
@@ -48,8 +49,13 @@ TModbusDevice::TModbusDevice(std::unique_ptr<Modbus::IModbusTraits> modbusTraits
       TUInt32SlaveId(config.CommonConfig->SlaveId),
       ModbusTraits(std::move(modbusTraits)),
       ResponseTime(std::chrono::milliseconds::zero()),
-      EnableWbContinuousRead(config.EnableWbContinuousRead)
+      EnableWbContinuousRead(config.EnableWbContinuousRead),
+      VerifySetupRegisters(config.VerifySetupRegisters)
 {
+    ReadSplits = std::make_shared<Modbus::TReadSplits>();
+    if (config.AdaptiveReadLimits) {
+        ReadLimits = std::make_shared<Modbus::TAdaptiveReadLimits>();
+    }
     config.CommonConfig->FrameTimeout =
         std::max(config.CommonConfig->FrameTimeout,
                  std::chrono::ceil<std::chrono::milliseconds>(port->GetSendTimeBytes(3.5)));
@@ -57,7 +63,7 @@ TModbusDevice::TModbusDevice(std::unique_ptr<Modbus::IModbusTraits> modbusTraits
 
 PRegisterRange TModbusDevice::CreateRegisterRange() const
 {
-    return Modbus::CreateRegisterRange(ResponseTime.GetValue());
+    return Modbus::CreateRegisterRange(ResponseTime.GetValue(), ReadLimits, ReadSplits);
 }
 
 void TModbusDevice::WriteRegisterImpl(PRegister reg, const TRegisterValue& value)
@@ -65,6 +71,11 @@ void TModbusDevice::WriteRegisterImpl(PRegister reg, const TRegisterValue& value
     Modbus::WriteRegister(*ModbusTraits, *Port(), SlaveId, *reg, value, ModbusCache);
 }
 
+void TModbusDevice::WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten)
+{
+    Modbus::WriteRegisters(*ModbusTraits, *Port(), SlaveId, writes, ModbusCache, onWritten);
+}
+
 void TModbusDevice::ReadRegisterRange(PRegisterRange range)
 {
     auto modbus_range = std::dynamic_pointer_cast<Modbus::TModbusRegisterRange>(range);
@@ -80,5 +91,38 @@ void TModbusDevice::WriteSetupRegisters()
     if (EnableWbContinuousRead) {
         Modbus::EnableWbContinuousRead(shared_from_this(), *ModbusTraits, *Port(), SlaveId, ModbusCache);
     }
-    Modbus::WriteSetupRegisters(*ModbusTraits, *Port(), SlaveId, SetupItems, ModbusCache);
+    Modbus::WriteSetupRegisters(*ModbusTraits, *Port(), SlaveId, SetupItems, ModbusCache, 0, VerifySetupRegisters);
+}
+
+TDeviceCapabilities TModbusDevice::GetCapabilities() const
+{
+    auto res = TSerialDevice::GetCapabilities();
+    res.ReadSplits = ReadSplits->Get();
+    if (ReadLimits) {
+        res.ReadLimits = ReadLimits->Get();
+    }
+    return res;
+}
+
+void TModbusDevice::SetCapabilities(const TDeviceCapabilities& capabilities)
+{
+    TSerialDevice::SetCapabilities(capabilities);
+    ReadSplits->Set(capabilities.ReadSplits);
+    if (ReadLimits) {
+        ReadLimits->Set(capabilities.ReadLimits);
+    }
+}
+
+std::string TModbusDevice::ReadSignature()
+{
+    // Only Wiren Board devices have known firmware version register
+    if (!EnableWbContinuousRead) {
+        return std::string();
+    }
+    try {
+        return Modbus::ReadWbFirmwareVersion(shared_from_this(), *ModbusTraits, *Port(), SlaveId, ModbusCache);
+    } catch (const TSerialDevicePermanentRegisterException& e) {
+        LOG(Warn) << ToString() << ": can't read firmware version: " << e.what();
+    }
+    return std::string();
 }
@@ -21,6 +21,15 @@ public:
      *
      */
     bool EnableWbContinuousRead = false;
+
+    /**
+     * @brief Learn maximum read request length and holes by reading registers
+     *        instead of using max_read_registers, max_reg_hole and max_bit_hole
+     */
+    bool AdaptiveReadLimits = false;
+
+    //! Read setup registers before writing them and write only registers holding different values
+    bool VerifySetupRegisters = false;
 };
 
 template<class Dev> class TModbusDeviceFactory: public IDeviceFactory
@@ -43,10 +52,13 @@ public:
         TModbusDeviceConfig config;
         config.CommonConfig = deviceConfig;
         WBMQTT::JSON::Get(data, "enable_wb_continuous_read", config.EnableWbContinuousRead);
+        WBMQTT::JSON::Get(data, "adaptive_read_limits", config.AdaptiveReadLimits);
+        WBMQTT::JSON::Get(data, "verify_setup_registers", config.VerifySetupRegisters);
         bool forceFrameTimeout = false;
         WBMQTT::JSON::Get(data, "force_frame_timeout", forceFrameTimeout);
 
-        auto dev = std::make_shared<Dev>(ModbusTraitsFactory->GetModbusTraits(port, forceFrameTimeout),
+        auto dev = std::make_shared<Dev>(
+            ModbusTraitsFactory->GetModbusTraits(port, forceFrameTimeout, deviceConfig->MaxPipelinedRequests),
                                          config,
                                          port,
                                          protocol);
@@ -61,6 +73,9 @@ class TModbusDevice: public TSerialDevice, public TUInt32SlaveId
     Modbus::TRegisterCache ModbusCache;
     TRunningAverage<std::chrono::microseconds, 10> ResponseTime;
     bool EnableWbContinuousRead;
+    bool VerifySetupRegisters;
+    Modbus::PAdaptiveReadLimits ReadLimits;
+    Modbus::PReadSplits ReadSplits;
 
 public:
     TModbusDevice(std::unique_ptr<Modbus::IModbusTraits> modbusTraits,
@@ -74,8 +89,13 @@ public:
 
     void OnEnabledEvent(uint16_t addr, bool res);
 
+    TDeviceCapabilities GetCapabilities() const override;
+    void SetCapabilities(const TDeviceCapabilities& capabilities) override;
+
     static void Register(TSerialDeviceFactory& factory);
 
 protected:
     void WriteRegisterImpl(PRegister reg, const TRegisterValue& value) override;
+    void WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten) override;
+    std::string ReadSignature() override;
 };
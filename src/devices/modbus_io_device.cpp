@@ -57,8 +57,13 @@ TModbusIODevice::TModbusIODevice(std::unique_ptr<Modbus::IModbusTraits> modbusTr
     : TSerialDevice(config.CommonConfig, port, protocol),
       TUInt32SlaveId(config.CommonConfig->SlaveId),
       ModbusTraits(std::move(modbusTraits)),
-      ResponseTime(std::chrono::milliseconds::zero())
+      ResponseTime(std::chrono::milliseconds::zero()),
+      VerifySetupRegisters(config.VerifySetupRegisters)
 {
+    ReadSplits = std::make_shared<Modbus::TReadSplits>();
+    if (config.AdaptiveReadLimits) {
+        ReadLimits = std::make_shared<Modbus::TAdaptiveReadLimits>();
+    }
     auto SecondaryId = GetSecondaryId(config.CommonConfig->SlaveId);
     Shift = (((SecondaryId - 1) % 4) + 1) * DeviceConfig()->Stride + DeviceConfig()->Shift;
     config.CommonConfig->FrameTimeout =
@@ -68,7 +73,7 @@ TModbusIODevice::TModbusIODevice(std::unique_ptr<Modbus::IModbusTraits> modbusTr
 
 PRegisterRange TModbusIODevice::CreateRegisterRange() const
 {
-    return Modbus::CreateRegisterRange(ResponseTime.GetValue());
+    return Modbus::CreateRegisterRange(ResponseTime.GetValue(), ReadLimits, ReadSplits);
 }
 
 void TModbusIODevice::WriteRegisterImpl(PRegister reg, const TRegisterValue& value)
@@ -76,6 +81,11 @@ void TModbusIODevice::WriteRegisterImpl(PRegister reg, const TRegisterValue& val
     Modbus::WriteRegister(*ModbusTraits, *Port(), SlaveId, *reg, value, ModbusCache, Shift);
 }
 
+void TModbusIODevice::WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten)
+{
+    Modbus::WriteRegisters(*ModbusTraits, *Port(), SlaveId, writes, ModbusCache, onWritten, Shift);
+}
+
 void TModbusIODevice::ReadRegisterRange(PRegisterRange range)
 {
     auto modbus_range = std::dynamic_pointer_cast<Modbus::TModbusRegisterRange>(range);
@@ -89,5 +99,24 @@ void TModbusIODevice::ReadRegisterRange(PRegisterRange range)
 void TModbusIODevice::WriteSetupRegisters()
 {
     Modbus::EnableWbContinuousRead(shared_from_this(), *ModbusTraits, *Port(), SlaveId, ModbusCache);
-    Modbus::WriteSetupRegisters(*ModbusTraits, *Port(), SlaveId, SetupItems, ModbusCache, Shift);
+    Modbus::WriteSetupRegisters(*ModbusTraits, *Port(), SlaveId, SetupItems, ModbusCache, Shift, VerifySetupRegisters);
+}
+
+TDeviceCapabilities TModbusIODevice::GetCapabilities() const
+{
+    auto res = TSerialDevice::GetCapabilities();
+    res.ReadSplits = ReadSplits->Get();
+    if (ReadLimits) {
+        res.ReadLimits = ReadLimits->Get();
+    }
+    return res;
+}
+
+void TModbusIODevice::SetCapabilities(const TDeviceCapabilities& capabilities)
+{
+    TSerialDevice::SetCapabilities(capabilities);
+    ReadSplits->Set(capabilities.ReadSplits);
+    if (ReadLimits) {
+        ReadLimits->Set(capabilities.ReadLimits);
+    }
 }
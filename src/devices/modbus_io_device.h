@@ -14,6 +14,9 @@ class TModbusIODevice: public TSerialDevice, public TUInt32SlaveId
     int Shift = 0;
     Modbus::TRegisterCache ModbusCache;
     TRunningAverage<std::chrono::microseconds, 10> ResponseTime;
+    bool VerifySetupRegisters;
+    Modbus::PAdaptiveReadLimits ReadLimits;
+    Modbus::PReadSplits ReadSplits;
 
 public:
     TModbusIODevice(std::unique_ptr<Modbus::IModbusTraits> modbusTraits,
@@ -25,8 +28,12 @@ public:
     void ReadRegisterRange(PRegisterRange range) override;
     void WriteSetupRegisters() override;
 
+    TDeviceCapabilities GetCapabilities() const override;
+    void SetCapabilities(const TDeviceCapabilities& capabilities) override;
+
     static void Register(TSerialDeviceFactory& factory);
 
 protected:
     void WriteRegisterImpl(PRegister reg, const TRegisterValue& value) override;
+    void WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten) override;
 };
@@ -1,12 +1,14 @@
 #include "file_descriptor_port.h"
 #include "binary_semaphore.h"
 #include "common_utils.h"
+#include "port_reactor.h"
 #include "serial_exc.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <sys/ioctl.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <unistd.h>
 #include <wblib/utils.h>
 
@@ -21,9 +23,12 @@ namespace
     const chrono::milliseconds NoiseTimeout(1);
     const chrono::milliseconds ContinuousNoiseTimeout(100);
     const int ContinuousNoiseReopenNumber = 3;
+
+    // Enough for several pipelined Modbus TCP responses
+    const size_t RX_BUFFER_SIZE = 4096;
 }
 
-TFileDescriptorPort::TFileDescriptorPort(): Fd(-1)
+TFileDescriptorPort::TFileDescriptorPort(): Fd(-1), RxBuffer(RX_BUFFER_SIZE), RxStart(0), RxEnd(0)
 {}
 
 TFileDescriptorPort::~TFileDescriptorPort()
@@ -38,6 +43,7 @@ void TFileDescriptorPort::Close()
     CheckPortOpen();
     close(Fd);
     Fd = -1;
+    ClearRxBuffer();
 }
 
 bool TFileDescriptorPort::IsOpen() const
@@ -73,18 +79,12 @@ void TFileDescriptorPort::WriteBytes(const uint8_t* buf, int count)
 
 bool TFileDescriptorPort::Select(const chrono::microseconds& us)
 {
-    fd_set rfds;
-    struct timeval tv, *tvp = 0;
-
-    FD_ZERO(&rfds);
-    FD_SET(Fd, &rfds);
-    if (us.count() > 0) {
-        tv.tv_sec = us.count() / 1000000;
-        tv.tv_usec = us.count() % 1000000;
-        tvp = &tv;
+    if (RxStart != RxEnd) {
+        return true;
     }
 
-    int r = select(Fd + 1, &rfds, NULL, NULL, tvp);
+    // Zero timeout means infinite waiting
+    int r = WaitForFd(Fd, POLLIN, (us.count() > 0) ? us : chrono::microseconds(-1));
     if (r < 0) {
         throw TSerialDeviceErrnoException("TFileDescriptorPort::Select() failed: ", errno);
     }
@@ -95,6 +95,15 @@ bool TFileDescriptorPort::Select(const chrono::microseconds& us)
 void TFileDescriptorPort::OnReadyEmptyFd()
 {}
 
+void TFileDescriptorPort::OnFramePartReceived(size_t size, const std::chrono::microseconds& gap)
+{}
+
+void TFileDescriptorPort::ClearRxBuffer()
+{
+    RxStart = 0;
+    RxEnd = 0;
+}
+
 uint8_t TFileDescriptorPort::ReadByte(const chrono::microseconds& timeout)
 {
     CheckPortOpen();
@@ -104,48 +113,44 @@ uint8_t TFileDescriptorPort::ReadByte(const chrono::microseconds& timeout)
     }
 
     uint8_t b;
-    if (read(Fd, &b, 1) < 1) {
+    if (ReadAvailableData(&b, 1) < 1) {
         throw TSerialDeviceException("read() failed");
     }
 
     LastInteraction = std::chrono::steady_clock::now();
 
-    LOG(Debug) << GetDescription(false) << ": Read: " << hex << setw(2) << setfill('0') << int(b);
+    if (::Debug.IsEnabled()) {
+        LOG(Debug) << GetDescription(false) << ": Read: " << hex << setw(2) << setfill('0') << int(b);
+    }
 
     return b;
 }
 
 size_t TFileDescriptorPort::ReadAvailableData(uint8_t* buf, size_t max_read)
 {
-    // We don't want to use non-blocking IO in general
-    // (e.g. we want blocking writes), but we don't want
-    // read() call below to block because actual frame
-    // size is not known at this point. So we must
-    // know how many bytes are available
-    int nb = 0;
-    if (ioctl(Fd, FIONREAD, &nb) < 0) {
-        throw TSerialDeviceException("FIONREAD ioctl() failed");
-    }
-
-    // Got Fd as ready for read from select, but no actual data to read
-    if (!nb) {
-        OnReadyEmptyFd();
-        return 0;
-    }
-
-    if (nb >= 0 && static_cast<size_t>(nb) > max_read) {
-        nb = max_read;
-    }
+    if (RxStart == RxEnd) {
+        // Fd is ready, so read() doesn't block and returns all received bytes fitting into the buffer
+        auto n = read(Fd, RxBuffer.data(), RxBuffer.size());
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            throw TSerialDeviceErrnoException("read() failed: ", errno);
+        }
 
-    int n = read(Fd, buf, nb);
-    if (n < 0) {
-        throw TSerialDeviceException("read() failed");
-    }
+        // Got Fd as ready for read from select, but no actual data to read
+        if (n == 0) {
+            OnReadyEmptyFd();
+            return 0;
+        }
 
-    if (n < nb) { // may happen only due to a kernel/driver bug
-        throw TSerialDeviceException("short read()");
+        RxStart = 0;
+        RxEnd = n;
     }
 
+    auto nb = std::min(max_read, RxEnd - RxStart);
+    memcpy(buf, RxBuffer.data() + RxStart, nb);
+    RxStart += nb;
     return nb;
 }
 
@@ -168,6 +173,7 @@ TReadFrameResult TFileDescriptorPort::ReadFrame(uint8_t* buf,
 
     // Will wait first byte up to responseTimeout us
     auto selectTimeout = responseTimeout;
+    std::chrono::steady_clock::time_point lastPartTime;
     while (res.Count < size) {
         if (frame_complete && frame_complete(buf, res.Count)) {
             break;
@@ -186,9 +192,13 @@ TReadFrameResult TFileDescriptorPort::ReadFrame(uint8_t* buf,
         // Got something, switch to frameTimeout to detect frame boundary
         // Delay between bytes in one message can't be more than frameTimeout
         selectTimeout = frameTimeout;
+        auto now = std::chrono::steady_clock::now();
         if (res.Count == 0) {
             res.ResponseTime = spentTime.GetSpentTime();
+        } else {
+            OnFramePartReceived(nb, std::chrono::duration_cast<std::chrono::microseconds>(now - lastPartTime));
         }
+        lastPartTime = now;
         res.Count += nb;
     }
 
@@ -241,6 +251,6 @@ void TFileDescriptorPort::SleepSinceLastInteraction(const chrono::microseconds&
 {
     auto now = chrono::steady_clock::now();
     auto delta = chrono::duration_cast<chrono::microseconds>(now - LastInteraction);
-    std::this_thread::sleep_for(us - delta);
+    SleepFor(us - delta);
     LOG(Debug) << GetDescription(false) << ": Sleep " << us.count() << " us";
 }
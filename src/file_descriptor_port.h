@@ -29,16 +29,34 @@ protected:
     bool Select(const std::chrono::microseconds& us);
     virtual void OnReadyEmptyFd();
 
+    /**
+     * @brief Called by ReadFrame for every part of a frame except the first one
+     *
+     * @param size part size in bytes
+     * @param gap time since the previous part was received
+     */
+    virtual void OnFramePartReceived(size_t size, const std::chrono::microseconds& gap);
+
+    //! Drop received bytes not consumed by ReadByte, ReadFrame or SkipNoise yet
+    void ClearRxBuffer();
+
     int Fd;
     std::chrono::time_point<std::chrono::steady_clock> LastInteraction;
 
 private:
     /**
-     * @brief Reads data from port. Throws TSerialDeviceException on errors
+     * @brief Reads data from port. Throws TSerialDeviceException on errors.
+     *        Bytes are taken from receive buffer.
+     *        If it is empty, all available bytes are read into it by one read() call.
      *
      * @param buf buffer to read to
      * @param max_read maximum bytes to read
      * @return size_t actual read bytes number
      */
     size_t ReadAvailableData(uint8_t* buf, size_t max_read);
+
+    //! Receive buffer, bytes from RxStart to RxEnd are not consumed yet
+    std::vector<uint8_t> RxBuffer;
+    size_t RxStart;
+    size_t RxEnd;
 };
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "log.h"
+#include "port_reactor.h"
 #include "serial_exc.h"
 #include "serial_port.h"
 
@@ -333,7 +334,7 @@ void TIEC61107ModeCDevice::SendEndSession()
     WriteBytes(IEC::MakeRequest("B0", CrcFn));
 
     // A device needs some time to process the command
-    std::this_thread::sleep_for(DeviceConfig()->FrameTimeout);
+    SleepFor(DeviceConfig()->FrameTimeout);
 }
 
 size_t TIEC61107ModeCDevice::ReadFrameProgMode(uint8_t* buf, size_t size, uint8_t startByte)
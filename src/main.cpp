@@ -6,6 +6,7 @@
 #include <wblib/signal_handling.h>
 #include <wblib/wbmqtt.h>
 
+#include <cctype>
 #include <filesystem>
 #include <fstream>
 #include <getopt.h>
@@ -18,6 +19,7 @@
 
 #include "device_template_generator.h"
 #include "files_watcher.h"
+#include "poll_plan_simulator.h"
 #include "rpc_config.h"
 #include "rpc_config_handler.h"
 #include "rpc_handler.h"
@@ -35,6 +37,7 @@ const auto driverName = "wb-modbus";
 const auto APP_NAME = "wb-mqtt-serial";
 
 const auto LIBWBMQTT_DB_FULL_FILE_PATH = "/var/lib/wb-mqtt-serial/libwbmqtt.db";
+const auto DEVICE_CAPABILITIES_FULL_FILE_PATH = "/var/lib/wb-mqtt-serial/capabilities.json";
 const auto CONFIG_FULL_FILE_PATH = "/etc/wb-mqtt-serial.conf";
 const auto TEMPLATES_DIR = "/usr/share/wb-mqtt-serial/templates";
 const auto USER_TEMPLATES_DIR = "/etc/wb-mqtt-serial.conf.d/templates";
@@ -81,7 +84,9 @@ namespace
              << "  -g                 Generate JSON Schema for wb-mqtt-confed" << endl
              << "  -J                 Make /etc/wb-mqtt-serial.conf from wb-mqtt-confed output" << endl
              << "  -G       options   Generate device template. Type \"-G help\" for options description" << endl
-             << "  -v                 Print the version" << endl;
+             << "  -v                 Print the version" << endl
+             << "  --simulate[=time]  Simulate polling of configured devices during time seconds (default: 60)" << endl
+             << "                     and print estimated bus load without accessing hardware" << endl;
     }
 
     /**
@@ -191,12 +196,39 @@ namespace
         exit(2);
     }
 
-    void ParseCommadLine(int argc, char* argv[], WBMQTT::TMosquittoMqttConfig& mqttConfig, string& customConfig)
+    void ParseCommadLine(int argc,
+                         char* argv[],
+                         WBMQTT::TMosquittoMqttConfig& mqttConfig,
+                         string& customConfig,
+                         std::optional<TPollPlanSimulator::TSettings>& simulatorSettings)
     {
+        const int SIMULATE_OPTION = 256;
+        const option longOptions[] = {{"simulate", optional_argument, nullptr, SIMULATE_OPTION}, {0, 0, 0, 0}};
         int c;
 
-        while ((c = getopt(argc, argv, "d:c:h:H:p:u:P:T:jJgG:v")) != -1) {
+        while ((c = getopt_long(argc, argv, "d:c:h:H:p:u:P:T:jJgG:v", longOptions, nullptr)) != -1) {
             switch (c) {
+                case SIMULATE_OPTION:
+                    simulatorSettings = TPollPlanSimulator::TSettings();
+                    if (optarg) {
+                        try {
+                            // stoul accepts leading spaces and signs, e.g. "-5" becomes a huge value
+                            if (!isdigit(static_cast<unsigned char>(optarg[0]))) {
+                                throw invalid_argument(optarg);
+                            }
+                            size_t pos = 0;
+                            auto seconds = stoul(optarg, &pos);
+                            if (optarg[pos] != '\0' || seconds == 0) {
+                                throw invalid_argument(optarg);
+                            }
+                            simulatorSettings->Duration = chrono::seconds(seconds);
+                        } catch (...) {
+                            cout << "Invalid --simulate parameter value " << optarg << endl;
+                            PrintUsage();
+                            exit(2);
+                        }
+                    }
+                    break;
                 case 'd':
                     SetDebugLevel(optarg);
                     break;
@@ -275,18 +307,45 @@ namespace
             confedSchemasMap.InvalidateCache(templates.DeleteTemplate(fileName));
         }
     }
+
+    int Simulate(const TPollPlanSimulator::TSettings& settings,
+                 const string& configFilename,
+                 TSerialDeviceFactory& deviceFactory,
+                 const Json::Value& commonDeviceSchema,
+                 TTemplateMap& templates,
+                 const Json::Value& portsSchema,
+                 TProtocolConfedSchemasMap& protocolSchemas)
+    {
+        try {
+            TPollPlanSimulator simulator(settings);
+            auto handlerConfig = LoadConfig(configFilename,
+                                            deviceFactory,
+                                            commonDeviceSchema,
+                                            templates,
+                                            std::make_shared<TRPCConfig>(),
+                                            portsSchema,
+                                            protocolSchemas,
+                                            simulator.GetPortFactory());
+            PrintSimulationReport(cout, simulator.Run(*handlerConfig));
+        } catch (const exception& e) {
+            LOG(Error) << e.what();
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 }
 
 int main(int argc, char* argv[])
 {
     WBMQTT::TMosquittoMqttConfig mqttConfig;
     string configFilename(CONFIG_FULL_FILE_PATH);
+    std::optional<TPollPlanSimulator::TSettings> simulatorSettings;
 
     WBMQTT::SignalHandling::Handle({SIGINT, SIGTERM});
     WBMQTT::SignalHandling::OnSignals({SIGINT, SIGTERM}, [&] { WBMQTT::SignalHandling::Stop(); });
     WBMQTT::SetThreadName(APP_NAME);
 
-    ParseCommadLine(argc, argv, mqttConfig, configFilename);
+    ParseCommadLine(argc, argv, mqttConfig, configFilename, simulatorSettings);
 
     TSerialDeviceFactory deviceFactory;
     RegisterProtocols(deviceFactory);
@@ -298,6 +357,16 @@ int main(int argc, char* argv[])
     TProtocolConfedSchemasMap protocolSchemasMap(PROTOCOL_SCHEMAS_DIR, *commonDeviceSchema);
     auto portsSchema = WBMQTT::JSON::Parse(PORTS_JSON_SCHEMA_FULL_FILE_PATH);
 
+    if (simulatorSettings) {
+        return Simulate(*simulatorSettings,
+                        configFilename,
+                        deviceFactory,
+                        *commonDeviceSchema,
+                        *templates,
+                        portsSchema,
+                        protocolSchemasMap);
+    }
+
     try {
         SchemaForConfed();
     } catch (const exception& e) {
@@ -375,7 +444,9 @@ int main(int argc, char* argv[])
 
             driver->WaitForReady();
 
-            serialDriver = make_shared<TMQTTSerialDriver>(driver, handlerConfig);
+            auto capabilitiesCache = make_shared<TDeviceCapabilitiesCache>(DEVICE_CAPABILITIES_FULL_FILE_PATH);
+            capabilitiesCache->Load();
+            serialDriver = make_shared<TMQTTSerialDriver>(driver, handlerConfig, capabilitiesCache);
             rpcHandler =
                 std::make_shared<TRPCHandler>(RPC_REQUEST_SCHEMA_FULL_FILE_PATH, rpcConfig, rpcServer, serialDriver);
         }
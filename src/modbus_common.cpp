@@ -4,9 +4,12 @@
 #include "log.h"
 #include "serial_device.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <exception>
+#include <iterator>
 #include <math.h>
 #include <netinet/in.h>
 #include <string.h>
@@ -25,14 +28,27 @@ namespace Modbus // modbus protocol declarations
 
     const int MAX_READ_REGISTERS = 125;
 
+    const int MAX_WRITE_BITS = 1968;
+
+    const int MAX_WRITE_REGISTERS = 123;
+
     const size_t EXCEPTION_RESPONSE_PDU_SIZE = 2;
     const size_t WRITE_RESPONSE_PDU_SIZE = 5;
 
+    // Request 8 bytes: SlaveID, Operation, Addr, Count, CRC
+    const size_t REQUEST_FRAME_SIZE = 8;
+
+    // Response 5 bytes except data: SlaveID, Operation, Size, CRC
+    const size_t RESPONSE_FRAME_SIZE = 5;
+
     const int MAX_HOLE_CONTINUOUS_16_BIT_REGISTERS = 10;
     const int MAX_HOLE_CONTINUOUS_1_BIT_REGISTERS = MAX_HOLE_CONTINUOUS_16_BIT_REGISTERS * 8;
 
     const uint16_t ENABLE_CONTINUOUS_READ_REGISTER = 114;
 
+    const uint16_t WB_FW_VERSION_REGISTER = 250;
+    const uint8_t WB_FW_VERSION_SIZE = 16;
+
     enum Error : uint8_t
     {
         ERR_NONE = 0x0,
@@ -102,6 +118,45 @@ namespace // general utilities
     {
         return (type == Modbus::REG_COIL) || (type == Modbus::REG_DISCRETE);
     }
+
+    size_t GetConfiguredMaxReadRegisters(const TRegister& reg)
+    {
+        auto maxRegs = IsSingleBitType(reg.Type) ? Modbus::MAX_READ_BITS : Modbus::MAX_READ_REGISTERS;
+        const auto& deviceConfig = *(reg.Device()->DeviceConfig());
+        if ((deviceConfig.MaxReadRegisters > 0) && (deviceConfig.MaxReadRegisters <= maxRegs)) {
+            maxRegs = deviceConfig.MaxReadRegisters;
+        }
+        return maxRegs;
+    }
+
+    // returns true if the register can be written by one request together with neighbours
+    bool CanWriteTogether(const TRegister& reg)
+    {
+        if (!reg.Device()->GetSupportsWriteTogether(reg.Type)) {
+            return false;
+        }
+        if (reg.Type == Modbus::REG_COIL) {
+            return true;
+        }
+        return (reg.Type == Modbus::REG_HOLDING || reg.Type == Modbus::REG_HOLDING_MULTI) &&
+               (reg.Format != RegisterFormat::String);
+    }
+
+    // writes use the same length limit as reads
+    size_t GetMaxWriteRegisters(const TRegister& reg)
+    {
+        size_t maxRegs = (reg.Type == Modbus::REG_COIL) ? Modbus::MAX_WRITE_BITS : Modbus::MAX_WRITE_REGISTERS;
+        return std::min(GetConfiguredMaxReadRegisters(reg), maxRegs);
+    }
+
+    int GetConfiguredMaxHole(const TRegister& reg)
+    {
+        if (!reg.Device()->GetSupportsHoles()) {
+            return 0;
+        }
+        const auto& deviceConfig = *(reg.Device()->DeviceConfig());
+        return IsSingleBitType(reg.Type) ? deviceConfig.MaxBitHole : deviceConfig.MaxRegHole;
+    }
 } // general utilities
 
 namespace Modbus // modbus protocol common utilities
@@ -113,9 +168,162 @@ namespace Modbus // modbus protocol common utilities
     TInvalidCRCError::TInvalidCRCError(): TMalformedResponseError("invalid crc")
     {}
 
-    TModbusRegisterRange::TModbusRegisterRange(std::chrono::microseconds averageResponseTime)
+    TAdaptiveLimit::TAdaptiveLimit(size_t accepted, size_t max): Accepted(accepted), Rejected(max + 1), Max(max)
+    {}
+
+    size_t TAdaptiveLimit::Get() const
+    {
+        if (Rejected > Max) {
+            return Max;
+        }
+        return Accepted + (Rejected - Accepted) / 2;
+    }
+
+    void TAdaptiveLimit::Accept(size_t value)
+    {
+        Accepted = std::max(Accepted, value);
+        if (Rejected <= Accepted) {
+            Rejected = Max + 1;
+            RejectedByTimeout = false;
+        }
+        // Device's limits can change after firmware update, try a bit more than accepted value.
+        // A rejected try costs only one request, its registers are read again by shorter ones
+        if (Rejected <= Max && ++AcceptsCount >= RETRY_ACCEPTS_COUNT) {
+            Rejected = std::min(Accepted + 2, Max + 1);
+            AcceptsCount = 0;
+        }
+    }
+
+    bool TAdaptiveLimit::Reject(size_t value, bool timeout)
+    {
+        if (value <= Accepted) {
+            return false;
+        }
+        if (value < Rejected) {
+            Rejected = value;
+            RejectedByTimeout = timeout;
+        } else if (value == Rejected && !timeout) {
+            RejectedByTimeout = false;
+        }
+        AcceptsCount = 0;
+        return true;
+    }
+
+    size_t TAdaptiveLimit::GetAccepted() const
+    {
+        return Accepted;
+    }
+
+    size_t TAdaptiveLimit::GetRejected() const
+    {
+        return RejectedByTimeout ? Max + 1 : Rejected;
+    }
+
+    void TAdaptiveLimit::Restore(size_t accepted, size_t rejected)
+    {
+        Accepted = std::min(accepted, Max);
+        Rejected = std::min(std::max(rejected, Accepted + 1), Max + 1);
+        AcceptsCount = 0;
+        RejectedByTimeout = false;
+    }
+
+    TAdaptiveLimit& TAdaptiveReadLimits::GetLength(int type)
+    {
+        auto maxRegs = IsSingleBitType(type) ? MAX_READ_BITS : MAX_READ_REGISTERS;
+        return Lengths.try_emplace(type, 1, maxRegs).first->second;
+    }
+
+    TAdaptiveLimit& TAdaptiveReadLimits::GetHole(int type)
+    {
+        auto maxHole =
+            IsSingleBitType(type) ? MAX_HOLE_CONTINUOUS_1_BIT_REGISTERS : MAX_HOLE_CONTINUOUS_16_BIT_REGISTERS;
+        return Holes.try_emplace(type, 0, maxHole).first->second;
+    }
+
+    size_t TAdaptiveReadLimits::GetMaxReadRegisters(int type)
+    {
+        return GetLength(type).Get();
+    }
+
+    size_t TAdaptiveReadLimits::GetMaxHole(int type)
+    {
+        return GetHole(type).Get();
+    }
+
+    void TAdaptiveReadLimits::Accept(int type, size_t count, size_t maxHole)
+    {
+        GetLength(type).Accept(count);
+        GetHole(type).Accept(maxHole);
+    }
+
+    bool TAdaptiveReadLimits::Reject(int type, size_t count, size_t maxHole, bool timeout)
+    {
+        // Holes are suspected first as they are more often not supported than long requests
+        if (maxHole != 0 && GetHole(type).Reject(maxHole, timeout)) {
+            return true;
+        }
+        return GetLength(type).Reject(count, timeout);
+    }
+
+    std::map<int, TLearnedReadLimits> TAdaptiveReadLimits::Get() const
+    {
+        std::map<int, TLearnedReadLimits> res;
+        for (const auto& length: Lengths) {
+            auto& limits = res[length.first];
+            limits.AcceptedLength = length.second.GetAccepted();
+            limits.RejectedLength = length.second.GetRejected();
+            auto hole = Holes.find(length.first);
+            limits.AcceptedHole = (hole != Holes.end()) ? hole->second.GetAccepted() : 0;
+            limits.RejectedHole = (hole != Holes.end()) ? hole->second.GetRejected() : 0;
+        }
+        return res;
+    }
+
+    void TAdaptiveReadLimits::Set(const std::map<int, TLearnedReadLimits>& limits)
+    {
+        Lengths.clear();
+        Holes.clear();
+        for (const auto& typeLimits: limits) {
+            GetLength(typeLimits.first).Restore(typeLimits.second.AcceptedLength, typeLimits.second.RejectedLength);
+            GetHole(typeLimits.first).Restore(typeLimits.second.AcceptedHole, typeLimits.second.RejectedHole);
+        }
+    }
+
+    void TReadSplits::Add(int type, uint32_t addr)
+    {
+        Splits[type].insert(addr);
+    }
+
+    const std::set<uint32_t>& TReadSplits::GetPoints(int type) const
+    {
+        static const std::set<uint32_t> noSplits;
+        auto it = Splits.find(type);
+        return (it != Splits.end()) ? it->second : noSplits;
+    }
+
+    std::map<int, std::set<uint32_t>> TReadSplits::Get() const
+    {
+        return Splits;
+    }
+
+    void TReadSplits::Set(const std::map<int, std::set<uint32_t>>& splits)
+    {
+        Splits = splits;
+    }
+
+    bool CrossesSplit(const std::set<uint32_t>& splits, uint32_t start, uint32_t end)
+    {
+        auto it = splits.upper_bound(start);
+        return (it != splits.end()) && (*it < end);
+    }
+
+    TModbusRegisterRange::TModbusRegisterRange(std::chrono::microseconds averageResponseTime,
+                                               PAdaptiveReadLimits readLimits,
+                                               PReadSplits readSplits)
         : AverageResponseTime(averageResponseTime),
-          ResponseTime(averageResponseTime)
+          ResponseTime(averageResponseTime),
+          ReadLimits(readLimits),
+          ReadSplits(readSplits)
     {}
 
     TModbusRegisterRange::~TModbusRegisterRange()
@@ -151,11 +359,7 @@ namespace Modbus // modbus protocol common utilities
             }
 
             // Can't add register separated from last in the range by more than maxHole registers
-            int maxHole = 0;
-            if (reg->Device()->GetSupportsHoles()) {
-                maxHole = isSingleBit ? deviceConfig.MaxBitHole : deviceConfig.MaxRegHole;
-            }
-            if (Start + Count + maxHole < addr) {
+            if (Start + Count + GetMaxHole(*reg) < addr) {
                 return false;
             }
 
@@ -187,21 +391,18 @@ namespace Modbus // modbus protocol common utilities
 
             extend = std::max(0, static_cast<int>(addr + widthInWords) - static_cast<int>(Start + Count));
 
-            auto maxRegs = isSingleBit ? MAX_READ_BITS : MAX_READ_REGISTERS;
-            if ((deviceConfig.MaxReadRegisters > 0) && (deviceConfig.MaxReadRegisters <= maxRegs)) {
-                maxRegs = deviceConfig.MaxReadRegisters;
+            if (Count + extend > GetMaxReadRegisters(*reg)) {
+                return false;
             }
-            if (Count + extend > static_cast<size_t>(maxRegs)) {
+
+            if (extend != 0 && ReadSplits &&
+                CrossesSplit(ReadSplits->GetPoints(reg->Type), Start, Start + Count + extend))
+            {
                 return false;
             }
         }
 
-        auto newPduSize = InferReadResponsePDUSize(reg->Type, Count + extend);
-        // Request 8 bytes: SlaveID, Operation, Addr, Count, CRC
-        // Response 5 bytes except data: SlaveID, Operation, Size, CRC
-        auto sendTime = reg->Device()->Port()->GetSendTimeBytes(newPduSize + 8 + 5);
-        auto newPollTime = std::chrono::ceil<std::chrono::milliseconds>(
-            sendTime + AverageResponseTime + deviceConfig.RequestDelay + 2 * deviceConfig.FrameTimeout);
+        auto newPollTime = std::chrono::ceil<std::chrono::milliseconds>(GetPollTime(*reg, Count + extend));
 
         if (((Count != 0) && !AddingRegisterIncreasesSize(isSingleBit, extend)) || (newPollTime <= pollLimit)) {
 
@@ -214,6 +415,8 @@ namespace Modbus // modbus protocol common utilities
             return true;
         }
         if (newPollTime > pollLimit) {
+            auto sendTime = reg->Device()->Port()->GetSendTimeBytes(
+                InferReadResponsePDUSize(reg->Type, Count + extend) + REQUEST_FRAME_SIZE + RESPONSE_FRAME_SIZE);
             LOG(Debug) << "Poll time for " << reg->ToString() << " is too long: " << newPollTime.count() << " ms"
                        << " (sendTime=" << sendTime.count() << " us, "
                        << "AverageResponseTime=" << AverageResponseTime.count() << " us, "
@@ -224,6 +427,117 @@ namespace Modbus // modbus protocol common utilities
         return false;
     }
 
+    std::list<PRegister> TModbusRegisterRange::AddRegisters(const std::list<PRegister>& registers,
+                                                            std::chrono::milliseconds pollLimit,
+                                                            bool readAtLeastOneRegister)
+    {
+        auto first = std::find_if(registers.begin(), registers.end(), [](const auto& reg) {
+            return reg->GetAvailable() != TRegisterAvailability::UNAVAILABLE;
+        });
+        if (!RegisterList().empty() || first == registers.end() ||
+            (*first)->GetAvailable() == TRegisterAvailability::UNKNOWN)
+        {
+            return TRegisterRange::AddRegisters(registers, pollLimit, readAtLeastOneRegister);
+        }
+
+        // Unavailable registers are dropped as in Add
+        std::list<PRegister> notAdded;
+        std::vector<PRegister> candidates;
+        for (const auto& reg: registers) {
+            if (reg->GetAvailable() == TRegisterAvailability::AVAILABLE && reg->Device() == (*first)->Device() &&
+                reg->Type == (*first)->Type)
+            {
+                candidates.push_back(reg);
+            } else if (reg->GetAvailable() != TRegisterAvailability::UNAVAILABLE) {
+                notAdded.push_back(reg);
+            }
+        }
+
+        std::vector<size_t> sorted(candidates.size());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            sorted[i] = i;
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [&](size_t i1, size_t i2) {
+            return GetUint32RegisterAddress(candidates[i1]->GetAddress()) <
+                   GetUint32RegisterAddress(candidates[i2]->GetAddress());
+        });
+        std::vector<TRegisterSpan> spans;
+        size_t firstPos = 0;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            const auto& reg = *candidates[sorted[i]];
+            auto addr = GetUint32RegisterAddress(reg.GetAddress());
+            spans.push_back({addr, addr + GetModbusDataWidthIn16BitWords(reg)});
+            if (sorted[i] == 0) {
+                firstPos = i;
+            }
+        }
+
+        auto plan = PlanReadRequests(spans,
+                                     GetMaxReadRegisters(**first),
+                                     GetMaxHole(**first),
+                                     pollLimit,
+                                     [&](size_t count) { return GetPollTime(**first, count); },
+                                     ReadSplits ? ReadSplits->GetPoints((*first)->Type) : std::set<uint32_t>());
+
+        // Read the request with the most urgent register
+        auto requestIt = std::upper_bound(plan.begin(), plan.end(), firstPos);
+        size_t requestEnd = (requestIt == plan.end()) ? spans.size() : *requestIt;
+        size_t requestStart = *(--requestIt);
+        uint32_t end = spans[requestStart].End;
+        bool hasHoles = false;
+        for (size_t i = requestStart + 1; i < requestEnd; ++i) {
+            hasHoles = hasHoles || (spans[i].Start > end);
+            end = std::max(end, spans[i].End);
+        }
+        auto count = end - spans[requestStart].Start;
+        if (!readAtLeastOneRegister &&
+            std::chrono::ceil<std::chrono::milliseconds>(GetPollTime(**first, count)) > pollLimit)
+        {
+            notAdded.insert(notAdded.end(), candidates.begin(), candidates.end());
+            return notAdded;
+        }
+
+        std::vector<bool> inRequest(candidates.size(), false);
+        for (size_t i = requestStart; i < requestEnd; ++i) {
+            inRequest[sorted[i]] = true;
+        }
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (inRequest[i]) {
+                RegisterList().push_back(candidates[i]);
+            } else {
+                notAdded.push_back(candidates[i]);
+            }
+        }
+        Start = spans[requestStart].Start;
+        Count = count;
+        HasHolesFlg = hasHoles;
+        return notAdded;
+    }
+
+    size_t TModbusRegisterRange::GetMaxReadRegisters(const TRegister& reg) const
+    {
+        if (ReadLimits) {
+            return ReadLimits->GetMaxReadRegisters(reg.Type);
+        }
+        return GetConfiguredMaxReadRegisters(reg);
+    }
+
+    size_t TModbusRegisterRange::GetMaxHole(const TRegister& reg) const
+    {
+        if (ReadLimits) {
+            return ReadLimits->GetMaxHole(reg.Type);
+        }
+        return GetConfiguredMaxHole(reg);
+    }
+
+    std::chrono::microseconds TModbusRegisterRange::GetPollTime(const TRegister& reg, size_t count) const
+    {
+        const auto& deviceConfig = *(reg.Device()->DeviceConfig());
+        auto sendTime = reg.Device()->Port()->GetSendTimeBytes(InferReadResponsePDUSize(reg.Type, count) +
+                                                               REQUEST_FRAME_SIZE + RESPONSE_FRAME_SIZE);
+        return sendTime + AverageResponseTime + deviceConfig.RequestDelay + 2 * deviceConfig.FrameTimeout;
+    }
+
     uint8_t* TModbusRegisterRange::GetBits()
     {
         if (!IsSingleBitType(Type()))
@@ -334,6 +648,35 @@ namespace Modbus // modbus protocol common utilities
         return ResponseTime;
     }
 
+    PAdaptiveReadLimits TModbusRegisterRange::GetReadLimits() const
+    {
+        return ReadLimits;
+    }
+
+    PReadSplits TModbusRegisterRange::GetReadSplits() const
+    {
+        return ReadSplits;
+    }
+
+    size_t TModbusRegisterRange::GetMaxHoleSize() const
+    {
+        std::vector<TRegisterSpan> spans;
+        for (const auto& reg: RegisterList()) {
+            auto addr = GetUint32RegisterAddress(reg->GetAddress());
+            spans.push_back({addr, addr + GetModbusDataWidthIn16BitWords(*reg)});
+        }
+        std::sort(spans.begin(), spans.end(), [](const auto& s1, const auto& s2) { return s1.Start < s2.Start; });
+        size_t maxHole = 0;
+        uint32_t end = spans.empty() ? 0 : spans.front().End;
+        for (const auto& span: spans) {
+            if (span.Start > end) {
+                maxHole = std::max<size_t>(maxHole, span.Start - end);
+            }
+            end = std::max(end, span.End);
+        }
+        return maxHole;
+    }
+
     ostream& operator<<(ostream& s, const TModbusRegisterRange& range)
     {
         s << range.GetCount() << " " << range.TypeName() << "(s) @ " << range.GetStart() << " of device "
@@ -542,6 +885,31 @@ namespace Modbus // modbus protocol common utilities
         return IsException(pdu) ? EXCEPTION_RESPONSE_PDU_SIZE : WRITE_RESPONSE_PDU_SIZE;
     }
 
+    // returns response PDU size inferred from its function code,
+    // 0 if the function code is unknown or not enough bytes are received to know the size
+    size_t InferResponsePDUSize(const uint8_t* pdu, size_t size)
+    {
+        if (size == 0) {
+            return 0;
+        }
+        if (IsException(pdu)) {
+            return EXCEPTION_RESPONSE_PDU_SIZE;
+        }
+        switch (pdu[0]) {
+            case FN_READ_COILS:
+            case FN_READ_DISCRETE:
+            case FN_READ_HOLDING:
+            case FN_READ_INPUT:
+                return (size < 2) ? 0 : ReadResponsePDUSize(pdu);
+            case FN_WRITE_SINGLE_COIL:
+            case FN_WRITE_SINGLE_REGISTER:
+            case FN_WRITE_MULTIPLE_COILS:
+            case FN_WRITE_MULTIPLE_REGISTERS:
+                return WRITE_RESPONSE_PDU_SIZE;
+        }
+        return 0;
+    }
+
     // fills pdu with read request data according to Modbus specification
     void ComposeReadRequestPDU(uint8_t* pdu, const TRegister& reg, int shift)
     {
@@ -592,6 +960,87 @@ namespace Modbus // modbus protocol common utilities
         }
     }
 
+    void PlaceRegisterValue(uint16_t* words, const TRegister& reg, uint64_t value)
+    {
+        auto widthInModbusWords = GetModbusDataWidthIn16BitWords(reg);
+
+        uint64_t composed = 0;
+        for (size_t i = 0; i < widthInModbusWords; ++i) {
+            composed <<= 16;
+            composed |= (reg.WordOrder == EWordOrder::BigEndian) ? words[i] : words[widthInModbusWords - 1 - i];
+        }
+
+        // Clear place for data to be written
+        composed &= ~(GetLSBMask(reg.GetDataWidth()) << reg.GetDataOffset());
+
+        // Place data
+        value <<= reg.GetDataOffset();
+        composed |= value;
+
+        for (size_t i = 0; i < widthInModbusWords; ++i) {
+            auto word = static_cast<uint16_t>(composed >> (widthInModbusWords - 1 - i) * 16);
+            if (reg.WordOrder == EWordOrder::BigEndian) {
+                words[i] = word;
+            } else {
+                words[widthInModbusWords - 1 - i] = word;
+            }
+        }
+    }
+
+    uint64_t ExtractRegisterValue(const uint16_t* words, const TRegister& reg)
+    {
+        int wordCount = GetModbusDataWidthIn16BitWords(reg);
+
+        uint64_t r = 0;
+        if (reg.WordOrder == EWordOrder::LittleEndian) {
+            for (int i = wordCount - 1; i >= 0; --i) {
+                r <<= 16;
+                r |= words[i];
+            }
+        } else {
+            for (int i = 0; i < wordCount; ++i) {
+                r <<= 16;
+                r |= words[i];
+            }
+        }
+
+        r >>= reg.GetDataOffset();
+        r &= GetLSBMask(reg.GetDataWidth());
+
+        return r;
+    }
+
+    // fills data with register value merged with cached bits of other registers sharing its words
+    void ComposeRegisterWords(uint8_t* data,
+                              const TRegister& reg,
+                              uint64_t value,
+                              uint32_t baseAddress,
+                              Modbus::TRegisterCache& tmpCache,
+                              const Modbus::TRegisterCache& cache)
+    {
+        auto widthInModbusWords = GetModbusDataWidthIn16BitWords(reg);
+
+        // Fill value from cache
+        std::array<uint16_t, 4> words{};
+        TAddress address{0};
+        address.Type = reg.Type;
+        for (size_t i = 0; i < widthInModbusWords; ++i) {
+            address.Address = baseAddress + i;
+            auto it = cache.find(address.AbsAddress);
+            if (it != cache.end()) {
+                words[i] = it->second;
+            }
+        }
+
+        PlaceRegisterValue(words.data(), reg, value);
+
+        for (size_t i = 0; i < widthInModbusWords; ++i) {
+            address.Address = baseAddress + i;
+            tmpCache[address.AbsAddress] = words[i];
+            WriteAs2Bytes(data + i * 2, words[i]);
+        }
+    }
+
     // fills pdu with write request data according to Modbus specification
     void ComposeMultipleWriteRequestPDU(uint8_t* pdu,
                                         const TRegister& reg,
@@ -612,45 +1061,7 @@ namespace Modbus // modbus protocol common utilities
 
         pdu[5] = widthInModbusWords * 2;
 
-        // Fill value from cache
-        TAddress address{0};
-        address.Type = reg.Type;
-        address.Address = baseAddress;
-        int step_k = 1;
-        if (reg.WordOrder == EWordOrder::LittleEndian) {
-            address.Address += widthInModbusWords - 1;
-            step_k = -1;
-        }
-        uint64_t valueToWrite = 0;
-        for (size_t i = 0; i < widthInModbusWords; ++i) {
-            valueToWrite <<= 16;
-            if (cache.count(address.AbsAddress)) {
-                valueToWrite |= cache.at(address.AbsAddress);
-            }
-            address.Address += step_k;
-        }
-
-        // Clear place for data to be written
-        valueToWrite &= ~(GetLSBMask(reg.GetDataWidth()) << reg.GetDataOffset());
-
-        // Place data
-        value <<= reg.GetDataOffset();
-        valueToWrite |= value;
-
-        for (size_t i = 0; i < widthInModbusWords; ++i) {
-            address.Address = baseAddress + i;
-            uint16_t wordValue = (reg.WordOrder == EWordOrder::BigEndian)
-                                     ? (valueToWrite >> (widthInModbusWords - 1) * 16) & 0xFFFF
-                                     : valueToWrite & 0xFFFF;
-
-            tmpCache[address.AbsAddress] = wordValue;
-            WriteAs2Bytes(pdu + 6 + i * 2, wordValue);
-            if (reg.WordOrder == EWordOrder::BigEndian) {
-                valueToWrite <<= 16;
-            } else {
-                valueToWrite >>= 16;
-            }
-        }
+        ComposeRegisterWords(pdu + 6, reg, value, baseAddress, tmpCache, cache);
     }
 
     void ComposeSingleWriteRequestPDU(uint8_t* pdu,
@@ -723,25 +1134,7 @@ namespace Modbus // modbus protocol common utilities
     uint64_t GetRegisterValueFromReadData(const uint16_t* rangeData, size_t rangeStartAddr, const TRegister& reg)
     {
         auto addr = GetUint32RegisterAddress(reg.GetAddress());
-        int wordCount = GetModbusDataWidthIn16BitWords(reg);
-
-        uint64_t r = 0;
-        if (reg.WordOrder == EWordOrder::LittleEndian) {
-            for (int i = wordCount - 1; i >= 0; --i) {
-                r <<= 16;
-                r |= rangeData[addr - rangeStartAddr + i];
-            }
-        } else {
-            for (int i = 0; i < wordCount; ++i) {
-                r <<= 16;
-                r |= rangeData[addr - rangeStartAddr + i];
-            }
-        }
-
-        r >>= reg.GetDataOffset();
-        r &= GetLSBMask(reg.GetDataWidth());
-
-        return r;
+        return ExtractRegisterValue(rangeData + addr - rangeStartAddr, reg);
     }
 
     std::string GetStringRegisterValueFromReadData(const uint16_t* rangeData,
@@ -821,9 +1214,60 @@ namespace Modbus // modbus protocol common utilities
         }
     }
 
-    PRegisterRange CreateRegisterRange(std::chrono::microseconds averageResponseTime)
+    PRegisterRange CreateRegisterRange(std::chrono::microseconds averageResponseTime,
+                                       PAdaptiveReadLimits readLimits,
+                                       PReadSplits readSplits)
     {
-        return std::make_shared<TModbusRegisterRange>(averageResponseTime);
+        return std::make_shared<TModbusRegisterRange>(averageResponseTime, readLimits, readSplits);
+    }
+
+    std::vector<size_t> PlanReadRequests(const std::vector<TRegisterSpan>& spans,
+                                         size_t maxRegs,
+                                         size_t maxHole,
+                                         std::chrono::milliseconds pollLimit,
+                                         const TReadRequestTimeFn& getRequestTime,
+                                         const std::set<uint32_t>& splits)
+    {
+        // cost[i] is minimal bus time of reading spans from i to the end, next[i] is start of the following request
+        std::vector<std::chrono::microseconds> cost(spans.size() + 1, std::chrono::microseconds::zero());
+        std::vector<size_t> next(spans.size() + 1, spans.size());
+        for (size_t i = spans.size(); i-- > 0;) {
+            const auto start = spans[i].Start;
+            auto end = spans[i].End;
+            cost[i] = std::chrono::microseconds::max();
+            for (size_t j = i; j < spans.size(); ++j) {
+                if (j != i) {
+                    if (spans[j].Start > end + maxHole) {
+                        break;
+                    }
+                    auto newEnd = std::max(end, spans[j].End);
+                    // Registers not extending the request are always read together
+                    if (newEnd - start > maxRegs) {
+                        break;
+                    }
+                    if (newEnd != end && CrossesSplit(splits, start, newEnd)) {
+                        break;
+                    }
+                    if (newEnd != end &&
+                        std::chrono::ceil<std::chrono::milliseconds>(getRequestTime(newEnd - start)) > pollLimit)
+                    {
+                        break;
+                    }
+                    end = newEnd;
+                }
+                auto requestCost = getRequestTime(end - start) + cost[j + 1];
+                // Prefer longer requests if costs are equal
+                if (requestCost <= cost[i]) {
+                    cost[i] = requestCost;
+                    next[i] = j + 1;
+                }
+            }
+        }
+        std::vector<size_t> res;
+        for (size_t i = 0; i < spans.size(); i = next[i]) {
+            res.push_back(i);
+        }
+        return res;
     }
 
     TReadFrameResult ReadResponse(IModbusTraits& traits,
@@ -846,23 +1290,18 @@ namespace Modbus // modbus protocol common utilities
         return res;
     }
 
-    void WriteRegister(IModbusTraits& traits,
-                       TPort& port,
-                       uint8_t slaveId,
-                       TRegister& reg,
-                       const TRegisterValue& value,
-                       Modbus::TRegisterCache& cache,
-                       int shift)
+    // composes requests writing a register, words of the register are stored in tmpCache
+    vector<TRequest> ComposeWriteRequests(IModbusTraits& traits,
+                                          uint8_t slaveId,
+                                          const TRegister& reg,
+                                          const TRegisterValue& value,
+                                          int shift,
+                                          Modbus::TRegisterCache& tmpCache,
+                                          const Modbus::TRegisterCache& cache)
     {
-        Modbus::TRegisterCache tmpCache;
-
         LOG(Debug) << "write " << GetModbusDataWidthIn16BitWords(reg) << " " << reg.TypeName << "(s) @ "
                    << reg.GetWriteAddress() << " of device " << reg.Device()->ToString();
 
-        // 1 byte - function code, 2 bytes - register address, 2 bytes - value
-        const uint16_t WRITE_RESPONSE_PDU_SIZE = 5;
-        TResponse response(traits.GetPacketSize(WRITE_RESPONSE_PDU_SIZE));
-
         vector<TRequest> requests(InferWriteRequestsCount(reg));
 
         if (IsPacking(reg)) {
@@ -899,8 +1338,22 @@ namespace Modbus // modbus protocol common utilities
                 traits.FinalizeRequest(req, slaveId);
             }
         }
+        return requests;
+    }
 
-        for (const auto& request: requests) {
+    void WriteRegister(IModbusTraits& traits,
+                       TPort& port,
+                       uint8_t slaveId,
+                       TRegister& reg,
+                       const TRegisterValue& value,
+                       Modbus::TRegisterCache& cache,
+                       int shift)
+    {
+        Modbus::TRegisterCache tmpCache;
+
+        TResponse response(traits.GetPacketSize(WRITE_RESPONSE_PDU_SIZE));
+
+        for (const auto& request: ComposeWriteRequests(traits, slaveId, reg, value, shift, tmpCache, cache)) {
             try {
                 port.SleepSinceLastInteraction(reg.Device()->DeviceConfig()->RequestDelay);
                 port.WriteBytes(request.data(), request.size());
@@ -921,6 +1374,280 @@ namespace Modbus // modbus protocol common utilities
         }
     }
 
+    // composes FC16 or FC15 request writing registers at contiguous addresses
+    TRequest ComposeWriteRegistersTogether(IModbusTraits& traits,
+                                           uint8_t slaveId,
+                                           std::vector<TRegisterWrite>::iterator first,
+                                           std::vector<TRegisterWrite>::iterator last,
+                                           int shift,
+                                           Modbus::TRegisterCache& tmpCache,
+                                           const Modbus::TRegisterCache& cache)
+    {
+        const auto& firstReg = *first->Register;
+        auto startAddress = GetUint32RegisterAddress(firstReg.GetWriteAddress()) + shift;
+        size_t count = 0;
+        for (auto it = first; it != last; ++it) {
+            count += GetModbusDataWidthIn16BitWords(*it->Register);
+        }
+        const bool isCoil = (firstReg.Type == REG_COIL);
+        size_t dataSize = isCoil ? (count + 7) / 8 : count * 2;
+
+        LOG(Debug) << "write " << count << " " << firstReg.TypeName << "(s) @ " << firstReg.GetWriteAddress()
+                   << " of device " << firstReg.Device()->ToString();
+
+        TRequest request(traits.GetPacketSize(6 + dataSize));
+        auto pdu = traits.GetPDU(request);
+        pdu[0] = GetFunctionImpl(firstReg.Type, OperationType::OP_WRITE, firstReg.TypeName, true);
+        WriteAs2Bytes(pdu + 1, startAddress);
+        WriteAs2Bytes(pdu + 3, count);
+        pdu[5] = dataSize;
+
+        for (auto it = first; it != last; ++it) {
+            const auto& reg = *it->Register;
+            auto offset = GetUint32RegisterAddress(reg.GetWriteAddress()) + shift - startAddress;
+            if (isCoil) {
+                if (it->Value.Get<uint64_t>() != 0) {
+                    pdu[6 + offset / 8] |= 1 << (offset % 8);
+                }
+            } else {
+                ComposeRegisterWords(pdu + 6 + offset * 2,
+                                     reg,
+                                     it->Value.Get<uint64_t>(),
+                                     startAddress + offset,
+                                     tmpCache,
+                                     cache);
+            }
+        }
+        traits.FinalizeRequest(request, slaveId);
+        return request;
+    }
+
+    void WriteRegisterOrSaveError(IModbusTraits& traits,
+                                  TPort& port,
+                                  uint8_t slaveId,
+                                  TRegisterWrite& write,
+                                  Modbus::TRegisterCache& cache,
+                                  int shift)
+    {
+        try {
+            WriteRegister(traits, port, slaveId, *write.Register, write.Value, cache, shift);
+        } catch (const TSerialDeviceException&) {
+            write.Error = std::current_exception();
+        }
+    }
+
+    // returns end of writes to be combined with the first one into one request
+    std::vector<TRegisterWrite>::iterator GetWritesTogetherEnd(std::vector<TRegisterWrite>::iterator first,
+                                                                std::vector<TRegisterWrite>::iterator end)
+    {
+        auto last = first + 1;
+        const auto& firstReg = *first->Register;
+        if (!CanWriteTogether(firstReg)) {
+            return last;
+        }
+        auto maxRegs = GetMaxWriteRegisters(firstReg);
+        size_t count = GetModbusDataWidthIn16BitWords(firstReg);
+        auto endAddress = GetUint32RegisterAddress(firstReg.GetWriteAddress()) + count;
+        for (; last != end; ++last) {
+            const auto& reg = *last->Register;
+            auto width = GetModbusDataWidthIn16BitWords(reg);
+            // Writing across a hole would overwrite registers not being written
+            if (reg.Type != firstReg.Type || GetUint32RegisterAddress(reg.GetWriteAddress()) != endAddress ||
+                count + width > maxRegs)
+            {
+                break;
+            }
+            count += width;
+            endAddress += width;
+        }
+        return last;
+    }
+
+    struct TTransaction
+    {
+        TRequest Request;
+        TResponse Response;
+        size_t PduSize = 0;
+        std::exception_ptr Error;
+    };
+
+    /**
+     * @brief Send all requests by one write and then read responses to them, errors are stored in transactions.
+     *        If a response to one of several requests is not received, pipelining is disabled.
+     */
+    void Transfer(IModbusTraits& traits, TPort& port, const TSerialDevice& device, std::vector<TTransaction>& transactions)
+    {
+        const auto& config = *device.DeviceConfig();
+        // Separate small writes would be delayed by Nagle's algorithm until the first response
+        std::vector<uint8_t> requests;
+        for (const auto& transaction: transactions) {
+            requests.insert(requests.end(), transaction.Request.begin(), transaction.Request.end());
+        }
+        try {
+            port.SleepSinceLastInteraction(config.RequestDelay);
+            port.WriteBytes(requests.data(), requests.size());
+        } catch (const TSerialDeviceException&) {
+            for (auto& transaction: transactions) {
+                transaction.Error = std::current_exception();
+            }
+            return;
+        }
+
+        bool failed = false;
+        for (auto& transaction: transactions) {
+            try {
+                transaction.PduSize =
+                    ReadResponse(traits, port, transaction.Request, transaction.Response, config).Count;
+            } catch (const TMalformedResponseError&) {
+                try {
+                    port.SkipNoise();
+                } catch (const std::exception& e) {
+                    LOG(Warn) << "SkipNoise failed: " << e.what();
+                }
+                transaction.Error = std::current_exception();
+            } catch (const TSerialDeviceException&) {
+                transaction.Error = std::current_exception();
+            }
+            failed = failed || transaction.Error;
+        }
+
+        if (failed && transactions.size() > 1 && traits.DisablePipelining()) {
+            LOG(Warn) << "Not all pipelined requests to " << device.ToString()
+                      << " are answered, requests are sent one by one";
+        }
+    }
+
+    size_t WriteRegisters(IModbusTraits& traits,
+                          TPort& port,
+                          uint8_t slaveId,
+                          std::vector<TRegisterWrite>& writes,
+                          Modbus::TRegisterCache& cache,
+                          const TRegisterWrittenFn& onWritten,
+                          int shift)
+    {
+        // Writes sent by one request
+        struct TWriteGroup
+        {
+            std::vector<TRegisterWrite>::iterator First;
+            std::vector<TRegisterWrite>::iterator Last;
+            Modbus::TRegisterCache WrittenWords;
+        };
+
+        size_t requests = 0;
+        auto first = writes.begin();
+        while (first != writes.end()) {
+            const auto window = traits.GetPipelineWindow();
+
+            // Requests are composed before sending, so words of previous requests are taken from batchCache
+            Modbus::TRegisterCache batchCache;
+            if (window > 1) {
+                batchCache = cache;
+            }
+            const auto& composeCache = (window > 1) ? batchCache : cache;
+
+            // Only neighbouring writes are combined, so the order of writes is kept
+            std::vector<TWriteGroup> groups;
+            std::vector<TTransaction> transactions;
+            while (first != writes.end() && groups.size() < window) {
+                auto last = GetWritesTogetherEnd(first, writes.end());
+                if (last - first == 1 && InferWriteRequestsCount(*first->Register) > 1) {
+                    // Requests of the register are sent one by one after already composed ones
+                    if (!groups.empty()) {
+                        break;
+                    }
+                    requests += InferWriteRequestsCount(*first->Register);
+                    WriteRegisterOrSaveError(traits, port, slaveId, *first, cache, shift);
+                    onWritten(*first);
+                    first = last;
+                    continue;
+                }
+
+                TWriteGroup group{first, last};
+                TTransaction transaction;
+                if (last - first == 1) {
+                    transaction.Request = ComposeWriteRequests(traits,
+                                                               slaveId,
+                                                               *first->Register,
+                                                               first->Value,
+                                                               shift,
+                                                               group.WrittenWords,
+                                                               composeCache)
+                                              .front();
+                } else {
+                    transaction.Request = ComposeWriteRegistersTogether(traits,
+                                                                        slaveId,
+                                                                        first,
+                                                                        last,
+                                                                        shift,
+                                                                        group.WrittenWords,
+                                                                        composeCache);
+                }
+                transaction.Response.resize(traits.GetPacketSize(WRITE_RESPONSE_PDU_SIZE));
+                if (window > 1) {
+                    for (const auto& item: group.WrittenWords) {
+                        batchCache.insert_or_assign(item.first, item.second);
+                    }
+                }
+                groups.push_back(std::move(group));
+                transactions.push_back(std::move(transaction));
+                first = last;
+            }
+            if (groups.empty()) {
+                continue;
+            }
+
+            Transfer(traits, port, *groups.front().First->Register->Device(), transactions);
+            requests += transactions.size();
+
+            for (size_t i = 0; i < groups.size(); ++i) {
+                const auto& transaction = transactions[i];
+                auto it = groups[i].First;
+                auto last = groups[i].Last;
+                try {
+                    if (transaction.Error) {
+                        std::rethrow_exception(transaction.Error);
+                    }
+                    ParseWriteResponse(traits.GetPDU(transaction.Response), transaction.PduSize);
+                    for (const auto& item: groups[i].WrittenWords) {
+                        cache.insert_or_assign(item.first, item.second);
+                    }
+                } catch (const TSerialDevicePermanentRegisterException& e) {
+                    if (last - it > 1) {
+                        // Find registers rejected by the device
+                        LOG(Debug) << "failed to write " << (last - it) << " " << it->Register->TypeName
+                                   << "(s) @ " << it->Register->GetWriteAddress() << " together: " << e.what()
+                                   << ", write them one by one";
+                        const auto& firstReg = *it->Register;
+                        bool singleWritesSucceeded = true;
+                        for (; it != last; ++it) {
+                            requests += InferWriteRequestsCount(*it->Register);
+                            WriteRegisterOrSaveError(traits, port, slaveId, *it, cache, shift);
+                            singleWritesSucceeded = singleWritesSucceeded && !it->Error;
+                            onWritten(*it);
+                        }
+                        // The device doesn't support multiple registers writing (e.g. only 0x06 is implemented),
+                        // so a failed request before single writes is not sent again
+                        if (singleWritesSucceeded) {
+                            LOG(Info) << firstReg.Device()->ToString() << " rejects writing several "
+                                      << firstReg.TypeName << "s by one request, they will be written one by one";
+                            firstReg.Device()->SetSupportsWriteTogether(firstReg.Type, false);
+                        }
+                        continue;
+                    }
+                    it->Error = std::current_exception();
+                } catch (const TSerialDeviceException&) {
+                    for (auto errorIt = it; errorIt != last; ++errorIt) {
+                        errorIt->Error = std::current_exception();
+                    }
+                }
+                for (; it != last; ++it) {
+                    onWritten(*it);
+                }
+            }
+        }
+        return requests;
+    }
+
     void ProcessRangeException(TModbusRegisterRange& range, const char* msg)
     {
         for (auto& reg: range.RegisterList()) {
@@ -932,31 +1659,349 @@ namespace Modbus // modbus protocol common utilities
         range.Device()->SetTransferResult(false);
     }
 
-    void ReadRegisterRange(IModbusTraits& traits,
-                           TPort& port,
-                           uint8_t slaveId,
-                           TModbusRegisterRange& range,
-                           Modbus::TRegisterCache& cache,
-                           int shift)
+    void LogReducedReadLimits(TModbusRegisterRange& range, TAdaptiveReadLimits& readLimits)
     {
-        if (range.RegisterList().empty()) {
-            return;
+        LOG(Info) << "Read limits of " << range.TypeName() << " registers of device " << range.Device()->ToString()
+                  << " are reduced to " << readLimits.GetMaxReadRegisters(range.Type()) << " registers and "
+                  << readLimits.GetMaxHole(range.Type()) << " hole";
+    }
+
+    std::vector<PRegister> GetRegistersSortedByAddress(const TModbusRegisterRange& range)
+    {
+        std::vector<PRegister> registers(range.RegisterList().begin(), range.RegisterList().end());
+        std::stable_sort(registers.begin(), registers.end(), [](const auto& r1, const auto& r2) {
+            return GetUint32RegisterAddress(r1->GetAddress()) < GetUint32RegisterAddress(r2->GetAddress());
+        });
+        return registers;
+    }
+
+    enum class TRangeReadResult
+    {
+        OK,
+        REJECTED,
+        ERROR
+    };
+
+    TRangeReadResult ReadRegisterRangeOrSplit(IModbusTraits& traits,
+                                              TPort& port,
+                                              uint8_t slaveId,
+                                              TModbusRegisterRange& range,
+                                              Modbus::TRegisterCache& cache,
+                                              int shift);
+
+    TRangeReadResult TryReadRegisterRange(IModbusTraits& traits,
+                                          TPort& port,
+                                          uint8_t slaveId,
+                                          TModbusRegisterRange& range,
+                                          Modbus::TRegisterCache& cache,
+                                          int shift,
+                                          std::exception_ptr& rejection);
+
+    TRangeReadResult ProcessRejectedRange(IModbusTraits& traits,
+                                          TPort& port,
+                                          uint8_t slaveId,
+                                          TModbusRegisterRange& range,
+                                          Modbus::TRegisterCache& cache,
+                                          int shift,
+                                          std::exception_ptr rejection);
+
+    /**
+     * @brief Split registers of a range into two ranges with the closest to equal sizes.
+     *        Registers with the same address are kept in one half.
+     * @return address of the first register of the second half or 0 if the range can't be split
+     */
+    uint32_t SplitRangeInHalves(const TModbusRegisterRange& range,
+                                TModbusRegisterRange& first,
+                                TModbusRegisterRange& second)
+    {
+        auto registers = GetRegistersSortedByAddress(range);
+        // Index of the first register of the second half, the closest to the middle
+        size_t middle = 0;
+        auto distanceToMiddle = [&](size_t i) {
+            return std::abs(static_cast<int>(2 * i) - static_cast<int>(registers.size()));
+        };
+        for (size_t i = 1; i < registers.size(); ++i) {
+            if (GetUint32RegisterAddress(registers[i - 1]->GetAddress()) !=
+                    GetUint32RegisterAddress(registers[i]->GetAddress()) &&
+                (middle == 0 || distanceToMiddle(i) < distanceToMiddle(middle)))
+            {
+                middle = i;
+            }
+        }
+        if (middle == 0) {
+            return 0;
+        }
+        for (size_t i = 0; i < registers.size(); ++i) {
+            if (!(i < middle ? first : second).Add(registers[i], std::chrono::milliseconds::max())) {
+                return 0;
+            }
+        }
+        return GetUint32RegisterAddress(registers[middle]->GetAddress());
+    }
+
+    /**
+     * @brief Read halves of a rejected range by separate requests.
+     *        A rejected half is split further, so a few unsupported addresses are found by O(log n) requests.
+     * @return false if the range can't be split or both halves are rejected
+     */
+    bool ReadRegisterRangeHalves(IModbusTraits& traits,
+                                 TPort& port,
+                                 uint8_t slaveId,
+                                 TModbusRegisterRange& range,
+                                 Modbus::TRegisterCache& cache,
+                                 int shift)
+    {
+        auto readSplits = range.GetReadSplits();
+        TModbusRegisterRange first(range.GetResponseTime(), range.GetReadLimits(), readSplits);
+        TModbusRegisterRange second(range.GetResponseTime(), range.GetReadLimits(), readSplits);
+        auto splitAddress = SplitRangeInHalves(range, first, second);
+        if (splitAddress == 0) {
+            return false;
+        }
+
+        LOG(Debug) << "failed to read " << range << ", reading it by two requests split at " << splitAddress;
+        std::exception_ptr firstRejection;
+        auto firstRes = TryReadRegisterRange(traits, port, slaveId, first, cache, shift, firstRejection);
+        if (firstRes == TRangeReadResult::ERROR) {
+            // Don't waste bus time on a device which doesn't respond
+            for (auto& reg: second.RegisterList()) {
+                reg->SetError(TRegister::TError::ReadError);
+            }
+            return true;
+        }
+        std::exception_ptr secondRejection;
+        auto secondRes = TryReadRegisterRange(traits, port, slaveId, second, cache, shift, secondRejection);
+        if (secondRes == TRangeReadResult::ERROR) {
+            if (firstRejection) {
+                for (auto& reg: first.RegisterList()) {
+                    reg->SetError(TRegister::TError::ReadError);
+                }
+            }
+            return true;
+        }
+        if (firstRejection && secondRejection) {
+            // Probably the whole block is not supported by the device.
+            // Splitting it further would take a request per register
+            return false;
         }
+        if (firstRejection) {
+            ProcessRejectedRange(traits, port, slaveId, first, cache, shift, firstRejection);
+        } else if (secondRejection) {
+            ProcessRejectedRange(traits, port, slaveId, second, cache, shift, secondRejection);
+        } else if (readSplits) {
+            readSplits->Add(range.Type(), splitAddress);
+            LOG(Info) << "Read requests of " << range.TypeName() << " registers of device "
+                      << range.Device()->ToString() << " are split at address " << splitAddress;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read registers of a range rejected because of its length or holes
+     *        by requests fitting reduced adaptive read limits.
+     */
+    TRangeReadResult ReadRegisterRangeWithReducedLimits(IModbusTraits& traits,
+                                                        TPort& port,
+                                                        uint8_t slaveId,
+                                                        TModbusRegisterRange& range,
+                                                        Modbus::TRegisterCache& cache,
+                                                        int shift)
+    {
+        auto registers = GetRegistersSortedByAddress(range);
+        auto res = TRangeReadResult::OK;
+        auto it = registers.begin();
+        while (it != registers.end()) {
+            // Limits can be reduced again while reading a part, so next part is built after that
+            TModbusRegisterRange part(range.GetResponseTime(), range.GetReadLimits(), range.GetReadSplits());
+            while (it != registers.end() && part.Add(*it, std::chrono::milliseconds::max())) {
+                ++it;
+            }
+            if (part.RegisterList().empty()) {
+                continue;
+            }
+            auto partRes = ReadRegisterRangeOrSplit(traits, port, slaveId, part, cache, shift);
+            if (partRes == TRangeReadResult::ERROR) {
+                // Don't waste bus time on a device which doesn't respond
+                for (; it != registers.end(); ++it) {
+                    (*it)->SetError(TRegister::TError::ReadError);
+                }
+                return TRangeReadResult::ERROR;
+            }
+            if (partRes == TRangeReadResult::REJECTED) {
+                res = TRangeReadResult::REJECTED;
+            }
+        }
+        return res;
+    }
+
+    /**
+     * @brief Put registers with the lowest address of the range to first and other ones to rest.
+     * @return false if all registers of the range have the same address
+     */
+    bool SplitFirstAddress(const TModbusRegisterRange& range, TModbusRegisterRange& first, TModbusRegisterRange& rest)
+    {
+        auto registers = GetRegistersSortedByAddress(range);
+        auto firstAddress = GetUint32RegisterAddress(registers.front()->GetAddress());
+        for (const auto& reg: registers) {
+            auto& part = (GetUint32RegisterAddress(reg->GetAddress()) == firstAddress) ? first : rest;
+            if (!part.Add(reg, std::chrono::milliseconds::max())) {
+                return false;
+            }
+        }
+        return !rest.RegisterList().empty();
+    }
+
+    /**
+     * @brief Check if a range timed out because of its size.
+     *        A timeout can also be caused by noise or by a device which is off,
+     *        so limits are reduced only if the shortest request to the same registers succeeds just after that.
+     *        Otherwise it is a usual transfer error.
+     */
+    TRangeReadResult ReadTimedOutRange(IModbusTraits& traits,
+                                       TPort& port,
+                                       uint8_t slaveId,
+                                       TModbusRegisterRange& range,
+                                       TModbusRegisterRange& first,
+                                       TModbusRegisterRange& rest,
+                                       Modbus::TRegisterCache& cache,
+                                       int shift,
+                                       const TResponseTimeoutException& timeout)
+    {
+        auto& readLimits = *range.GetReadLimits();
+        try {
+            first.ReadRange(traits, port, slaveId, shift, cache);
+        } catch (const TSerialDeviceException&) {
+            ProcessRangeException(range, timeout.what());
+            return TRangeReadResult::ERROR;
+        }
+        range.Device()->SetTransferResult(true);
+        readLimits.Accept(first.Type(), first.GetCount(), first.GetMaxHoleSize());
+
+        if (range.Device()->GetConnectionState() == TDeviceConnectionState::CONNECTED &&
+            readLimits.Reject(range.Type(), range.GetCount(), range.GetMaxHoleSize(), true))
+        {
+            LogReducedReadLimits(range, readLimits);
+            return ReadRegisterRangeWithReducedLimits(traits, port, slaveId, rest, cache, shift);
+        }
+        return ReadRegisterRangeOrSplit(traits, port, slaveId, rest, cache, shift);
+    }
+
+    /**
+     * @brief Read a range by one request.
+     *        An exception of a rejected request is stored to rejection without processing,
+     *        so the caller decides whether to split the range.
+     */
+    TRangeReadResult TryReadRegisterRange(IModbusTraits& traits,
+                                          TPort& port,
+                                          uint8_t slaveId,
+                                          TModbusRegisterRange& range,
+                                          Modbus::TRegisterCache& cache,
+                                          int shift,
+                                          std::exception_ptr& rejection)
+    {
+        auto readLimits = range.GetReadLimits();
         try {
             range.ReadRange(traits, port, slaveId, shift, cache);
             range.Device()->SetTransferResult(true);
+            if (readLimits) {
+                readLimits->Accept(range.Type(), range.GetCount(), range.GetMaxHoleSize());
+            }
+            return TRangeReadResult::OK;
+        } catch (const TSerialDevicePermanentRegisterException&) {
+            rejection = std::current_exception();
+            return TRangeReadResult::REJECTED;
+        } catch (const TResponseTimeoutException& e) {
+            // Some devices silently drop requests they can't process.
+            // Requests of a disconnected device time out regardless of their size
+            if (readLimits && range.Device()->GetConnectionState() != TDeviceConnectionState::DISCONNECTED) {
+                TModbusRegisterRange first(range.GetResponseTime(), readLimits, range.GetReadSplits());
+                TModbusRegisterRange rest(range.GetResponseTime(), readLimits, range.GetReadSplits());
+                if (SplitFirstAddress(range, first, rest)) {
+                    return ReadTimedOutRange(traits, port, slaveId, range, first, rest, cache, shift, e);
+                }
+            }
+            ProcessRangeException(range, e.what());
+        } catch (const TSerialDeviceException& e) {
+            ProcessRangeException(range, e.what());
+        }
+        return TRangeReadResult::ERROR;
+    }
+
+    /**
+     * @brief Read registers of a range rejected by the device with reduced limits, without holes or by parts.
+     *        Registers which can't be read are marked unavailable.
+     */
+    TRangeReadResult ProcessRejectedRange(IModbusTraits& traits,
+                                          TPort& port,
+                                          uint8_t slaveId,
+                                          TModbusRegisterRange& range,
+                                          Modbus::TRegisterCache& cache,
+                                          int shift,
+                                          std::exception_ptr rejection)
+    {
+        try {
+            std::rethrow_exception(rejection);
         } catch (const TSerialDevicePermanentRegisterException& e) {
-            if (range.HasHoles()) {
+            auto readLimits = range.GetReadLimits();
+            if (readLimits && readLimits->Reject(range.Type(), range.GetCount(), range.GetMaxHoleSize())) {
+                LogReducedReadLimits(range, *readLimits);
+                return ReadRegisterRangeWithReducedLimits(traits, port, slaveId, range, cache, shift);
+            }
+            if (range.HasHoles() && !readLimits) {
                 range.Device()->SetSupportsHoles(false);
+            } else if (ReadRegisterRangeHalves(traits, port, slaveId, range, cache, shift)) {
+                return TRangeReadResult::REJECTED;
             } else {
                 for (auto& reg: range.RegisterList()) {
                     reg->SetAvailable(TRegisterAvailability::UNAVAILABLE);
                 }
             }
             ProcessRangeException(range, e.what());
-        } catch (const TSerialDeviceException& e) {
-            ProcessRangeException(range, e.what());
         }
+        return TRangeReadResult::REJECTED;
+    }
+
+    TRangeReadResult ReadRegisterRangeOrSplit(IModbusTraits& traits,
+                                              TPort& port,
+                                              uint8_t slaveId,
+                                              TModbusRegisterRange& range,
+                                              Modbus::TRegisterCache& cache,
+                                              int shift)
+    {
+        std::exception_ptr rejection;
+        auto res = TryReadRegisterRange(traits, port, slaveId, range, cache, shift, rejection);
+        if (rejection) {
+            return ProcessRejectedRange(traits, port, slaveId, range, cache, shift, rejection);
+        }
+        return res;
+    }
+
+    void ReadRegisterRange(IModbusTraits& traits,
+                           TPort& port,
+                           uint8_t slaveId,
+                           TModbusRegisterRange& range,
+                           Modbus::TRegisterCache& cache,
+                           int shift)
+    {
+        if (range.RegisterList().empty()) {
+            return;
+        }
+        ReadRegisterRangeOrSplit(traits, port, slaveId, range, cache, shift);
+    }
+
+    std::string ReadWbFirmwareVersion(PSerialDevice device,
+                                      IModbusTraits& traits,
+                                      TPort& port,
+                                      uint8_t slaveId,
+                                      TRegisterCache& cache)
+    {
+        auto config = TRegister::Create(Modbus::REG_INPUT, WB_FW_VERSION_REGISTER, RegisterFormat::String);
+        config->SetDataWidth(WB_FW_VERSION_SIZE * 8);
+        auto reg = std::make_shared<TRegister>(device, config);
+        TModbusRegisterRange range(std::chrono::microseconds::zero());
+        range.Add(reg, std::chrono::milliseconds::max());
+        range.ReadRange(traits, port, slaveId, 0, cache);
+        return reg->GetValue().Get<std::string>();
     }
 
     void WarnFailedRegisterSetup(const PDeviceSetupItem& item, const char* msg)
@@ -964,35 +2009,125 @@ namespace Modbus // modbus protocol common utilities
         LOG(Warn) << "failed to write: " << item->Register->ToString() << ": " << msg;
     }
 
+    // reads setup registers and returns number of read requests, registers not read get ReadError
+    size_t ReadSetupRegisters(IModbusTraits& traits,
+                              TPort& port,
+                              uint8_t slaveId,
+                              const std::vector<PDeviceSetupItem>& setupItems,
+                              Modbus::TRegisterCache& cache,
+                              int shift)
+    {
+        std::list<PRegister> registers;
+        for (const auto& item: setupItems) {
+            auto& reg = item->Register;
+            if (reg->AccessType == TRegisterConfig::EAccessType::WRITE_ONLY) {
+                continue;
+            }
+            // Setup registers are not polled, so their availability is learned here
+            if (reg->GetAvailable() == TRegisterAvailability::UNKNOWN) {
+                reg->SetAvailable(TRegisterAvailability::AVAILABLE);
+            }
+            reg->SetError(TRegister::TError::ReadError);
+            registers.push_back(reg);
+        }
+        size_t requests = 0;
+        while (!registers.empty()) {
+            auto range = std::dynamic_pointer_cast<TModbusRegisterRange>(
+                setupItems.front()->Register->Device()->CreateRegisterRange());
+            registers = range->AddRegisters(registers, std::chrono::milliseconds::max(), true);
+            if (range->RegisterList().empty()) {
+                break;
+            }
+            ReadRegisterRange(traits, port, slaveId, *range, cache, shift);
+            ++requests;
+        }
+        return requests;
+    }
+
+    bool IsSetupValueWritten(const PDeviceSetupItem& item)
+    {
+        const auto& reg = *item->Register;
+        return (reg.AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) &&
+               !reg.GetErrorState().test(TRegister::TError::ReadError) && (reg.GetValue() == item->RawValue);
+    }
+
     void WriteSetupRegisters(Modbus::IModbusTraits& traits,
                              TPort& port,
                              uint8_t slaveId,
                              const std::vector<PDeviceSetupItem>& setupItems,
                              Modbus::TRegisterCache& cache,
-                             int shift)
+                             int shift,
+                             bool verify)
     {
-        for (const auto& item: setupItems) {
-            try {
-                WriteRegister(traits, port, slaveId, *item->Register, item->RawValue, cache, shift);
+        if (setupItems.empty()) {
+            return;
+        }
+        auto device = setupItems.front()->Register->Device();
+
+        size_t readRequests = 0;
+        std::vector<PDeviceSetupItem> items;
+        if (verify) {
+            readRequests = ReadSetupRegisters(traits, port, slaveId, setupItems, cache, shift);
+            std::copy_if(setupItems.begin(), setupItems.end(), std::back_inserter(items), [](const auto& item) {
+                return !IsSetupValueWritten(item);
+            });
+        } else {
+            items = setupItems;
+        }
 
-                std::stringstream ss;
-                ss << "Init: " << item->Name << ": setup register " << item->Register->ToString() << " <-- "
-                   << item->HumanReadableValue;
+        std::vector<TRegisterWrite> writes;
+        size_t singleRequests = 0;
+        for (const auto& item: items) {
+            writes.push_back({item->Register, item->RawValue, nullptr});
+            singleRequests += InferWriteRequestsCount(*item->Register);
+        }
 
-                if (item->RawValue.GetType() == TRegisterValue::ValueType::String) {
-                    ss << " ('" << item->RawValue << "')";
-                } else {
-                    ss << " (0x" << std::hex << item->RawValue << ")";
-                    // TODO: More verbose exception
+        auto onWritten = [&](const TRegisterWrite& write) {
+            const auto& item = items[&write - writes.data()];
+            if (write.Error) {
+                // Transient errors abort initialization as before
+                try {
+                    std::rethrow_exception(write.Error);
+                } catch (const TSerialDevicePermanentRegisterException& e) {
+                    WarnFailedRegisterSetup(item, e.what());
                 }
-                LOG(Info) << ss.str();
-            } catch (const TSerialDevicePermanentRegisterException& e) {
-                WarnFailedRegisterSetup(item, e.what());
+                return;
             }
+            std::stringstream ss;
+            ss << "Init: " << item->Name << ": setup register " << item->Register->ToString() << " <-- "
+               << item->HumanReadableValue;
+
+            if (item->RawValue.GetType() == TRegisterValue::ValueType::String) {
+                ss << " ('" << item->RawValue << "')";
+            } else {
+                ss << " (0x" << std::hex << item->RawValue << ")";
+                // TODO: More verbose exception
+            }
+            LOG(Info) << ss.str();
+        };
+        auto writeRequests = WriteRegisters(traits, port, slaveId, writes, cache, onWritten, shift);
+
+        std::stringstream ss;
+        ss << "Init: " << device->ToString() << ": " << writes.size() << " setup register(s) written by "
+           << writeRequests << " request(s) instead of " << singleRequests;
+        if (verify) {
+            ss << ", " << (setupItems.size() - items.size()) << " already set, checked by " << readRequests
+               << " read request(s)";
         }
-        if (!setupItems.empty()) {
-            setupItems.front()->Register->Device()->SetTransferResult(true);
-        }
+        LOG(Info) << ss.str();
+        device->SetTransferResult(true);
+    }
+
+    // IModbusTraits
+
+    size_t IModbusTraits::GetPipelineWindow() const
+    {
+        return 1;
+    }
+
+    bool IModbusTraits::DisablePipelining()
+    {
+        return false;
     }
 
     // TModbusRTUTraits
@@ -1005,9 +2140,10 @@ namespace Modbus // modbus protocol common utilities
         return [=](uint8_t* buf, size_t size) {
             if (size < 2)
                 return false;
-            if (Modbus::IsException(buf + 1)) // GetPDU
-                return size >= EXCEPTION_RESPONSE_PDU_SIZE + DATA_SIZE;
-            return size >= n;
+            // Frame size is known from function code, so the read completes as soon as the frame is received
+            // even if it differs from the expected one
+            auto pduSize = InferResponsePDUSize(buf + 1, size - 1); // GetPDU
+            return size >= (pduSize ? pduSize + DATA_SIZE : n);
         };
     }
 
@@ -1026,7 +2162,7 @@ namespace Modbus // modbus protocol common utilities
                                                  const std::chrono::milliseconds& responseTimeout,
                                                  const std::chrono::milliseconds& frameTimeout,
                                                  const TRequest& req,
-                                                 TResponse& res) const
+                                                 TResponse& res)
     {
         auto rc = port.ReadFrame(res.data(),
                                  res.size(),
@@ -1035,11 +2171,13 @@ namespace Modbus // modbus protocol common utilities
                                  ExpectNBytes(res.size()));
         // RTU response should be at least 3 bytes: 1 byte slave_id, 2 bytes CRC
         if (rc.Count < DATA_SIZE) {
+            port.ReportFrameError();
             throw Modbus::TMalformedResponseError("invalid data size");
         }
 
         uint16_t crc = (res[rc.Count - 2] << 8) + res[rc.Count - 1];
         if (crc != CRC16::CalculateCRC16(res.data(), rc.Count - 2)) {
+            port.ReportFrameError();
             throw TInvalidCRCError();
         }
 
@@ -1073,7 +2211,10 @@ namespace Modbus // modbus protocol common utilities
 
     // TModbusTCPTraits
 
-    TModbusTCPTraits::TModbusTCPTraits(std::shared_ptr<uint16_t> transactionId): TransactionId(transactionId)
+    TModbusTCPTraits::TModbusTCPTraits(std::shared_ptr<uint16_t> transactionId, size_t maxPipelinedRequests)
+        : TransactionId(transactionId),
+          MaxPipelinedRequests(std::max(maxPipelinedRequests, size_t(1))),
+          Pipelining(MaxPipelinedRequests > 1)
     {}
 
     void TModbusTCPTraits::SetMBAP(TRequest& req, uint16_t transactionId, size_t pduSize, uint8_t slaveId) const
@@ -1107,20 +2248,43 @@ namespace Modbus // modbus protocol common utilities
         SetMBAP(request, *TransactionId, request.size() - MBAP_SIZE, slaveId);
     }
 
+    bool TModbusTCPTraits::IsPipelinedAfter(uint16_t transactionId, uint16_t requestTransactionId) const
+    {
+        uint16_t distance = transactionId - requestTransactionId;
+        return distance != 0 && distance < MaxPipelinedRequests;
+    }
+
     TReadFrameResult TModbusTCPTraits::ReadFrame(TPort& port,
                                                  const std::chrono::milliseconds& responseTimeout,
                                                  const std::chrono::milliseconds& frameTimeout,
                                                  const TRequest& req,
-                                                 TResponse& res) const
-    {
+                                                 TResponse& res)
+    {
+        uint16_t requestTransactionId = (req[0] << 8) | req[1];
+        TReadFrameResult rc;
+        bool received = false;
+        for (auto it = EarlyResponses.begin(); it != EarlyResponses.end();) {
+            if (it->first == requestTransactionId) {
+                res = std::move(it->second);
+                rc.Count = res.size() - MBAP_SIZE;
+                received = true;
+            }
+            // Responses to requests sent before this one are not waited for anymore
+            if (!IsPipelinedAfter(it->first, requestTransactionId)) {
+                it = EarlyResponses.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
         auto startTime = chrono::steady_clock::now();
-        while (chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime) <
-               responseTimeout + frameTimeout)
+        while (!received && chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime) <
+                                responseTimeout + frameTimeout)
         {
             if (res.size() < MBAP_SIZE) {
                 res.resize(MBAP_SIZE);
             }
-            auto rc = port.ReadFrame(res.data(), MBAP_SIZE, responseTimeout + frameTimeout, frameTimeout);
+            rc = port.ReadFrame(res.data(), MBAP_SIZE, responseTimeout + frameTimeout, frameTimeout);
 
             if (rc.Count < MBAP_SIZE) {
                 throw TMalformedResponseError("Can't read full MBAP");
@@ -1144,17 +2308,39 @@ namespace Modbus // modbus protocol common utilities
             }
 
             // check transaction id
-            if (req[0] == res[0] && req[1] == res[1]) {
-                // check unit identifier
-                if (req[6] != res[6]) {
-                    throw TSerialDeviceTransientErrorException("request and response unit identifier mismatch");
+            uint16_t transactionId = (res[0] << 8) | res[1];
+            if (transactionId == requestTransactionId) {
+                received = true;
+                break;
+            }
+
+            if (IsPipelinedAfter(transactionId, requestTransactionId)) {
+                EarlyResponses[transactionId].assign(res.begin(), res.begin() + MBAP_SIZE + len);
+                if (DisablePipelining()) {
+                    LOG(Warn) << "Response to transaction " << transactionId << " came before response to "
+                              << requestTransactionId << " [unit id is " << static_cast<int>(req[6])
+                              << "], requests are sent one by one";
                 }
-                return rc;
+                continue;
             }
 
             LOG(Debug) << "Transaction id mismatch";
         }
-        throw TResponseTimeoutException();
+        if (!received) {
+            throw TResponseTimeoutException();
+        }
+
+        // check unit identifier
+        if (req[6] != res[6]) {
+            throw TSerialDeviceTransientErrorException("request and response unit identifier mismatch");
+        }
+
+        if (!Pipelining && MaxPipelinedRequests > 1 &&
+            ++SerialResponsesCount >= PIPELINING_RETRY_RESPONSES_COUNT) {
+            Pipelining = true;
+            LOG(Info) << "Pipelining of requests [unit id is " << static_cast<int>(req[6]) << "] is enabled again";
+        }
+        return rc;
     }
 
     uint8_t* TModbusTCPTraits::GetPDU(std::vector<uint8_t>& frame) const
@@ -1167,18 +2353,37 @@ namespace Modbus // modbus protocol common utilities
         return &frame[MBAP_SIZE];
     }
 
-    std::unique_ptr<Modbus::IModbusTraits> TModbusRTUTraitsFactory::GetModbusTraits(PPort port, bool forceFrameTimeout)
+    size_t TModbusTCPTraits::GetPipelineWindow() const
+    {
+        return Pipelining ? MaxPipelinedRequests : 1;
+    }
+
+    bool TModbusTCPTraits::DisablePipelining()
+    {
+        if (!Pipelining) {
+            return false;
+        }
+        Pipelining = false;
+        SerialResponsesCount = 0;
+        return true;
+    }
+
+    std::unique_ptr<Modbus::IModbusTraits> TModbusRTUTraitsFactory::GetModbusTraits(PPort port,
+                                                                                    bool forceFrameTimeout,
+                                                                                    size_t maxPipelinedRequests)
     {
         return std::make_unique<Modbus::TModbusRTUTraits>(forceFrameTimeout);
     }
 
-    std::unique_ptr<Modbus::IModbusTraits> TModbusTCPTraitsFactory::GetModbusTraits(PPort port, bool forceFrameTimeout)
+    std::unique_ptr<Modbus::IModbusTraits> TModbusTCPTraitsFactory::GetModbusTraits(PPort port,
+                                                                                    bool forceFrameTimeout,
+                                                                                    size_t maxPipelinedRequests)
     {
         auto it = TransactionIds.find(port);
         if (it == TransactionIds.end()) {
             std::tie(it, std::ignore) = TransactionIds.insert({port, std::make_shared<uint16_t>(0)});
         }
-        return std::make_unique<Modbus::TModbusTCPTraits>(it->second);
+        return std::make_unique<Modbus::TModbusTCPTraits>(it->second, maxPipelinedRequests);
     }
 
     void EnableWbContinuousRead(PSerialDevice device,
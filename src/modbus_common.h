@@ -6,7 +6,9 @@
 #include "serial_device.h"
 #include <array>
 #include <bitset>
+#include <functional>
 #include <ostream>
+#include <set>
 
 namespace Modbus // modbus protocol common utilities
 {
@@ -43,10 +45,22 @@ namespace Modbus // modbus protocol common utilities
                                            const std::chrono::milliseconds& responseTimeout,
                                            const std::chrono::milliseconds& frameTimeout,
                                            const TRequest& req,
-                                           TResponse& resp) const = 0;
+                                           TResponse& resp) = 0;
 
         virtual uint8_t* GetPDU(std::vector<uint8_t>& frame) const = 0;
         virtual const uint8_t* GetPDU(const std::vector<uint8_t>& frame) const = 0;
+
+        /**
+         * @brief Maximum number of requests sent to a device before reading responses to them.
+         *        1 - a request is sent after receiving response to the previous one.
+         */
+        virtual size_t GetPipelineWindow() const;
+
+        /**
+         * @brief Send requests one by one, e.g. if responses to pipelined requests are lost.
+         * @return false if pipelining is already disabled
+         */
+        virtual bool DisablePipelining();
     };
 
     class TModbusRTUTraits: public IModbusTraits
@@ -68,7 +82,7 @@ namespace Modbus // modbus protocol common utilities
                                    const std::chrono::milliseconds& responseTimeout,
                                    const std::chrono::milliseconds& frameTimeout,
                                    const TRequest& req,
-                                   TResponse& resp) const override;
+                                   TResponse& resp) override;
 
         uint8_t* GetPDU(std::vector<uint8_t>& frame) const override;
         const uint8_t* GetPDU(const std::vector<uint8_t>& frame) const override;
@@ -79,12 +93,26 @@ namespace Modbus // modbus protocol common utilities
         const size_t MBAP_SIZE = 7;
 
         std::shared_ptr<uint16_t> TransactionId;
+        size_t MaxPipelinedRequests;
+        bool Pipelining;
+
+        //! Responses received one by one since pipelining was disabled
+        size_t SerialResponsesCount = 0;
+
+        //! Responses to pipelined requests received before responses to previous requests
+        std::map<uint16_t, TResponse> EarlyResponses;
 
         void SetMBAP(TRequest& req, uint16_t transactionId, size_t pduSize, uint8_t slaveId) const;
         uint16_t GetLengthFromMBAP(const TResponse& buf) const;
 
+        //! Check if the transaction is pipelined after the request's transaction
+        bool IsPipelinedAfter(uint16_t transactionId, uint16_t requestTransactionId) const;
+
     public:
-        TModbusTCPTraits(std::shared_ptr<uint16_t> transactionId);
+        //! Disabled pipelining is tried again after the number of responses to requests sent one by one
+        static const size_t PIPELINING_RETRY_RESPONSES_COUNT = 1000;
+
+        TModbusTCPTraits(std::shared_ptr<uint16_t> transactionId, size_t maxPipelinedRequests = 1);
 
         size_t GetPacketSize(size_t pduSize) const override;
 
@@ -94,17 +122,22 @@ namespace Modbus // modbus protocol common utilities
                                    const std::chrono::milliseconds& responseTimeout,
                                    const std::chrono::milliseconds& frameTimeout,
                                    const TRequest& req,
-                                   TResponse& resp) const override;
+                                   TResponse& resp) override;
 
         uint8_t* GetPDU(std::vector<uint8_t>& frame) const override;
         const uint8_t* GetPDU(const std::vector<uint8_t>& frame) const override;
+
+        size_t GetPipelineWindow() const override;
+        bool DisablePipelining() override;
     };
 
     class IModbusTraitsFactory
     {
     public:
         virtual ~IModbusTraitsFactory() = default;
-        virtual std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port, bool forceFrameTimeout) = 0;
+        virtual std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port,
+                                                                        bool forceFrameTimeout,
+                                                                        size_t maxPipelinedRequests) = 0;
     };
 
     class TModbusTCPTraitsFactory: public IModbusTraitsFactory
@@ -112,23 +145,138 @@ namespace Modbus // modbus protocol common utilities
         std::unordered_map<PPort, std::shared_ptr<uint16_t>> TransactionIds;
 
     public:
-        std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port, bool forceFrameTimeout) override;
+        std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port,
+                                                                bool forceFrameTimeout,
+                                                                size_t maxPipelinedRequests) override;
     };
 
     class TModbusRTUTraitsFactory: public IModbusTraitsFactory
     {
     public:
-        std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port, bool forceFrameTimeout) override;
+        std::unique_ptr<Modbus::IModbusTraits> GetModbusTraits(PPort port,
+                                                                bool forceFrameTimeout,
+                                                                size_t maxPipelinedRequests) override;
     };
 
+    /**
+     * @brief Binary search of the largest value accepted by a device, e.g. read request length.
+     *        The maximum is tried first. A value could be rejected because of another reason,
+     *        so rejected values are tried again after RETRY_ACCEPTS_COUNT accepted requests.
+     */
+    class TAdaptiveLimit
+    {
+    public:
+        static const size_t RETRY_ACCEPTS_COUNT = 1000;
+
+        TAdaptiveLimit(size_t accepted, size_t max);
+
+        //! Value to try in following requests
+        size_t Get() const;
+
+        void Accept(size_t value);
+
+        /**
+         * @brief Process rejection of a request with the value.
+         * @param timeout the request is not answered, so it could be lost because of another reason
+         * @return false if the value is known to be accepted, so the rejection has another reason
+         */
+        bool Reject(size_t value, bool timeout = false);
+
+        size_t GetAccepted() const;
+
+        //! Smallest rejected value to save. A value rejected only by timeouts is not saved
+        size_t GetRejected() const;
+
+        //! Restore state saved by GetAccepted and GetRejected
+        void Restore(size_t accepted, size_t rejected);
+
+    private:
+        size_t Accepted;
+        size_t Rejected;
+        size_t Max;
+        size_t AcceptsCount = 0;
+        bool RejectedByTimeout = false;
+    };
+
+    /**
+     * @brief Read request length and hole limits learned by reading registers of a device.
+     *        Used instead of max_read_registers, max_reg_hole and max_bit_hole in adaptive mode.
+     *        Limits are learned separately for every register type.
+     */
+    class TAdaptiveReadLimits
+    {
+    public:
+        size_t GetMaxReadRegisters(int type);
+        size_t GetMaxHole(int type);
+
+        void Accept(int type, size_t count, size_t maxHole);
+
+        /**
+         * @brief Process rejection of a read request.
+         * @param timeout the request is not answered, limits learned by timeouts are not saved
+         * @return false if the request's length and holes are known to be accepted,
+         *         so the request is rejected because of unsupported registers
+         */
+        bool Reject(int type, size_t count, size_t maxHole, bool timeout = false);
+
+        std::map<int, TLearnedReadLimits> Get() const;
+        void Set(const std::map<int, TLearnedReadLimits>& limits);
+
+    private:
+        std::map<int, TAdaptiveLimit> Lengths;
+        std::map<int, TAdaptiveLimit> Holes;
+
+        TAdaptiveLimit& GetLength(int type);
+        TAdaptiveLimit& GetHole(int type);
+    };
+
+    typedef std::shared_ptr<TAdaptiveReadLimits> PAdaptiveReadLimits;
+
+    /**
+     * @brief Addresses read requests must not cross. They are found by splitting failed requests
+     *        of registers which are readable by separate requests.
+     *        A request can start at a split point, but can't read registers on both sides of it.
+     */
+    class TReadSplits
+    {
+    public:
+        void Add(int type, uint32_t addr);
+
+        //! Split points of the register type
+        const std::set<uint32_t>& GetPoints(int type) const;
+
+        std::map<int, std::set<uint32_t>> Get() const;
+        void Set(const std::map<int, std::set<uint32_t>>& splits);
+
+    private:
+        std::map<int, std::set<uint32_t>> Splits;
+    };
+
+    typedef std::shared_ptr<TReadSplits> PReadSplits;
+
+    //! Check if addresses [start, end) can't be read by one request
+    bool CrossesSplit(const std::set<uint32_t>& splits, uint32_t start, uint32_t end);
+
     class TModbusRegisterRange: public TRegisterRange
     {
     public:
-        TModbusRegisterRange(std::chrono::microseconds averageResponseTime);
+        TModbusRegisterRange(std::chrono::microseconds averageResponseTime,
+                             PAdaptiveReadLimits readLimits = nullptr,
+                             PReadSplits readSplits = nullptr);
         ~TModbusRegisterRange();
 
         bool Add(PRegister reg, std::chrono::milliseconds pollLimit) override;
 
+        /**
+         * @brief Selects the most urgent register and registers to read with it by one request.
+         *        Available registers are split into requests by PlanReadRequests,
+         *        the range gets the request with the most urgent register.
+         *        Registers with unknown availability are added one by one.
+         */
+        std::list<PRegister> AddRegisters(const std::list<PRegister>& registers,
+                                          std::chrono::milliseconds pollLimit,
+                                          bool readAtLeastOneRegister) override;
+
         int GetStart() const;
         int GetCount() const;
         uint8_t* GetBits();
@@ -145,6 +293,12 @@ namespace Modbus // modbus protocol common utilities
 
         std::chrono::microseconds GetResponseTime() const;
 
+        PAdaptiveReadLimits GetReadLimits() const;
+        PReadSplits GetReadSplits() const;
+
+        //! Longest hole between registers of the range
+        size_t GetMaxHoleSize() const;
+
     private:
         bool HasHolesFlg = false;
         uint32_t Start;
@@ -153,11 +307,60 @@ namespace Modbus // modbus protocol common utilities
         uint16_t* Words = 0;
         std::chrono::microseconds AverageResponseTime;
         std::chrono::microseconds ResponseTime;
+        PAdaptiveReadLimits ReadLimits;
+        PReadSplits ReadSplits;
+
+        size_t GetMaxReadRegisters(const TRegister& reg) const;
+        size_t GetMaxHole(const TRegister& reg) const;
 
         bool AddingRegisterIncreasesSize(bool isSingleBit, size_t extend) const;
+
+        //! Estimated bus time of reading count registers of the same type as reg
+        std::chrono::microseconds GetPollTime(const TRegister& reg, size_t count) const;
+    };
+
+    PRegisterRange CreateRegisterRange(std::chrono::microseconds averageResponseTime,
+                                       PAdaptiveReadLimits readLimits = nullptr,
+                                       PReadSplits readSplits = nullptr);
+
+    //! Addresses [Start, End) of a register in 16-bit words or bits
+    struct TRegisterSpan
+    {
+        uint32_t Start;
+        uint32_t End;
     };
 
-    PRegisterRange CreateRegisterRange(std::chrono::microseconds averageResponseTime);
+    typedef std::function<std::chrono::microseconds(size_t count)> TReadRequestTimeFn;
+
+    /**
+     * @brief Split registers into read requests with minimal total bus time.
+     *        Every request costs response time, request delay and frame timeouts,
+     *        so reading across a short hole is usually cheaper than an additional request.
+     *        A request of several registers can't be longer than maxRegs, can't have holes longer than maxHole,
+     *        can't cross split points and must fit into pollLimit.
+     *
+     * @param spans address spans of registers sorted by start
+     * @param getRequestTime bus time of a request reading count registers
+     * @param splits split points from TReadSplits
+     * @return indexes of first spans of requests
+     */
+    std::vector<size_t> PlanReadRequests(const std::vector<TRegisterSpan>& spans,
+                                         size_t maxRegs,
+                                         size_t maxHole,
+                                         std::chrono::milliseconds pollLimit,
+                                         const TReadRequestTimeFn& getRequestTime,
+                                         const std::set<uint32_t>& splits = std::set<uint32_t>());
+
+    /**
+     * @brief Place register value into its words as the device stores them.
+     *        Bits of the words not belonging to the register are kept.
+     *
+     * @param words words of the register in order of addresses
+     */
+    void PlaceRegisterValue(uint16_t* words, const TRegister& reg, uint64_t value);
+
+    //! Get register value from its words in order of addresses
+    uint64_t ExtractRegisterValue(const uint16_t* words, const TRegister& reg);
 
     void WriteRegister(IModbusTraits& traits,
                        TPort& port,
@@ -167,6 +370,28 @@ namespace Modbus // modbus protocol common utilities
                        TRegisterCache& cache,
                        int shift = 0);
 
+    /**
+     * @brief Write registers of a device.
+     *        Neighbouring holding registers and coils at contiguous addresses are written
+     *        by one 0x10 or 0x0F request within read length limit of the device.
+     *        If such request is rejected, the registers are written one by one to get errors per register.
+     *        Up to traits.GetPipelineWindow() requests are sent before reading responses to them.
+     * @return number of sent requests
+     */
+    size_t WriteRegisters(IModbusTraits& traits,
+                          TPort& port,
+                          uint8_t slaveId,
+                          std::vector<TRegisterWrite>& writes,
+                          TRegisterCache& cache,
+                          const TRegisterWrittenFn& onWritten,
+                          int shift = 0);
+
+    /**
+     * @brief Read registers of the range.
+     *        If a request without holes is rejected by the device, the range is split in halves
+     *        which are read separately, so unsupported registers are found by O(log n) requests.
+     *        Split points between halves read successfully are stored in range's TReadSplits.
+     */
     void ReadRegisterRange(IModbusTraits& traits,
                            TPort& port,
                            uint8_t slaveId,
@@ -174,12 +399,26 @@ namespace Modbus // modbus protocol common utilities
                            TRegisterCache& cache,
                            int shift = 0);
 
+    //! Read firmware version of a Wiren Board device
+    std::string ReadWbFirmwareVersion(PSerialDevice device,
+                                      IModbusTraits& traits,
+                                      TPort& port,
+                                      uint8_t slaveId,
+                                      TRegisterCache& cache);
+
+    /**
+     * @brief Write setup registers of a device as WriteRegisters does.
+     *        In verify mode setup registers are read first by ranges and only registers
+     *        holding different values are written.
+     *        Transient errors are thrown, other errors are logged.
+     */
     void WriteSetupRegisters(IModbusTraits& traits,
                              TPort& port,
                              uint8_t slaveId,
                              const std::vector<PDeviceSetupItem>& setupItems,
                              TRegisterCache& cache,
-                             int shift = 0);
+                             int shift = 0,
+                             bool verify = false);
 
     class TMalformedResponseError: public TSerialDeviceTransientErrorException
     {
@@ -0,0 +1,480 @@
+#include "modbus_tcp_server.h"
+#include "log.h"
+#include "modbus_common.h"
+#include "serial_device.h"
+#include "serial_exc.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <wblib/utils.h>
+
+#define LOG(logger) ::logger.Log() << "[modbus tcp server] "
+
+using namespace std::chrono;
+
+namespace
+{
+    const size_t MAX_CONNECTIONS = 32;
+    const size_t MBAP_HEADER_SIZE = 7;
+    const size_t MAX_PDU_SIZE = 253;
+    const size_t MAX_REGISTER_WORDS = 4;
+
+    const uint16_t MAX_READ_BITS = 2000;
+    const uint16_t MAX_READ_REGISTERS = 125;
+    const uint16_t MAX_WRITE_BITS = 1968;
+    const uint16_t MAX_WRITE_REGISTERS = 123;
+
+    const uint8_t ILLEGAL_FUNCTION = 0x01;
+    const uint8_t ILLEGAL_DATA_ADDRESS = 0x02;
+    const uint8_t ILLEGAL_DATA_VALUE = 0x03;
+    const uint8_t GATEWAY_PATH_UNAVAILABLE = 0x0A;
+
+    std::vector<uint8_t> MakeException(uint8_t function, uint8_t code)
+    {
+        return {static_cast<uint8_t>(function | 0x80), code};
+    }
+
+    uint16_t Get2Bytes(const uint8_t* data)
+    {
+        return (data[0] << 8) | data[1];
+    }
+
+    void Append2Bytes(std::vector<uint8_t>& data, uint16_t value)
+    {
+        data.push_back(value >> 8);
+        data.push_back(value & 0xFF);
+    }
+
+    void SetNonBlocking(int fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, NULL) | O_NONBLOCK);
+    }
+}
+
+TModbusTcpServer::TModbusTcpServer(const TModbusTcpServerConfig& config, util::TGetNowFn nowFn)
+    : Config(config),
+      NowFn(nowFn)
+{}
+
+TModbusTcpServer::~TModbusTcpServer()
+{
+    Stop();
+}
+
+int TModbusTcpServer::GetTable(const TRegister& reg)
+{
+    switch (reg.Type) {
+        case Modbus::REG_COIL:
+            return COILS;
+        case Modbus::REG_DISCRETE:
+            return DISCRETE_INPUTS;
+        case Modbus::REG_HOLDING:
+        case Modbus::REG_HOLDING_SINGLE:
+        case Modbus::REG_HOLDING_MULTI:
+            return HOLDING_REGISTERS;
+        case Modbus::REG_INPUT:
+            return INPUT_REGISTERS;
+    }
+    return -1;
+}
+
+void TModbusTcpServer::AddDevice(PSerialDevice device, const std::string& port, const TWriteFn& writeFn)
+{
+    const auto& slaveId = device->DeviceConfig()->SlaveId;
+    auto offsetIt = Config.UnitIdOffsets.find(port);
+    int offset = (offsetIt == Config.UnitIdOffsets.end()) ? 0 : offsetIt->second;
+    uint8_t unitId = 0;
+    try {
+        size_t pos = 0;
+        auto id = std::stoul(slaveId, &pos, 0);
+        if (pos != slaveId.size() || id == 0 || id > 247 || id + offset > 255) {
+            throw std::invalid_argument(slaveId);
+        }
+        unitId = id + offset;
+    } catch (const std::logic_error&) {
+        LOG(Warn) << device->ToString() << " is not served, slave id \"" << slaveId << "\" with offset " << offset
+                  << " can't be a unit id";
+        return;
+    }
+    if (Units.count(unitId)) {
+        LOG(Warn) << device->ToString() << " is not served, unit id " << int(unitId)
+                  << " is already used, set unit_id_offsets for its port";
+        return;
+    }
+
+    auto& unit = Units[unitId];
+    unit.Write = writeFn;
+    DeviceUnits[device.get()] = unitId;
+    for (const auto& reg: device->GetRegisters()) {
+        auto table = GetTable(*reg);
+        if (table < 0 || reg->Format == RegisterFormat::String) {
+            continue;
+        }
+        size_t width = (table <= DISCRETE_INPUTS) ? 1 : reg->Get16BitWidth();
+        if (width > MAX_REGISTER_WORDS) {
+            continue;
+        }
+        if (reg->AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) {
+            auto addr = GetUint32RegisterAddress(reg->GetAddress());
+            for (size_t i = 0; i < width; ++i) {
+                unit.Words[table][addr + i];
+            }
+        }
+        if (reg->AccessType != TRegisterConfig::EAccessType::READ_ONLY &&
+            (table == COILS || table == HOLDING_REGISTERS))
+        {
+            unit.Writable[table].emplace(GetUint32RegisterAddress(reg->GetWriteAddress()), reg);
+        }
+    }
+    LOG(Info) << "unit id " << int(unitId) << ": " << device->ToString();
+}
+
+void TModbusTcpServer::UpdateRegister(PRegister reg)
+{
+    auto table = GetTable(*reg);
+    auto device = reg->Device();
+    if (table < 0 || !device) {
+        return;
+    }
+    auto unitIt = DeviceUnits.find(device.get());
+    if (unitIt == DeviceUnits.end()) {
+        return;
+    }
+    auto& words = Units.at(unitIt->second).Words[table];
+
+    auto value = reg->GetValue();
+    bool valid = !reg->GetErrorState().test(TRegister::TError::ReadError) &&
+                 (value.GetType() == TRegisterValue::ValueType::Integer);
+    auto addr = GetUint32RegisterAddress(reg->GetAddress());
+    size_t width = (table <= DISCRETE_INPUTS) ? 1 : reg->Get16BitWidth();
+    auto now = NowFn();
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    std::array<uint16_t, MAX_REGISTER_WORDS> buf{};
+    std::array<TServedWord*, MAX_REGISTER_WORDS> served{};
+    for (size_t i = 0; i < width; ++i) {
+        auto it = words.find(addr + i);
+        if (it == words.end()) {
+            return;
+        }
+        served[i] = &it->second;
+        buf[i] = it->second.Value;
+    }
+    if (valid) {
+        if (table <= DISCRETE_INPUTS) {
+            buf[0] = (value.Get<uint64_t>() != 0);
+        } else {
+            Modbus::PlaceRegisterValue(buf.data(), *reg, value.Get<uint64_t>());
+        }
+    }
+    for (size_t i = 0; i < width; ++i) {
+        served[i]->Valid = valid;
+        if (valid) {
+            served[i]->Value = buf[i];
+            served[i]->UpdateTime = now;
+        }
+    }
+}
+
+void TModbusTcpServer::Start()
+{
+    if (Active) {
+        return;
+    }
+
+    ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (ListenFd < 0) {
+        throw std::runtime_error("can't create socket: " + FormatErrno(errno));
+    }
+    int reuse = 1;
+    setsockopt(ListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(Config.Port);
+    if (inet_pton(AF_INET, Config.Address.c_str(), &addr.sin_addr) != 1) {
+        close(ListenFd);
+        ListenFd = -1;
+        throw std::runtime_error("invalid address: " + Config.Address);
+    }
+    socklen_t addrLen = sizeof(addr);
+    if (bind(ListenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0 || listen(ListenFd, SOMAXCONN) < 0 ||
+        getsockname(ListenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0 || pipe(WakeUpFds) < 0)
+    {
+        auto error = errno;
+        close(ListenFd);
+        ListenFd = -1;
+        throw std::runtime_error("can't listen on " + Config.Address + ":" + std::to_string(Config.Port) + ": " +
+                                 FormatErrno(error));
+    }
+    SetNonBlocking(ListenFd);
+    ListenPort = ntohs(addr.sin_port);
+
+    Active = true;
+    Thread = std::thread([this]() {
+        WBMQTT::SetThreadName("modbus tcp");
+        Run();
+    });
+    LOG(Info) << "listening on " << Config.Address << ":" << ListenPort;
+}
+
+void TModbusTcpServer::Stop()
+{
+    if (!Active.exchange(false)) {
+        return;
+    }
+    if (write(WakeUpFds[1], "", 1) < 0) {
+        LOG(Warn) << "can't wake up server thread: " << FormatErrno(errno);
+    }
+    if (Thread.joinable()) {
+        Thread.join();
+    }
+    for (const auto& connection: Connections) {
+        close(connection.Fd);
+    }
+    Connections.clear();
+    for (auto fd: {ListenFd, WakeUpFds[0], WakeUpFds[1]}) {
+        close(fd);
+    }
+    ListenFd = WakeUpFds[0] = WakeUpFds[1] = -1;
+}
+
+uint16_t TModbusTcpServer::GetPort() const
+{
+    return ListenPort;
+}
+
+void TModbusTcpServer::Run()
+{
+    std::vector<pollfd> fds;
+    while (Active) {
+        fds.clear();
+        fds.push_back({WakeUpFds[0], POLLIN, 0});
+        fds.push_back({ListenFd, POLLIN, 0});
+        for (const auto& connection: Connections) {
+            fds.push_back({connection.Fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(Error) << "poll failed: " << FormatErrno(errno);
+            return;
+        }
+        if (fds[0].revents) {
+            return;
+        }
+        // Backwards to keep indexes of not processed connections while closing others
+        for (size_t i = Connections.size(); i > 0; --i) {
+            if (fds[i + 1].revents && !ReadConnection(Connections[i - 1])) {
+                close(Connections[i - 1].Fd);
+                Connections.erase(Connections.begin() + i - 1);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            Accept();
+        }
+    }
+}
+
+void TModbusTcpServer::Accept()
+{
+    int fd = accept(ListenFd, nullptr, nullptr);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG(Warn) << "accept failed: " << FormatErrno(errno);
+        }
+        return;
+    }
+    if (Connections.size() >= MAX_CONNECTIONS) {
+        LOG(Warn) << "too many connections, new connection is closed";
+        close(fd);
+        return;
+    }
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    SetNonBlocking(fd);
+    Connections.push_back({fd, {}});
+}
+
+bool TModbusTcpServer::ReadConnection(TConnection& connection)
+{
+    uint8_t buf[1024];
+    auto res = read(connection.Fd, buf, sizeof(buf));
+    if (res < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+    if (res == 0) {
+        return false;
+    }
+    auto& data = connection.Buffer;
+    data.insert(data.end(), buf, buf + res);
+
+    size_t pos = 0;
+    while (data.size() - pos >= MBAP_HEADER_SIZE) {
+        const auto* header = data.data() + pos;
+        size_t length = Get2Bytes(header + 4);
+        if (Get2Bytes(header + 2) != 0 || length < 2 || length > MAX_PDU_SIZE + 1) {
+            LOG(Debug) << "malformed MBAP header, connection is closed";
+            return false;
+        }
+        if (data.size() - pos < MBAP_HEADER_SIZE - 1 + length) {
+            break;
+        }
+        auto pdu = ProcessPdu(header[6], header + MBAP_HEADER_SIZE, length - 1);
+
+        std::vector<uint8_t> response(header, header + 4);
+        Append2Bytes(response, pdu.size() + 1);
+        response.push_back(header[6]);
+        response.insert(response.end(), pdu.begin(), pdu.end());
+        if (send(connection.Fd, response.data(), response.size(), MSG_NOSIGNAL) != ssize_t(response.size())) {
+            LOG(Debug) << "client doesn't read responses, connection is closed";
+            return false;
+        }
+        pos += MBAP_HEADER_SIZE - 1 + length;
+    }
+    data.erase(data.begin(), data.begin() + pos);
+    return true;
+}
+
+std::vector<uint8_t> TModbusTcpServer::ProcessPdu(uint8_t unitId, const uint8_t* pdu, size_t size)
+{
+    // Units are not changed after start, so they are accessed without lock
+    auto unit = Units.find(unitId);
+    if (unit == Units.end()) {
+        return MakeException(pdu[0], GATEWAY_PATH_UNAVAILABLE);
+    }
+    switch (pdu[0]) {
+        case 0x01:
+            return ReadTable(unit->second, COILS, pdu, size);
+        case 0x02:
+            return ReadTable(unit->second, DISCRETE_INPUTS, pdu, size);
+        case 0x03:
+            return ReadTable(unit->second, HOLDING_REGISTERS, pdu, size);
+        case 0x04:
+            return ReadTable(unit->second, INPUT_REGISTERS, pdu, size);
+        case 0x05:
+        case 0x0F:
+            if (Config.AllowWrites) {
+                return WriteTable(unit->second, COILS, pdu, size);
+            }
+            break;
+        case 0x06:
+        case 0x10:
+            if (Config.AllowWrites) {
+                return WriteTable(unit->second, HOLDING_REGISTERS, pdu, size);
+            }
+            break;
+    }
+    return MakeException(pdu[0], ILLEGAL_FUNCTION);
+}
+
+std::vector<uint8_t> TModbusTcpServer::ReadTable(TUnit& unit, TTable table, const uint8_t* pdu, size_t size)
+{
+    bool isBits = (table <= DISCRETE_INPUTS);
+    if (size != 5) {
+        return MakeException(pdu[0], ILLEGAL_DATA_VALUE);
+    }
+    uint32_t start = Get2Bytes(pdu + 1);
+    uint32_t count = Get2Bytes(pdu + 3);
+    if (count == 0 || count > (isBits ? MAX_READ_BITS : MAX_READ_REGISTERS)) {
+        return MakeException(pdu[0], ILLEGAL_DATA_VALUE);
+    }
+
+    size_t byteCount = isBits ? (count + 7) / 8 : count * 2;
+    std::vector<uint8_t> res(2 + byteCount, 0);
+    res[0] = pdu[0];
+    res[1] = byteCount;
+
+    auto now = NowFn();
+    std::unique_lock<std::mutex> lock(Mutex);
+    const auto& words = unit.Words[table];
+    auto it = words.lower_bound(start);
+    for (uint32_t i = 0; i < count; ++i, ++it) {
+        if (it == words.end() || it->first != start + i) {
+            return MakeException(pdu[0], ILLEGAL_DATA_ADDRESS);
+        }
+        const auto& word = it->second;
+        if (!word.Valid || (Config.MaxValueAge.count() > 0 && now - word.UpdateTime > Config.MaxValueAge)) {
+            return MakeException(pdu[0], Config.StaleValueException);
+        }
+        if (isBits) {
+            if (word.Value) {
+                res[2 + i / 8] |= 1 << (i % 8);
+            }
+        } else {
+            res[2 + i * 2] = word.Value >> 8;
+            res[3 + i * 2] = word.Value & 0xFF;
+        }
+    }
+    return res;
+}
+
+std::vector<uint8_t> TModbusTcpServer::WriteTable(TUnit& unit, TTable table, const uint8_t* pdu, size_t size)
+{
+    bool isBits = (table == COILS);
+    bool isSingle = (pdu[0] == 0x05 || pdu[0] == 0x06);
+    if (size < 5) {
+        return MakeException(pdu[0], ILLEGAL_DATA_VALUE);
+    }
+    uint32_t start = Get2Bytes(pdu + 1);
+    std::vector<uint16_t> values;
+    if (isSingle) {
+        auto value = Get2Bytes(pdu + 3);
+        if (size != 5 || (isBits && value != 0 && value != 0xFF00)) {
+            return MakeException(pdu[0], ILLEGAL_DATA_VALUE);
+        }
+        values.push_back(isBits ? (value != 0) : value);
+    } else {
+        uint32_t count = Get2Bytes(pdu + 3);
+        if (count == 0 || count > (isBits ? MAX_WRITE_BITS : MAX_WRITE_REGISTERS) || size < 6 ||
+            pdu[5] != (isBits ? (count + 7) / 8 : count * 2) || size != 6u + pdu[5])
+        {
+            return MakeException(pdu[0], ILLEGAL_DATA_VALUE);
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            values.push_back(isBits ? ((pdu[6 + i / 8] >> (i % 8)) & 1) : Get2Bytes(pdu + 6 + i * 2));
+        }
+    }
+    uint32_t end = start + values.size();
+
+    // Only registers written completely by the request are set
+    std::vector<bool> written(values.size(), false);
+    std::vector<std::pair<PRegister, uint64_t>> writes;
+    const auto& writable = unit.Writable[table];
+    for (auto it = writable.lower_bound(start); it != writable.end() && it->first < end; ++it) {
+        const auto& reg = it->second;
+        size_t width = isBits ? 1 : reg->Get16BitWidth();
+        if (it->first + width > end) {
+            continue;
+        }
+        auto offset = it->first - start;
+        writes.emplace_back(reg, isBits ? values[offset] : Modbus::ExtractRegisterValue(&values[offset], *reg));
+        std::fill(written.begin() + offset, written.begin() + offset + width, true);
+    }
+    if (std::find(written.begin(), written.end(), false) != written.end()) {
+        return MakeException(pdu[0], ILLEGAL_DATA_ADDRESS);
+    }
+
+    for (const auto& write: writes) {
+        try {
+            unit.Write(write.first, TRegisterValue(write.second));
+        } catch (const std::exception& e) {
+            LOG(Warn) << "can't write " << write.first->ToString() << ": " << e.what();
+            return MakeException(pdu[0], ILLEGAL_DATA_ADDRESS);
+        }
+    }
+    return std::vector<uint8_t>(pdu, pdu + 5);
+}
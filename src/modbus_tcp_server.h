@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common_utils.h"
+#include "register.h"
+
+struct TModbusTcpServerConfig
+{
+    //! Address of interface to listen on
+    std::string Address = "127.0.0.1";
+
+    //! TCP port to listen on, 0 - any free port
+    uint16_t Port = 502;
+
+    /**
+     * @brief Values not updated for longer time are stale.
+     *        Zero - only values never read or read with error are stale.
+     */
+    std::chrono::milliseconds MaxValueAge = std::chrono::milliseconds::zero();
+
+    //! Modbus exception code returned for stale values. Default is GATEWAY TARGET DEVICE FAILED TO RESPOND
+    uint8_t StaleValueException = 0x0B;
+
+    //! Queue writes of clients. Otherwise write functions are answered with ILLEGAL FUNCTION
+    bool AllowWrites = false;
+
+    //! Offsets added to slave ids of devices to get unit ids, by port description
+    std::map<std::string, int> UnitIdOffsets;
+};
+
+/**
+ * @brief Modbus TCP slave serving registers of configured Modbus devices.
+ *        Reads are answered from values already polled by the driver without accessing the bus.
+ *        Writes are queued as writes from MQTT.
+ *        Unit id of a request is slave id of a device plus unit id offset of its port.
+ */
+class TModbusTcpServer
+{
+public:
+    typedef std::function<void(PRegister reg, const TRegisterValue& value)> TWriteFn;
+
+    TModbusTcpServer(const TModbusTcpServerConfig& config,
+                     util::TGetNowFn nowFn = std::chrono::steady_clock::now);
+    ~TModbusTcpServer();
+
+    /**
+     * @brief Serve registers of a Modbus device. Must be called before Start.
+     *
+     * @param port description of the device's port, used to get unit id offset
+     * @param writeFn called from server's thread to queue writing of a register
+     */
+    void AddDevice(PSerialDevice device, const std::string& port, const TWriteFn& writeFn);
+
+    //! Store polled value or read error of a register. Can be called from any thread
+    void UpdateRegister(PRegister reg);
+
+    //! Open listening socket and start serving thread. Throws std::runtime_error on errors
+    void Start();
+
+    void Stop();
+
+    //! Actual port the server listens on
+    uint16_t GetPort() const;
+
+private:
+    enum TTable
+    {
+        COILS = 0,
+        DISCRETE_INPUTS,
+        HOLDING_REGISTERS,
+        INPUT_REGISTERS,
+        TABLES_COUNT
+    };
+
+    struct TServedWord
+    {
+        uint16_t Value = 0;
+        bool Valid = false;
+        std::chrono::steady_clock::time_point UpdateTime;
+    };
+
+    struct TUnit
+    {
+        std::map<uint32_t, TServedWord> Words[TABLES_COUNT];
+
+        //! Writable registers of coils and holding registers tables by write address
+        std::multimap<uint32_t, PRegister> Writable[TABLES_COUNT];
+
+        TWriteFn Write;
+    };
+
+    struct TConnection
+    {
+        int Fd;
+        std::vector<uint8_t> Buffer;
+    };
+
+    //! Index of table in TTable or -1 if the register can't be served
+    static int GetTable(const TRegister& reg);
+
+    void Run();
+    void Accept();
+    bool ReadConnection(TConnection& connection);
+    std::vector<uint8_t> ProcessPdu(uint8_t unitId, const uint8_t* pdu, size_t size);
+    std::vector<uint8_t> ReadTable(TUnit& unit, TTable table, const uint8_t* pdu, size_t size);
+    std::vector<uint8_t> WriteTable(TUnit& unit, TTable table, const uint8_t* pdu, size_t size);
+
+    TModbusTcpServerConfig Config;
+    util::TGetNowFn NowFn;
+
+    std::map<uint8_t, TUnit> Units;
+    std::unordered_map<const TSerialDevice*, uint8_t> DeviceUnits;
+    std::mutex Mutex;
+
+    int ListenFd = -1;
+    int WakeUpFds[2] = {-1, -1};
+    uint16_t ListenPort = 0;
+    std::vector<TConnection> Connections;
+    std::thread Thread;
+    std::atomic<bool> Active{false};
+};
+
+typedef std::shared_ptr<TModbusTcpServer> PModbusTcpServer;
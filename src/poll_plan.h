@@ -2,19 +2,19 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
-#include <queue>
-
-template<typename TItem> class TPriorityQueue: public std::priority_queue<TItem>
-{
-public:
-    template<typename Pred> bool Contains(Pred pred) const
-    {
-        return std::find_if(this->c.cbegin(), this->c.cend(), pred) != this->c.cend();
-    }
-};
-
-template<class TEntry, typename ComparePredicate> class TPriorityQueueSchedule
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Deadline ordered schedule of unique entries.
+ *        Implemented as a binary heap with an entry to heap position index,
+ *        so membership check is O(1) and removal or rescheduling of an arbitrary entry is O(log n).
+ *        Entries with equal deadlines are ordered by ComparePredicate, the "greatest" one goes first.
+ */
+template<class TEntry, typename ComparePredicate, typename THash = std::hash<TEntry>> class TPriorityQueueSchedule
 {
 public:
     struct TItem
@@ -39,9 +39,27 @@ public:
         return Entries.empty();
     }
 
+    size_t Size() const
+    {
+        return Entries.size();
+    }
+
+    /**
+     * @brief Add entry to schedule.
+     *        If the entry is already scheduled, its deadline is changed in place.
+     */
     void AddEntry(TEntry entry, std::chrono::steady_clock::time_point deadline)
     {
-        Entries.emplace(TItem{entry, deadline});
+        auto it = Index.find(entry);
+        if (it != Index.end()) {
+            auto pos = it->second;
+            Entries[pos].Deadline = deadline;
+            Restore(pos);
+            return;
+        }
+        Entries.emplace_back(TItem{entry, deadline});
+        Index.emplace(std::move(entry), Entries.size() - 1);
+        SiftUp(Entries.size() - 1);
     }
 
     std::chrono::steady_clock::time_point GetDeadline() const
@@ -49,17 +67,32 @@ public:
         if (Entries.empty()) {
             return std::chrono::steady_clock::time_point::max();
         }
-        return Entries.top().Deadline;
+        return Entries.front().Deadline;
     }
 
     const TItem& GetTop() const
     {
-        return Entries.top();
+        return Entries.front();
     }
 
     void Pop()
     {
-        Entries.pop();
+        RemoveAt(0);
+    }
+
+    /**
+     * @brief Remove entry from schedule.
+     *
+     * @return true if entry was scheduled
+     */
+    bool Remove(const TEntry& entry)
+    {
+        auto it = Index.find(entry);
+        if (it == Index.end()) {
+            return false;
+        }
+        RemoveAt(it->second);
+        return true;
     }
 
     bool HasReadyItems(std::chrono::steady_clock::time_point time) const
@@ -67,21 +100,107 @@ public:
         return !Entries.empty() && (GetDeadline() <= time);
     }
 
-    bool Contains(TEntry entry) const
+    bool Contains(const TEntry& entry) const
     {
-        return Entries.Contains([&](const TItem& item) { return item.Data == entry; });
+        return Index.count(entry) != 0;
     }
 
 private:
-    TPriorityQueue<TItem> Entries;
+    std::vector<TItem> Entries;
+    std::unordered_map<TEntry, size_t, THash> Index;
+
+    //! Returns true if item at pos1 must be polled before item at pos2
+    bool IsBefore(size_t pos1, size_t pos2) const
+    {
+        return Entries[pos2] < Entries[pos1];
+    }
+
+    void Swap(size_t pos1, size_t pos2)
+    {
+        std::swap(Entries[pos1], Entries[pos2]);
+        Index[Entries[pos1].Data] = pos1;
+        Index[Entries[pos2].Data] = pos2;
+    }
+
+    void SiftUp(size_t pos)
+    {
+        while (pos > 0) {
+            auto parent = (pos - 1) / 2;
+            if (!IsBefore(pos, parent)) {
+                return;
+            }
+            Swap(pos, parent);
+            pos = parent;
+        }
+    }
+
+    void SiftDown(size_t pos)
+    {
+        for (;;) {
+            auto first = pos;
+            auto left = 2 * pos + 1;
+            auto right = left + 1;
+            if (left < Entries.size() && IsBefore(left, first)) {
+                first = left;
+            }
+            if (right < Entries.size() && IsBefore(right, first)) {
+                first = right;
+            }
+            if (first == pos) {
+                return;
+            }
+            Swap(pos, first);
+            pos = first;
+        }
+    }
+
+    void Restore(size_t pos)
+    {
+        if (pos > 0 && IsBefore(pos, (pos - 1) / 2)) {
+            SiftUp(pos);
+        } else {
+            SiftDown(pos);
+        }
+    }
+
+    void RemoveAt(size_t pos)
+    {
+        auto last = Entries.size() - 1;
+        if (pos != last) {
+            Swap(pos, last);
+        }
+        Index.erase(Entries.back().Data);
+        Entries.pop_back();
+        if (pos < Entries.size()) {
+            Restore(pos);
+        }
+    }
 };
 
 enum class TPriority
 {
+    //! Alarms and safety inputs. Selected before all other items, but limited by minimal shares of other classes
+    Alarm,
+
+    //! Control feedback
     High,
+
+    //! Bulk reads, e.g. metering
     Low
 };
 
+/**
+ * @brief Minimal guaranteed parts of time for priority classes.
+ *        They are taken into account only if items of several classes are waiting.
+ *        High priority items are selected before low priority ones until low priority items get less than their share.
+ *        Alarm items get the rest of time.
+ */
+struct TPriorityShares
+{
+    double High = 0.25;
+    double Low = 0.25;
+};
+
 enum class TItemAccumulationPolicy
 {
     Force,
@@ -94,55 +213,16 @@ enum class TItemSelectionPolicy
     All
 };
 
-class TRateLimiter
-{
-    size_t RateLimit;
-    size_t Count = 0;
-    std::chrono::steady_clock::time_point StartTime;
-
-public:
-    TRateLimiter(size_t rateLimit): RateLimit(rateLimit)
-    {}
-
-    void NewItem(std::chrono::steady_clock::time_point time)
-    {
-        if (RateLimit == 0) {
-            return;
-        }
-        if (time - StartTime <= std::chrono::seconds(1)) {
-            ++Count;
-            return;
-        }
-        Count = 1;
-        StartTime = std::chrono::time_point_cast<std::chrono::seconds>(time);
-    }
-
-    bool IsOverLimit(std::chrono::steady_clock::time_point time) const
-    {
-        if (RateLimit == 0) {
-            return false;
-        }
-        if (time - StartTime <= std::chrono::seconds(1)) {
-            return Count > RateLimit;
-        }
-        return false;
-    }
-
-    std::chrono::steady_clock::time_point GetStartTime() const
-    {
-        return StartTime;
-    }
-};
-
 class TTotalTimeBalancer
 {
-    std::chrono::milliseconds TotalTime;
+    //! Kept in microseconds, so short scaled reads are not rounded up to whole milliseconds
+    std::chrono::microseconds TotalTime;
 
     //! Maximum allowed TotalTime that does not need to be reduced
-    std::chrono::milliseconds TotalTimeThreshold;
+    std::chrono::microseconds TotalTimeThreshold;
 
     //! Limits TotalTime allowed values by [-MaxTotalTime, MaxTotalTime]
-    std::chrono::milliseconds MaxTotalTime;
+    std::chrono::microseconds MaxTotalTime;
 
 public:
     TTotalTimeBalancer(std::chrono::milliseconds totalTimeThreshold, std::chrono::milliseconds maxTotalTime)
@@ -152,12 +232,12 @@ public:
         Reset();
     }
 
-    void IncrementTotalTime(const std::chrono::milliseconds& delta)
+    void IncrementTotalTime(const std::chrono::microseconds& delta)
     {
         TotalTime = std::min(TotalTime + delta, MaxTotalTime);
     }
 
-    void DecrementTotalTime(const std::chrono::milliseconds& delta)
+    void DecrementTotalTime(const std::chrono::microseconds& delta)
     {
         TotalTime = std::max(TotalTime - delta, -MaxTotalTime);
     }
@@ -170,51 +250,148 @@ public:
     std::chrono::milliseconds GetTimeToDecrement() const
     {
         auto delta = (TotalTime - TotalTimeThreshold);
-        if (delta > std::chrono::milliseconds::zero()) {
-            return delta;
+        if (delta > std::chrono::microseconds::zero()) {
+            return std::chrono::ceil<std::chrono::milliseconds>(delta);
         }
         return std::chrono::milliseconds::zero();
     }
 
     void Reset()
     {
-        TotalTime = std::chrono::milliseconds::zero();
+        TotalTime = std::chrono::microseconds::zero();
     }
 
-    std::chrono::milliseconds GetTotalTime() const
+    std::chrono::microseconds GetTotalTime() const
     {
         return TotalTime;
     }
 };
 
+/**
+ * @brief Deficit round robin accounting of a shared resource time between clients with different weights.
+ *        Every round each client gets Quantum * weight of credit, a selected client spends it.
+ *        A client with exhausted credit should be skipped while other clients have credit.
+ *        If all waiting clients have exhausted their credits, a new round must be started.
+ */
+template<class TClient> class TDeficitRoundRobin
+{
+    struct TClientState
+    {
+        uint32_t Weight = 1;
+        std::chrono::microseconds Deficit = std::chrono::microseconds::zero();
+        std::chrono::microseconds SpentTime = std::chrono::microseconds::zero();
+    };
+
+    std::chrono::microseconds Quantum;
+    std::unordered_map<TClient, TClientState> Clients;
+    std::chrono::microseconds TotalSpentTime;
+
+public:
+    TDeficitRoundRobin(std::chrono::microseconds quantum)
+        : Quantum(quantum),
+          TotalSpentTime(std::chrono::microseconds::zero())
+    {}
+
+    void SetWeight(const TClient& client, uint32_t weight)
+    {
+        auto& state = Clients[client];
+        state.Weight = std::max(weight, uint32_t(1));
+        state.Deficit = Quantum * state.Weight;
+    }
+
+    bool HasCredit(const TClient& client) const
+    {
+        auto it = Clients.find(client);
+        return (it == Clients.end()) || (it->second.Deficit > std::chrono::microseconds::zero());
+    }
+
+    void Spend(const TClient& client, std::chrono::microseconds time)
+    {
+        auto& state = Clients[client];
+        state.Deficit -= time;
+        state.SpentTime += time;
+        TotalSpentTime += time;
+    }
+
+    /**
+     * @brief Start as many rounds as needed to give credit to at least one of waiting clients.
+     *        Unused credit is not accumulated for more than one round.
+     */
+    template<class TClientsList> void NextRound(const TClientsList& waitingClients)
+    {
+        int64_t rounds = 0;
+        for (const auto& client: waitingClients) {
+            auto it = Clients.find(client);
+            if (it == Clients.end()) {
+                continue;
+            }
+            auto credit = Quantum * it->second.Weight;
+            auto clientRounds = (credit - it->second.Deficit) / credit;
+            if (rounds == 0 || clientRounds < rounds) {
+                rounds = clientRounds;
+            }
+        }
+        rounds = std::max(rounds, int64_t(1));
+        for (auto& client: Clients) {
+            auto credit = Quantum * client.second.Weight;
+            client.second.Deficit = std::min(client.second.Deficit + credit * rounds, credit);
+        }
+    }
+
+    //! Part of total spent time used by the client since last ResetShares call
+    double GetShare(const TClient& client) const
+    {
+        auto it = Clients.find(client);
+        if (it == Clients.end() || TotalSpentTime == std::chrono::microseconds::zero()) {
+            return 0;
+        }
+        return static_cast<double>(it->second.SpentTime.count()) / TotalSpentTime.count();
+    }
+
+    void ResetShares()
+    {
+        for (auto& client: Clients) {
+            client.second.SpentTime = std::chrono::microseconds::zero();
+        }
+        TotalSpentTime = std::chrono::microseconds::zero();
+    }
+};
+
 template<class TEntry, class TComparePredicate = std::less<TEntry>> class TScheduler
 {
 public:
     using TQueue = TPriorityQueueSchedule<TEntry, TComparePredicate>;
     using TItem = typename TQueue::TItem;
 
-    TScheduler(std::chrono::milliseconds maxLowPriorityLag): TimeBalancer(maxLowPriorityLag, 2 * maxLowPriorityLag)
-    {
+    TScheduler(std::chrono::milliseconds maxLowPriorityLag, const TPriorityShares& minShares = TPriorityShares())
+        : TimeBalancer(maxLowPriorityLag, 2 * maxLowPriorityLag),
+          AlarmTimeBalancer(maxLowPriorityLag, 2 * maxLowPriorityLag)
+    {
+        // Time of high and low priority items is scaled so that TimeBalancer keeps low priority items share
+        // equal to Low / (High + Low) of not alarm time.
+        // Time of alarm items is scaled so that AlarmTimeBalancer keeps alarm share below 1 - (High + Low)
+        const auto notAlarmShare = minShares.High + minShares.Low;
+        HighPriorityTimeScale = 2 * minShares.Low / notAlarmShare;
+        LowPriorityTimeScale = 2 * minShares.High / notAlarmShare;
+        AlarmTimeScale = notAlarmShare;
+        NotAlarmTimeScale = 1 - notAlarmShare;
         ResetLoadBalancing();
     }
 
     void AddEntry(TEntry entry, std::chrono::steady_clock::time_point deadline, TPriority priority)
     {
-        if (priority == TPriority::Low) {
-            LowPriorityQueue.AddEntry(entry, deadline);
-        } else {
-            HighPriorityQueue.AddEntry(entry, deadline);
-        }
+        GetQueue(priority).AddEntry(entry, deadline);
     }
 
     std::chrono::steady_clock::time_point GetDeadline() const
     {
-        return std::min(HighPriorityQueue.GetDeadline(), LowPriorityQueue.GetDeadline());
+        return std::min(GetHighPriorityDeadline(), LowPriorityQueue.GetDeadline());
     }
 
+    //! Deadline of alarm and high priority items
     std::chrono::steady_clock::time_point GetHighPriorityDeadline() const
     {
-        return HighPriorityQueue.GetDeadline();
+        return std::min(AlarmQueue.GetDeadline(), HighPriorityQueue.GetDeadline());
     }
 
     std::chrono::steady_clock::time_point GetLowPriorityDeadline() const
@@ -239,6 +416,19 @@ public:
                                                      TAccumulator& accumulator,
                                                      TItemSelectionPolicy policy)
     {
+        if (AlarmQueue.HasReadyItems(currentTime) && !ShouldLimitAlarms(currentTime, policy)) {
+            bool firstItem = true;
+            while (AlarmQueue.HasReadyItems(currentTime) &&
+                   accumulator(AlarmQueue.GetTop().Data,
+                               firstItem ? TItemAccumulationPolicy::Force
+                                         : TItemAccumulationPolicy::AccordingToPollLimitTime,
+                               std::chrono::milliseconds::max()))
+            {
+                AlarmQueue.Pop();
+                firstItem = false;
+            }
+            return;
+        }
         bool forceLowPriority = (policy == TItemSelectionPolicy::All) && ShouldSelectLowPriority(currentTime);
         if (HighPriorityQueue.HasReadyItems(currentTime) &&
             (!forceLowPriority || !LowPriorityQueue.HasReadyItems(currentTime)))
@@ -274,31 +464,47 @@ public:
         }
     }
 
-    void UpdateSelectionTime(const std::chrono::milliseconds& delta, TPriority priority)
+    void UpdateSelectionTime(const std::chrono::microseconds& delta, TPriority priority)
     {
-        if (priority == TPriority::High) {
-            TimeBalancer.IncrementTotalTime(delta);
-        } else {
-            TimeBalancer.DecrementTotalTime(delta);
+        switch (priority) {
+            case TPriority::Alarm: {
+                AlarmTimeBalancer.IncrementTotalTime(Scale(delta, AlarmTimeScale));
+                return;
+            }
+            case TPriority::High: {
+                TimeBalancer.IncrementTotalTime(Scale(delta, HighPriorityTimeScale));
+                break;
+            }
+            case TPriority::Low: {
+                TimeBalancer.DecrementTotalTime(Scale(delta, LowPriorityTimeScale));
+                break;
+            }
         }
+        AlarmTimeBalancer.DecrementTotalTime(Scale(delta, NotAlarmTimeScale));
     }
 
     void ResetLoadBalancing()
     {
         TimeBalancer.Reset();
+        AlarmTimeBalancer.Reset();
     }
 
-    bool Contains(TEntry entry)
+    bool Contains(const TEntry& entry) const
     {
-        return LowPriorityQueue.Contains(entry) || HighPriorityQueue.Contains(entry);
+        return LowPriorityQueue.Contains(entry) || HighPriorityQueue.Contains(entry) || AlarmQueue.Contains(entry);
+    }
+
+    bool Remove(const TEntry& entry)
+    {
+        return LowPriorityQueue.Remove(entry) || HighPriorityQueue.Remove(entry) || AlarmQueue.Remove(entry);
     }
 
     bool IsEmpty() const
     {
-        return LowPriorityQueue.IsEmpty() && HighPriorityQueue.IsEmpty();
+        return LowPriorityQueue.IsEmpty() && HighPriorityQueue.IsEmpty() && AlarmQueue.IsEmpty();
     }
 
-    std::chrono::milliseconds GetTotalTime() const
+    std::chrono::microseconds GetTotalTime() const
     {
         return TimeBalancer.GetTotalTime();
     }
@@ -306,14 +512,46 @@ public:
 private:
     TQueue LowPriorityQueue;
     TQueue HighPriorityQueue;
+    TQueue AlarmQueue;
     TTotalTimeBalancer TimeBalancer;
+    TTotalTimeBalancer AlarmTimeBalancer;
+    double HighPriorityTimeScale;
+    double LowPriorityTimeScale;
+    double AlarmTimeScale;
+    double NotAlarmTimeScale;
+
+    TQueue& GetQueue(TPriority priority)
+    {
+        switch (priority) {
+            case TPriority::Alarm:
+                return AlarmQueue;
+            case TPriority::High:
+                return HighPriorityQueue;
+            default:
+                return LowPriorityQueue;
+        }
+    }
+
+    static std::chrono::microseconds Scale(const std::chrono::microseconds& delta, double scale)
+    {
+        return std::chrono::round<std::chrono::microseconds>(std::chrono::duration<double, std::micro>(delta) * scale);
+    }
+
+    bool ShouldLimitAlarms(std::chrono::steady_clock::time_point currentTime, TItemSelectionPolicy policy) const
+    {
+        if (!AlarmTimeBalancer.ShouldDecrement()) {
+            return false;
+        }
+        return HighPriorityQueue.HasReadyItems(currentTime) ||
+               ((policy == TItemSelectionPolicy::All) && LowPriorityQueue.HasReadyItems(currentTime));
+    }
 
     std::chrono::milliseconds GetLowPriorityPollLimit(std::chrono::steady_clock::time_point currentTime) const
     {
-        if (HighPriorityQueue.IsEmpty()) {
+        if (HighPriorityQueue.IsEmpty() && AlarmQueue.IsEmpty()) {
             return std::chrono::milliseconds::max();
         }
-        auto delta = std::chrono::ceil<std::chrono::milliseconds>(HighPriorityQueue.GetDeadline() - currentTime);
+        auto delta = std::chrono::ceil<std::chrono::milliseconds>(GetHighPriorityDeadline() - currentTime);
         if (delta > std::chrono::milliseconds(0)) {
             return delta;
         }
@@ -0,0 +1,433 @@
+#include "poll_plan_simulator.h"
+
+#include <iomanip>
+#include <unordered_map>
+
+#include "crc16.h"
+#include "log.h"
+#include "serial_client.h"
+
+#define LOG(logger) logger.Log() << "[simulator] "
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace
+{
+    const size_t MODBUS_MBAP_SIZE = 7;
+    const size_t MODBUS_RTU_DATA_SIZE = 3; // slave id + CRC
+    const uint8_t MODBUS_EXCEPTION_FLAG = 0x80;
+    const uint8_t MODBUS_ILLEGAL_FUNCTION = 0x01;
+
+    /**
+     * @brief Make response PDU with zero filled data for read requests.
+     *        Unsupported functions are answered with illegal function exception.
+     */
+    std::vector<uint8_t> MakeModbusResponsePDU(const uint8_t* pdu, size_t size)
+    {
+        if (size == 0) {
+            return std::vector<uint8_t>();
+        }
+        const auto fn = pdu[0];
+        switch (fn) {
+            case 0x01:   // read coils
+            case 0x02:   // read discrete inputs
+            case 0x03:   // read holding registers
+            case 0x04: { // read input registers
+                if (size < 5) {
+                    break;
+                }
+                size_t count = (pdu[3] << 8) | pdu[4];
+                size_t bytes = (fn <= 0x02) ? (count + 7) / 8 : count * 2;
+                std::vector<uint8_t> res(2 + bytes, 0);
+                res[0] = fn;
+                res[1] = static_cast<uint8_t>(bytes);
+                return res;
+            }
+            case 0x05: // write single coil
+            case 0x06: // write single register
+                return std::vector<uint8_t>(pdu, pdu + size);
+            case 0x0F:   // write multiple coils
+            case 0x10: { // write multiple registers
+                if (size < 5) {
+                    break;
+                }
+                return std::vector<uint8_t>(pdu, pdu + 5);
+            }
+        }
+        return {static_cast<uint8_t>(fn | MODBUS_EXCEPTION_FLAG), MODBUS_ILLEGAL_FUNCTION};
+    }
+
+    double ToMilliseconds(microseconds value)
+    {
+        return value.count() / 1000.0;
+    }
+}
+
+TSimulatedPort::TSimulatedPort(PPort port,
+                               bool isModbusTcp,
+                               std::chrono::microseconds responseTime,
+                               const std::set<uint8_t>& disconnectedSlaveIds)
+    : Port(port),
+      IsModbusTcp(isModbusTcp),
+      ResponseTime(responseTime),
+      DisconnectedSlaveIds(disconnectedSlaveIds)
+{}
+
+void TSimulatedPort::Open()
+{
+    IsOpenFlg = true;
+}
+
+void TSimulatedPort::Close()
+{
+    IsOpenFlg = false;
+}
+
+bool TSimulatedPort::IsOpen() const
+{
+    return IsOpenFlg;
+}
+
+void TSimulatedPort::CheckPortOpen() const
+{
+    if (!IsOpenFlg) {
+        throw TSerialDeviceException("port not open");
+    }
+}
+
+void TSimulatedPort::WriteBytes(const uint8_t* buf, int count)
+{
+    Time += GetSendTimeBytes(count);
+    LastInteraction = Time;
+    ++RequestsCount;
+    Response.clear();
+    WaitingForResponse = true;
+
+    if (IsModbusTcp) {
+        if (static_cast<size_t>(count) <= MODBUS_MBAP_SIZE || DisconnectedSlaveIds.count(buf[6])) {
+            return;
+        }
+        auto pdu = MakeModbusResponsePDU(buf + MODBUS_MBAP_SIZE, count - MODBUS_MBAP_SIZE);
+        auto len = pdu.size() + 1;
+        Response.insert(Response.end(), {buf[0], buf[1], 0, 0});
+        Response.push_back((len >> 8) & 0xFF);
+        Response.push_back(len & 0xFF);
+        Response.push_back(buf[6]);
+        Response.insert(Response.end(), pdu.begin(), pdu.end());
+        return;
+    }
+
+    // Broadcast requests are not answered
+    if (static_cast<size_t>(count) <= MODBUS_RTU_DATA_SIZE || buf[0] == 0 || DisconnectedSlaveIds.count(buf[0])) {
+        return;
+    }
+    std::vector<uint8_t> frame{buf[0]};
+    auto pdu = MakeModbusResponsePDU(buf + 1, count - MODBUS_RTU_DATA_SIZE);
+    frame.insert(frame.end(), pdu.begin(), pdu.end());
+    auto crc = CRC16::CalculateCRC16(frame.data(), frame.size());
+    frame.push_back(crc >> 8);
+    frame.push_back(crc & 0xFF);
+    Response.insert(Response.end(), frame.begin(), frame.end());
+}
+
+uint8_t TSimulatedPort::ReadByte(const std::chrono::microseconds& timeout)
+{
+    Time += timeout;
+    throw TResponseTimeoutException();
+}
+
+TReadFrameResult TSimulatedPort::ReadFrame(uint8_t* buf,
+                                           size_t count,
+                                           const std::chrono::microseconds& responseTimeout,
+                                           const std::chrono::microseconds& frameTimeout,
+                                           TFrameCompletePred frameComplete)
+{
+    if (Response.empty()) {
+        Time += responseTimeout;
+        if (WaitingForResponse) {
+            ++TimeoutsCount;
+            WaitingForResponse = false;
+        }
+        throw TResponseTimeoutException();
+    }
+
+    TReadFrameResult res;
+    if (WaitingForResponse) {
+        res.ResponseTime = ResponseTime;
+        Time += ResponseTime;
+        WaitingForResponse = false;
+    }
+
+    bool complete = false;
+    while (res.Count < count && !Response.empty()) {
+        buf[res.Count] = Response.front();
+        Response.pop_front();
+        ++res.Count;
+        if (frameComplete && frameComplete(buf, res.Count)) {
+            complete = true;
+            break;
+        }
+    }
+
+    // Real port waits for frame timeout if it can't detect end of frame
+    Time += GetSendTimeBytes(res.Count);
+    if (!complete && res.Count != count) {
+        Time += frameTimeout;
+    }
+    LastInteraction = Time;
+    return res;
+}
+
+void TSimulatedPort::SkipNoise()
+{
+    Response.clear();
+}
+
+void TSimulatedPort::SleepSinceLastInteraction(const std::chrono::microseconds& us)
+{
+    auto wakeUpTime = LastInteraction + us;
+    if (wakeUpTime > Time) {
+        Time = wakeUpTime;
+    }
+}
+
+std::chrono::microseconds TSimulatedPort::GetSendTimeBytes(double bytesNumber) const
+{
+    return Port->GetSendTimeBytes(bytesNumber);
+}
+
+std::chrono::microseconds TSimulatedPort::GetSendTimeBits(size_t bitsNumber) const
+{
+    return Port->GetSendTimeBits(bitsNumber);
+}
+
+std::string TSimulatedPort::GetDescription(bool verbose) const
+{
+    return Port->GetDescription(verbose);
+}
+
+std::chrono::steady_clock::time_point TSimulatedPort::GetTime() const
+{
+    return Time;
+}
+
+void TSimulatedPort::WaitUntil(std::chrono::steady_clock::time_point time)
+{
+    if (time > Time) {
+        IdleTime += ceil<microseconds>(time - Time);
+        Time = time;
+    }
+}
+
+std::chrono::microseconds TSimulatedPort::GetIdleTime() const
+{
+    return IdleTime;
+}
+
+size_t TSimulatedPort::GetRequestsCount() const
+{
+    return RequestsCount;
+}
+
+size_t TSimulatedPort::GetTimeoutsCount() const
+{
+    return TimeoutsCount;
+}
+
+std::chrono::microseconds TSimulatedRegisterStats::GetAveragePeriod() const
+{
+    if (ReadCount < 2) {
+        return microseconds::zero();
+    }
+    return ceil<microseconds>(LastReadTime - FirstReadTime) / (ReadCount - 1);
+}
+
+double TSimulatedPortStats::GetUtilization() const
+{
+    if (SimulationTime == microseconds::zero()) {
+        return 0;
+    }
+    return static_cast<double>(BusyTime.count()) / SimulationTime.count();
+}
+
+double TSimulatedPortStats::GetBusTimeShare(PSerialDevice device) const
+{
+    auto total = microseconds::zero();
+    for (const auto& it: DevicesBusyTime) {
+        total += it.second;
+    }
+    auto it = DevicesBusyTime.find(device);
+    if (total == microseconds::zero() || it == DevicesBusyTime.end()) {
+        return 0;
+    }
+    return static_cast<double>(it->second.count()) / total.count();
+}
+
+std::vector<PRegister> TSimulatedPortStats::GetStarvedRegisters() const
+{
+    // Low priority register is starved if it has no chance to be read twice during simulation
+    std::vector<PRegister> res;
+    for (const auto& reg: Registers) {
+        if (!reg.Register->IsHighPriority() && reg.ReadCount < 2) {
+            res.push_back(reg.Register);
+        }
+    }
+    return res;
+}
+
+TPollPlanSimulator::TPollPlanSimulator(const TSettings& settings): Settings(settings)
+{}
+
+TPortFactoryFn TPollPlanSimulator::GetPortFactory() const
+{
+    auto responseTime = Settings.ResponseTime;
+    auto disconnectedSlaveIds = Settings.DisconnectedSlaveIds;
+    return [responseTime, disconnectedSlaveIds](const Json::Value& config, PRPCConfig rpcConfig) {
+        auto res = DefaultPortFactory(config, rpcConfig);
+        return std::pair<PPort, bool>(
+            std::make_shared<TSimulatedPort>(res.first, res.second, responseTime, disconnectedSlaveIds),
+            res.second);
+    };
+}
+
+std::vector<TSimulatedPortStats> TPollPlanSimulator::Run(const THandlerConfig& config) const
+{
+    std::vector<TSimulatedPortStats> res;
+    for (const auto& portConfig: config.PortConfigs) {
+        res.push_back(RunPort(*portConfig, config.GetMinLowPriorityRegistersRateLimit(*portConfig)));
+    }
+    return res;
+}
+
+TSimulatedPortStats TPollPlanSimulator::RunPort(const TPortConfig& portConfig, size_t lowPriorityRateLimit) const
+{
+    auto port = std::dynamic_pointer_cast<TSimulatedPort>(portConfig.Port);
+    if (!port) {
+        throw std::runtime_error("port " + portConfig.Port->GetDescription(false) + " is not simulated");
+    }
+
+    TSimulatedPortStats stats;
+    stats.Description = port->GetDescription(false);
+
+    std::list<PSerialDevice> devices;
+    std::unordered_map<PRegister, size_t> registerIndexes;
+    for (const auto& device: portConfig.Devices) {
+        if (!device->Protocol()->IsModbus()) {
+            LOG(Warn) << "device " << device->ToString() << " is not simulated";
+            stats.SkippedDevices.push_back(device);
+            continue;
+        }
+        devices.push_back(device);
+        for (const auto& reg: device->GetRegisters()) {
+            if (reg->AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) {
+                registerIndexes.emplace(reg, stats.Registers.size());
+                TSimulatedRegisterStats regStats;
+                regStats.Register = reg;
+                stats.Registers.push_back(regStats);
+            }
+        }
+    }
+
+    port->Open();
+    const auto startTime = port->GetTime();
+    const auto endTime = startTime + Settings.Duration;
+    // Ports are simulated independently, so unused capacity of other ports is not known.
+    // Only guaranteed part of global rate limit is used
+    auto rateLimiter = std::make_shared<TSharedRateLimiter>(lowPriorityRateLimit);
+    TSerialClientRegisterAndEventsReader reader(devices,
+                                                GetReadEventsPeriod(*port),
+                                                [port]() { return port->GetTime(); },
+                                                rateLimiter->AddPort(stats.Description, lowPriorityRateLimit),
+                                                portConfig.PriorityClasses.MinShares);
+    TSerialClientDeviceAccessHandler lastAccessedDevice(reader.GetEventsReader());
+
+    auto registerCallback = [&](PRegister reg) {
+        auto it = registerIndexes.find(reg);
+        if (it == registerIndexes.end() || reg->GetErrorState().test(TRegister::TError::ReadError)) {
+            return;
+        }
+        auto& regStats = stats.Registers[it->second];
+        auto now = port->GetTime();
+        if (regStats.ReadCount == 0) {
+            regStats.FirstReadTime = now;
+        } else {
+            regStats.MaxPeriod = std::max(regStats.MaxPeriod, ceil<microseconds>(now - regStats.LastReadTime));
+        }
+        regStats.LastReadTime = now;
+        ++regStats.ReadCount;
+        if (reg->GetErrorState().test(TRegister::TError::PollIntervalMissError)) {
+            ++regStats.PollIntervalMissCount;
+        }
+    };
+
+    while (port->GetTime() < endTime) {
+        auto cycleStartTime = port->GetTime();
+        auto device = reader.OpenPortCycle(*port, registerCallback, [](PSerialDevice) {}, lastAccessedDevice);
+        if (device) {
+            stats.DevicesBusyTime[device] += ceil<microseconds>(port->GetTime() - cycleStartTime);
+        }
+        auto deadline = std::min(reader.GetDeadline(port->GetTime()), endTime);
+        if (deadline > port->GetTime()) {
+            port->WaitUntil(deadline);
+        } else if (port->GetTime() == cycleStartTime) {
+            // Nothing was done and scheduler is not going to wait, move clock forward to avoid infinite loop
+            port->WaitUntil(cycleStartTime + 1us);
+        }
+    }
+    lastAccessedDevice.PrepareToAccess(nullptr);
+    port->Close();
+
+    stats.SimulationTime = ceil<microseconds>(port->GetTime() - startTime);
+    stats.BusyTime = stats.SimulationTime - port->GetIdleTime();
+    stats.RequestsCount = port->GetRequestsCount();
+    stats.TimeoutsCount = port->GetTimeoutsCount();
+    stats.DisconnectedDevicesBusTime = reader.GetDisconnectedDevicesBusTime();
+    return stats;
+}
+
+void PrintSimulationReport(std::ostream& out, const std::vector<TSimulatedPortStats>& stats)
+{
+    out << std::fixed << std::setprecision(1);
+    for (const auto& port: stats) {
+        out << "Port " << port.Description << std::endl
+            << "  simulated time: " << ToMilliseconds(port.SimulationTime) << " ms" << std::endl
+            << "  bus utilization: " << port.GetUtilization() * 100 << "%" << std::endl
+            << "  requests: " << port.RequestsCount << ", timeouts: " << port.TimeoutsCount << std::endl
+            << "  bus time spent on disconnected devices: " << ToMilliseconds(port.DisconnectedDevicesBusTime) << " ms"
+            << std::endl;
+        for (const auto& device: port.SkippedDevices) {
+            out << "  skipped non-Modbus device: " << device->ToString() << std::endl;
+        }
+        for (const auto& device: port.DevicesBusyTime) {
+            out << "  " << device.first->ToString() << " bus time share: " << port.GetBusTimeShare(device.first) * 100
+                << "%" << std::endl;
+        }
+        out << "  registers:" << std::endl;
+        for (const auto& reg: port.Registers) {
+            out << "    " << reg.Register->ToString() << ": ";
+            if (reg.ReadCount < 2) {
+                out << "read " << reg.ReadCount << " time(s)";
+            } else {
+                out << "period " << ToMilliseconds(reg.GetAveragePeriod()) << " ms, max "
+                    << ToMilliseconds(reg.MaxPeriod) << " ms";
+            }
+            if (reg.Register->ReadPeriod) {
+                out << ", read_period_ms " << reg.Register->ReadPeriod->count() << ", poll interval misses ";
+                if (reg.ReadCount != 0) {
+                    out << 100.0 * reg.PollIntervalMissCount / reg.ReadCount << "%";
+                } else {
+                    out << "100%";
+                }
+            }
+            out << std::endl;
+        }
+        auto starved = port.GetStarvedRegisters();
+        if (!starved.empty()) {
+            out << "  starved low priority registers: " << starved.size() << std::endl;
+            for (const auto& reg: starved) {
+                out << "    " << reg->ToString() << std::endl;
+            }
+        }
+    }
+}
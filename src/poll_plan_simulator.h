@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <set>
+#include <vector>
+
+#include "port.h"
+#include "serial_config.h"
+
+/**
+ * @brief Port model for offline poll plan simulation.
+ *        It doesn't touch hardware, answers Modbus requests with zero filled responses
+ *        and advances virtual clock according to transmission and response times.
+ */
+class TSimulatedPort: public TPort
+{
+public:
+    TSimulatedPort(PPort port,
+                   bool isModbusTcp,
+                   std::chrono::microseconds responseTime,
+                   const std::set<uint8_t>& disconnectedSlaveIds = std::set<uint8_t>());
+
+    void Open() override;
+    void Close() override;
+    bool IsOpen() const override;
+    void CheckPortOpen() const override;
+
+    void WriteBytes(const uint8_t* buf, int count) override;
+
+    uint8_t ReadByte(const std::chrono::microseconds& timeout) override;
+
+    TReadFrameResult ReadFrame(uint8_t* buf,
+                               size_t count,
+                               const std::chrono::microseconds& responseTimeout,
+                               const std::chrono::microseconds& frameTimeout,
+                               TFrameCompletePred frameComplete = 0) override;
+
+    void SkipNoise() override;
+
+    void SleepSinceLastInteraction(const std::chrono::microseconds& us) override;
+
+    std::chrono::microseconds GetSendTimeBytes(double bytesNumber) const override;
+    std::chrono::microseconds GetSendTimeBits(size_t bitsNumber) const override;
+
+    std::string GetDescription(bool verbose = true) const override;
+
+    std::chrono::steady_clock::time_point GetTime() const;
+
+    //! Advance virtual clock without bus activity
+    void WaitUntil(std::chrono::steady_clock::time_point time);
+
+    std::chrono::microseconds GetIdleTime() const;
+    size_t GetRequestsCount() const;
+    size_t GetTimeoutsCount() const;
+
+private:
+    PPort Port;
+    bool IsModbusTcp;
+    bool IsOpenFlg = false;
+    std::chrono::microseconds ResponseTime;
+    std::set<uint8_t> DisconnectedSlaveIds;
+    std::chrono::steady_clock::time_point Time;
+    std::chrono::steady_clock::time_point LastInteraction;
+    std::chrono::microseconds IdleTime = std::chrono::microseconds::zero();
+    std::deque<uint8_t> Response;
+    bool WaitingForResponse = false;
+    size_t RequestsCount = 0;
+    size_t TimeoutsCount = 0;
+};
+
+typedef std::shared_ptr<TSimulatedPort> PSimulatedPort;
+
+struct TSimulatedRegisterStats
+{
+    PRegister Register;
+    size_t ReadCount = 0;
+    size_t PollIntervalMissCount = 0;
+    std::chrono::steady_clock::time_point FirstReadTime;
+    std::chrono::steady_clock::time_point LastReadTime;
+    std::chrono::microseconds MaxPeriod = std::chrono::microseconds::zero();
+
+    std::chrono::microseconds GetAveragePeriod() const;
+};
+
+struct TSimulatedPortStats
+{
+    std::string Description;
+    std::chrono::microseconds SimulationTime = std::chrono::microseconds::zero();
+    std::chrono::microseconds BusyTime = std::chrono::microseconds::zero();
+    size_t RequestsCount = 0;
+    size_t TimeoutsCount = 0;
+    std::vector<TSimulatedRegisterStats> Registers;
+    std::vector<PSerialDevice> SkippedDevices;
+    std::map<PSerialDevice, std::chrono::microseconds> DevicesBusyTime;
+    std::chrono::microseconds DisconnectedDevicesBusTime = std::chrono::microseconds::zero();
+
+    double GetUtilization() const;
+
+    //! Part of bus busy time used by the device
+    double GetBusTimeShare(PSerialDevice device) const;
+    std::vector<PRegister> GetStarvedRegisters() const;
+};
+
+/**
+ * @brief Runs real poll scheduler against simulated ports to estimate bus capacity before commissioning.
+ *        Ports are simulated independently as they are polled in parallel.
+ *        Only Modbus devices are simulated, Wiren Board events are not supported by simulated devices,
+ *        so all registers are polled.
+ */
+class TPollPlanSimulator
+{
+public:
+    struct TSettings
+    {
+        //! Simulated polling duration
+        std::chrono::seconds Duration = std::chrono::seconds(60);
+
+        //! Time from request end to response start
+        std::chrono::microseconds ResponseTime = std::chrono::milliseconds(2);
+
+        //! Devices with the slave ids don't answer
+        std::set<uint8_t> DisconnectedSlaveIds;
+    };
+
+    TPollPlanSimulator(const TSettings& settings);
+
+    /**
+     * @brief Port factory for LoadConfig.
+     *        Wraps ports created by DefaultPortFactory in TSimulatedPort
+     */
+    TPortFactoryFn GetPortFactory() const;
+
+    std::vector<TSimulatedPortStats> Run(const THandlerConfig& config) const;
+
+private:
+    TSettings Settings;
+
+    TSimulatedPortStats RunPort(const TPortConfig& portConfig, size_t lowPriorityRateLimit) const;
+};
+
+void PrintSimulationReport(std::ostream& out, const std::vector<TSimulatedPortStats>& stats);
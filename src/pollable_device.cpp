@@ -1,5 +1,15 @@
 #include "pollable_device.h"
 
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+
+namespace
+{
+    //! Limits planning time of a range if a lot of registers are due
+    const size_t MAX_PLANNED_REGISTERS = 256;
+}
+
 bool TRegisterComparePredicate::operator()(const PRegister& r1, const PRegister& r2) const
 {
     if (r1->Type != r2->Type) {
@@ -13,21 +23,92 @@ bool TRegisterComparePredicate::operator()(const PRegister& r1, const PRegister&
     return r1->GetDataOffset() > r2->GetDataOffset();
 }
 
+std::map<PSerialDevice, TPollPhases> GetPollPhases(const std::list<PSerialDevice>& devices)
+{
+    std::map<std::chrono::milliseconds, std::vector<PSerialDevice>> devicesByPeriod;
+    for (const auto& device: devices) {
+        std::set<std::chrono::milliseconds> periods;
+        for (const auto& reg: device->GetRegisters()) {
+            if (reg->ReadPeriod && reg->AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) {
+                periods.insert(*reg->ReadPeriod);
+            }
+        }
+        for (const auto& period: periods) {
+            devicesByPeriod[period].push_back(device);
+        }
+    }
+    std::map<PSerialDevice, TPollPhases> res;
+    for (const auto& periodDevices: devicesByPeriod) {
+        const auto& period = periodDevices.first;
+        const auto& periodDevicesList = periodDevices.second;
+        for (size_t i = 0; i < periodDevicesList.size(); ++i) {
+            res[periodDevicesList[i]][period] = period * i / periodDevicesList.size();
+        }
+    }
+    return res;
+}
+
 TPollableDevice::TPollableDevice(PSerialDevice device,
                                  std::chrono::steady_clock::time_point currentTime,
-                                 TPriority priority)
+                                 TPriority priority,
+                                 const TPollPhases& phases)
     : Device(device),
-      Priority(priority)
+      Priority(priority),
+      Phases(phases)
 {
     for (const auto& reg: Device->GetRegisters()) {
-        if ((Priority == TPriority::High && reg->IsHighPriority()) ||
-            (Priority == TPriority::Low && !reg->IsHighPriority()))
-        {
+        if (reg->GetPriority() == Priority) {
             if (reg->AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) {
-                Registers.AddEntry(reg, currentTime);
+                RegisterIndexes.emplace(reg, RegisterTable.size());
+                RegisterTable.push_back(reg);
             }
         }
     }
+
+    // Order registers once, so the schedule can compare integers
+    std::vector<uint32_t> sorted(RegisterTable.size());
+    for (uint32_t i = 0; i < sorted.size(); ++i) {
+        sorted[i] = i;
+    }
+    auto isBefore = [this](uint32_t i1, uint32_t i2) {
+        return TRegisterComparePredicate()(RegisterTable[i2], RegisterTable[i1]);
+    };
+    std::sort(sorted.begin(), sorted.end(), isBefore);
+    RegisterEntries.resize(RegisterTable.size());
+    uint32_t order = 0;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        if (i != 0 && isBefore(sorted[i - 1], sorted[i])) {
+            ++order;
+        }
+        RegisterEntries[sorted[i]] = TScheduledRegister{sorted[i], order};
+    }
+
+    for (const auto& entry: RegisterEntries) {
+        Registers.AddEntry(entry, GetFirstReadTime(RegisterTable[entry.Index], currentTime));
+    }
+}
+
+const TScheduledRegister& TPollableDevice::GetEntry(const PRegister& reg) const
+{
+    return RegisterEntries[RegisterIndexes.at(reg)];
+}
+
+const PRegister& TPollableDevice::GetTopRegister() const
+{
+    return RegisterTable[Registers.GetTop().Data.Index];
+}
+
+std::chrono::steady_clock::time_point TPollableDevice::GetFirstReadTime(
+    PRegister reg,
+    std::chrono::steady_clock::time_point currentTime) const
+{
+    if (reg->ReadPeriod) {
+        auto it = Phases.find(*reg->ReadPeriod);
+        if (it != Phases.end()) {
+            return currentTime + it->second;
+        }
+    }
+    return currentTime;
 }
 
 PRegisterRange TPollableDevice::ReadRegisterRange(std::chrono::milliseconds pollLimit,
@@ -37,16 +118,34 @@ PRegisterRange TPollableDevice::ReadRegisterRange(std::chrono::milliseconds poll
 {
     auto currentTime = sessionTime.GetStartTime();
     auto registerRange = Device->CreateRegisterRange();
-    while (Registers.HasReadyItems(currentTime)) {
-        const auto limit = (readAtLeastOneRegister && registerRange->RegisterList().empty())
-                               ? std::chrono::milliseconds::max()
-                               : pollLimit;
-        const auto& item = Registers.GetTop();
-        if (!registerRange->Add(item.Data, limit)) {
-            break;
-        }
+
+    // Only one register is read to check if disconnected device is back
+    const bool isProbe = Device->DeviceConfig()->MaxProbeInterval.count() > 0 &&
+                         Device->GetConnectionState() == TDeviceConnectionState::DISCONNECTED;
+    const size_t maxDueRegisters = isProbe ? 1 : MAX_PLANNED_REGISTERS;
+    std::vector<TRegisterSchedule::TItem> dueItems;
+    std::list<PRegister> dueRegisters;
+    while (Registers.HasReadyItems(currentTime) && dueItems.size() < maxDueRegisters) {
+        dueItems.push_back(Registers.GetTop());
+        dueRegisters.push_back(GetTopRegister());
         Registers.Pop();
     }
+    if (!dueRegisters.empty()) {
+        auto notAdded = registerRange->AddRegisters(dueRegisters, pollLimit, readAtLeastOneRegister);
+        if (!notAdded.empty()) {
+            std::unordered_set<PRegister> notAddedSet(notAdded.begin(), notAdded.end());
+            for (const auto& item: dueItems) {
+                if (notAddedSet.count(RegisterTable[item.Data.Index])) {
+                    Registers.AddEntry(item.Data, item.Deadline);
+                }
+            }
+        }
+    }
+
+    const auto lookahead = Device->DeviceConfig()->PollLookahead;
+    if (!registerRange->RegisterList().empty() && lookahead.count() > 0 && !isProbe) {
+        AddSoonDueRegisters(*registerRange, currentTime + lookahead, pollLimit);
+    }
 
     if (!registerRange->RegisterList().empty()) {
         bool readOk = false;
@@ -77,7 +176,7 @@ std::list<PRegister> TPollableDevice::MarkWaitingRegistersAsReadErrorAndReschedu
 {
     std::list<PRegister> res;
     while (Registers.HasReadyItems(currentTime)) {
-        res.push_back(Registers.GetTop().Data);
+        res.push_back(GetTopRegister());
         Registers.Pop();
     }
     for (const auto& reg: res) {
@@ -113,40 +212,75 @@ bool TPollableDevice::HasRegisters() const
 
 void TPollableDevice::RescheduleAllRegisters(std::chrono::steady_clock::time_point currentTime)
 {
-    for (const auto& reg: Device->GetRegisters()) {
-        if ((Priority == TPriority::High && reg->IsHighPriority()) ||
-            (Priority == TPriority::Low && !reg->IsHighPriority()))
-        {
-            if (reg->AccessType != TRegisterConfig::EAccessType::WRITE_ONLY) {
-                if (reg->IsExcludedFromPolling() && !Registers.Contains(reg)) {
-                    reg->SetAvailable(TRegisterAvailability::UNKNOWN);
-                    reg->IncludeInPolling();
-                    Registers.AddEntry(reg, currentTime);
-                }
-            }
+    for (const auto& entry: RegisterEntries) {
+        const auto& reg = RegisterTable[entry.Index];
+        if (reg->IsExcludedFromPolling() && !Registers.Contains(entry)) {
+            reg->SetAvailable(TRegisterAvailability::UNKNOWN);
+            reg->IncludeInPolling();
+            Registers.AddEntry(entry, GetFirstReadTime(reg, currentTime));
         }
     }
 }
 
+void TPollableDevice::DelayPolling(std::chrono::steady_clock::time_point time)
+{
+    std::vector<TScheduledRegister> entries;
+    while (Registers.HasReadyItems(time)) {
+        entries.push_back(Registers.GetTop().Data);
+        Registers.Pop();
+    }
+    for (const auto& entry: entries) {
+        Registers.AddEntry(entry, time);
+    }
+}
+
+void TPollableDevice::ResumePolling(std::chrono::steady_clock::time_point currentTime)
+{
+    for (const auto& entry: RegisterEntries) {
+        if (Registers.Contains(entry)) {
+            Registers.AddEntry(entry, GetFirstReadTime(RegisterTable[entry.Index], currentTime));
+        }
+    }
+}
+
+void TPollableDevice::AddSoonDueRegisters(TRegisterRange& registerRange,
+                                          std::chrono::steady_clock::time_point lookaheadTime,
+                                          std::chrono::milliseconds pollLimit)
+{
+    std::vector<TRegisterSchedule::TItem> skipped;
+    while (Registers.HasReadyItems(lookaheadTime)) {
+        auto item = Registers.GetTop();
+        Registers.Pop();
+        const auto& reg = RegisterTable[item.Data.Index];
+        // Unavailable registers are silently dropped by range, they must stay in schedule
+        if (reg->GetAvailable() == TRegisterAvailability::UNAVAILABLE || !registerRange.Add(reg, pollLimit)) {
+            skipped.push_back(item);
+        }
+    }
+    for (const auto& item: skipped) {
+        Registers.AddEntry(item.Data, item.Deadline);
+    }
+}
+
 void TPollableDevice::ScheduleNextPoll(PRegister reg, std::chrono::steady_clock::time_point currentTime)
 {
     if (reg->IsExcludedFromPolling()) {
         // If register is sporadic it must be read once to get actual value
         // Keep polling it until successful read
         if (reg->GetValue().GetType() == TRegisterValue::ValueType::Undefined) {
-            Registers.AddEntry(reg, currentTime + std::chrono::microseconds(1));
+            Registers.AddEntry(GetEntry(reg), currentTime + std::chrono::microseconds(1));
         }
         return;
     }
-    if (Priority == TPriority::High) {
-        Registers.AddEntry(reg, currentTime + *(reg->ReadPeriod));
+    if (reg->ReadPeriod) {
+        Registers.AddEntry(GetEntry(reg), currentTime + *(reg->ReadPeriod));
         return;
     }
     if (reg->ReadRateLimit) {
-        Registers.AddEntry(reg, currentTime + *(reg->ReadRateLimit));
+        Registers.AddEntry(GetEntry(reg), currentTime + *(reg->ReadRateLimit));
         return;
     }
     // Low priority registers should be scheduled to read as soon as possible,
     // but with a small delay after current read.
-    Registers.AddEntry(reg, currentTime + std::chrono::microseconds(1));
+    Registers.AddEntry(GetEntry(reg), currentTime + std::chrono::microseconds(1));
 }
\ No newline at end of file
@@ -5,21 +5,96 @@
 #include "serial_client_device_access_handler.h"
 #include "serial_device.h"
 
+#include <unordered_map>
+#include <vector>
+
 struct TRegisterComparePredicate
 {
     bool operator()(const PRegister& r1, const PRegister& r2) const;
 };
 
+/**
+ * @brief Entry of TPollableDevice's registers schedule.
+ *        A register is identified by index in the device's register table.
+ *        Registers with equal deadlines are ordered by precalculated Order,
+ *        so the schedule's heap neither dereferences registers nor calls virtual address comparison.
+ */
+struct TScheduledRegister
+{
+    uint32_t Index;
+
+    //! Registers with smaller order are read first. Equal for registers equal by TRegisterComparePredicate
+    uint32_t Order;
+
+    bool operator==(const TScheduledRegister& other) const
+    {
+        return Index == other.Index;
+    }
+};
+
+struct TScheduledRegisterHash
+{
+    size_t operator()(const TScheduledRegister& reg) const
+    {
+        return reg.Index;
+    }
+};
+
+struct TScheduledRegisterComparePredicate
+{
+    bool operator()(const TScheduledRegister& r1, const TScheduledRegister& r2) const
+    {
+        return r1.Order > r2.Order;
+    }
+};
+
+//! Delays of first reads of device registers by read period
+typedef std::map<std::chrono::milliseconds, std::chrono::milliseconds> TPollPhases;
+
+/**
+ * @brief Spread first reads of registers with equal read periods over the period.
+ *        Registers of a device with equal periods get the same delay, so they can still be read by one request.
+ *        Devices get delays according to their order in the list, the first one is read immediately.
+ */
+std::map<PSerialDevice, TPollPhases> GetPollPhases(const std::list<PSerialDevice>& devices);
+
 class TPollableDevice
 {
+    typedef TPriorityQueueSchedule<TScheduledRegister, TScheduledRegisterComparePredicate, TScheduledRegisterHash>
+        TRegisterSchedule;
+
     PSerialDevice Device;
-    TPriorityQueueSchedule<PRegister, TRegisterComparePredicate> Registers;
+
+    //! Pollable registers of the device with the priority. Indexes are stable, so schedule stores them
+    std::vector<PRegister> RegisterTable;
+    std::vector<TScheduledRegister> RegisterEntries;
+    std::unordered_map<PRegister, uint32_t> RegisterIndexes;
+
+    TRegisterSchedule Registers;
     TPriority Priority;
+    TPollPhases Phases;
+
+    std::chrono::steady_clock::time_point GetFirstReadTime(PRegister reg,
+                                                           std::chrono::steady_clock::time_point currentTime) const;
 
     void ScheduleNextPoll(PRegister reg, std::chrono::steady_clock::time_point currentTime);
 
+    const TScheduledRegister& GetEntry(const PRegister& reg) const;
+    const PRegister& GetTopRegister() const;
+
+    /**
+     * @brief Add to the range registers with deadlines not later than lookaheadTime.
+     *        Registers that don't fit into the range keep their deadlines.
+     */
+    void AddSoonDueRegisters(TRegisterRange& registerRange,
+                             std::chrono::steady_clock::time_point lookaheadTime,
+                             std::chrono::milliseconds pollLimit);
+
 public:
-    TPollableDevice(PSerialDevice device, std::chrono::steady_clock::time_point currentTime, TPriority priority);
+    TPollableDevice(PSerialDevice device,
+                    std::chrono::steady_clock::time_point currentTime,
+                    TPriority priority,
+                    const TPollPhases& phases = TPollPhases());
 
     PRegisterRange ReadRegisterRange(std::chrono::milliseconds pollLimit,
                                      bool readAtLeastOneRegister,
@@ -38,6 +113,15 @@ public:
     bool HasRegisters() const;
 
     void RescheduleAllRegisters(std::chrono::steady_clock::time_point currentTime);
+
+    /**
+     * @brief Postpone reading of registers scheduled before the time.
+     *        Used to probe disconnected device rarely.
+     */
+    void DelayPolling(std::chrono::steady_clock::time_point time);
+
+    //! Schedule all registers for reading after successful probe of disconnected device
+    void ResumePolling(std::chrono::steady_clock::time_point currentTime);
 };
 
 typedef std::shared_ptr<TPollableDevice> PPollableDevice;
@@ -9,6 +9,12 @@ void TPort::Reopen()
     }
 }
 
+bool TPort::TryOpen()
+{
+    Open();
+    return true;
+}
+
 void TPort::WriteBytes(const std::vector<uint8_t>& buf)
 {
     WriteBytes(&buf[0], buf.size());
@@ -35,6 +41,9 @@ void TPort::ApplySerialPortSettings(const TSerialPortConnectionSettings& setting
 void TPort::ResetSerialPortSettings()
 {}
 
+void TPort::ReportFrameError()
+{}
+
 TPortOpenCloseLogic::TPortOpenCloseLogic(const TPortOpenCloseLogic::TSettings& settings, util::TGetNowFn nowFn)
     : Settings(settings),
       NowFn(nowFn)
@@ -52,15 +61,25 @@ void TPortOpenCloseLogic::OpenIfAllowed(PPort port)
     }
 
     try {
-        port->Open();
+        Opening = !port->TryOpen();
     } catch (...) {
+        Opening = false;
         NextOpenTryTime = currentTime + Settings.ReopenTimeout;
         throw;
     }
+    if (Opening) {
+        // Opening will be continued in the next cycle
+        return;
+    }
     LastSuccessfulCycle = NowFn();
     RemainingFailCycles = Settings.ConnectionMaxFailCycles;
 }
 
+bool TPortOpenCloseLogic::IsOpening() const
+{
+    return Opening;
+}
+
 void TPortOpenCloseLogic::CloseIfNeeded(PPort port, bool allPreviousDataExchangeWasFailed)
 {
     if (!port->IsOpen()) {
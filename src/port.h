@@ -30,6 +30,16 @@ public:
     virtual ~TPort() = default;
 
     virtual void Open() = 0;
+
+    /**
+     * @brief Open port without blocking for a long time.
+     *        Throws TSerialDeviceException on errors.
+     *        Default implementation calls Open.
+     *
+     * @return true if the port is open, false if opening is in progress and the method must be called again later
+     */
+    virtual bool TryOpen();
+
     virtual void Close() = 0;
     virtual void Reopen();
     virtual bool IsOpen() const = 0;
@@ -89,6 +99,12 @@ public:
      * @brief Reset connection parameters to preconfigured if it is a serial port
      */
     virtual void ResetSerialPortSettings();
+
+    /**
+     * @brief Notify the port about a corrupted or truncated frame received by the protocol.
+     *        Ports with adaptive timing fall back to safe delays.
+     */
+    virtual void ReportFrameError();
 };
 
 using PPort = std::shared_ptr<TPort>;
@@ -108,10 +124,14 @@ public:
     void OpenIfAllowed(PPort port);
     void CloseIfNeeded(PPort port, bool allPreviousDataExchangeWasFailed);
 
+    //! Port opening is started by OpenIfAllowed, but not completed yet
+    bool IsOpening() const;
+
 private:
     TPortOpenCloseLogic::TSettings Settings;
     std::chrono::steady_clock::time_point LastSuccessfulCycle;
     size_t RemainingFailCycles;
     std::chrono::steady_clock::time_point NextOpenTryTime;
+    bool Opening = false;
     util::TGetNowFn NowFn;
 };
@@ -0,0 +1,352 @@
+#include "port_reactor.h"
+#include "log.h"
+#include "serial_exc.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#define LOG(logger) ::logger.Log() << "[port reactor] "
+
+namespace
+{
+    // Ports' code doesn't use big buffers on stack, 8 MB of thread's default stack are not needed
+    const size_t FIBER_STACK_SIZE = 256 * 1024;
+
+    const int MAX_EPOLL_EVENTS = 64;
+
+    int ToPollTimeout(std::chrono::steady_clock::time_point deadline)
+    {
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            return -1;
+        }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return std::clamp<std::chrono::milliseconds::rep>(timeout.count(), 0, INT_MAX);
+    }
+}
+
+struct TPortReactor::TFiber
+{
+    TCycleFn Cycle;
+    ucontext_t Context;
+    void* Stack = nullptr;
+    size_t StackSize = 0;
+    bool Finished = false;
+
+    //! Exception thrown by Cycle, it finishes the fiber
+    std::exception_ptr Error;
+
+    // Suspension state, it is accessed only from reactor's thread
+    bool Suspended = false;
+    int Fd = -1;
+    std::chrono::steady_clock::time_point Deadline;
+    int Result = 0;
+
+    // Set by TWaiter::WakeUp, guarded by WakeUpMutex
+    bool WakeUpRequested = false;
+
+    ~TFiber()
+    {
+        if (Stack) {
+            munmap(Stack, StackSize);
+        }
+    }
+};
+
+thread_local TPortReactor* TPortReactor::CurrentReactor = nullptr;
+thread_local TPortReactor::TFiber* TPortReactor::CurrentFiber = nullptr;
+
+TPortReactor::TWaiter::TWaiter(TPortReactor* reactor, TFiber* fiber): Reactor(reactor), Fiber(fiber)
+{}
+
+void TPortReactor::TWaiter::WakeUp() const
+{
+    Reactor->WakeUp(Fiber);
+}
+
+TPortReactor::TPortReactor(const std::string& name): Name(name), Active(true)
+{
+    // Descriptors are used by Stop and WakeUp from other threads, so they must exist before the reactor is shared
+    EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (EpollFd < 0) {
+        throw TSerialDeviceErrnoException("can't create epoll: ", errno);
+    }
+    WakeUpFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (WakeUpFd < 0) {
+        auto err = errno;
+        close(EpollFd);
+        throw TSerialDeviceErrnoException("can't create eventfd: ", err);
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, WakeUpFd, &ev) != 0) {
+        auto err = errno;
+        close(WakeUpFd);
+        close(EpollFd);
+        throw TSerialDeviceErrnoException("can't add eventfd to epoll: ", err);
+    }
+}
+
+TPortReactor::~TPortReactor()
+{
+    close(WakeUpFd);
+    close(EpollFd);
+}
+
+const std::string& TPortReactor::GetName() const
+{
+    return Name;
+}
+
+void TPortReactor::AddLoop(TCycleFn cycle)
+{
+    auto fiber = std::make_unique<TFiber>();
+    fiber->Cycle = cycle;
+
+    auto pageSize = sysconf(_SC_PAGESIZE);
+    // The lowest page is a guard page, stack overflow causes SIGSEGV instead of memory corruption
+    fiber->StackSize = FIBER_STACK_SIZE + pageSize;
+    fiber->Stack = mmap(nullptr, fiber->StackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (fiber->Stack == MAP_FAILED) {
+        fiber->Stack = nullptr;
+        throw TSerialDeviceErrnoException("can't allocate fiber's stack: ", errno);
+    }
+    mprotect(fiber->Stack, pageSize, PROT_NONE);
+
+    getcontext(&fiber->Context);
+    fiber->Context.uc_stack.ss_sp = static_cast<char*>(fiber->Stack) + pageSize;
+    fiber->Context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber->Context.uc_link = &MainContext;
+    auto ptr = reinterpret_cast<uintptr_t>(fiber.get());
+    makecontext(&fiber->Context,
+                reinterpret_cast<void (*)()>(&TPortReactor::FiberMain),
+                2,
+                uint32_t(ptr),
+                uint32_t(uint64_t(ptr) >> 32));
+
+    Fibers.push_back(std::move(fiber));
+}
+
+void TPortReactor::FiberMain(uint32_t fiberLow, uint32_t fiberHigh)
+{
+    auto fiber = reinterpret_cast<TFiber*>((uintptr_t(fiberHigh) << 32) | fiberLow);
+    auto reactor = CurrentReactor;
+    try {
+        while (reactor->Active) {
+            fiber->Cycle();
+        }
+    } catch (...) {
+        // Exception can't leave the fiber's stack, Run handles it after switching back
+        fiber->Error = std::current_exception();
+    }
+    fiber->Finished = true;
+    // Return to MainContext by uc_link
+}
+
+bool TPortReactor::Run()
+{
+    CurrentReactor = this;
+    for (auto& fiber: Fibers) {
+        Resume(*fiber);
+    }
+    while (std::any_of(Fibers.begin(), Fibers.end(), [](const auto& fiber) { return !fiber->Finished; })) {
+        ProcessEvents();
+    }
+    CurrentReactor = nullptr;
+    return !Failed;
+}
+
+void TPortReactor::Stop()
+{
+    Active = false;
+    uint64_t value = 1;
+    if (write(WakeUpFd, &value, sizeof(value)) < 0) {
+        // The counter is already big, the reactor will wake up anyway
+    }
+}
+
+void TPortReactor::Resume(TFiber& fiber)
+{
+    fiber.Suspended = false;
+    CurrentFiber = &fiber;
+    swapcontext(&MainContext, &fiber.Context);
+    CurrentFiber = nullptr;
+    if (fiber.Error) {
+        try {
+            std::rethrow_exception(fiber.Error);
+        } catch (const std::exception& e) {
+            LOG(Error) << "FATAL: " << e.what() << ". Stopping event loops.";
+        } catch (...) {
+            LOG(Error) << "FATAL: unknown exception. Stopping event loops.";
+        }
+        fiber.Error = nullptr;
+        Fail();
+    }
+}
+
+void TPortReactor::Fail()
+{
+    Failed = true;
+    // Other loops complete their current cycles, so their ports are closed properly
+    Active = false;
+}
+
+void TPortReactor::WakeUp(TFiber* fiber)
+{
+    {
+        std::unique_lock<std::mutex> lock(WakeUpMutex);
+        fiber->WakeUpRequested = true;
+        WokenUp.push_back(fiber);
+    }
+    uint64_t value = 1;
+    if (write(WakeUpFd, &value, sizeof(value)) < 0) {
+        // The counter is already big, the reactor will wake up anyway
+    }
+}
+
+void TPortReactor::ProcessEvents()
+{
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    for (const auto& fiber: Fibers) {
+        if (fiber->Suspended) {
+            deadline = std::min(deadline, fiber->Deadline);
+        }
+    }
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    auto count = epoll_wait(EpollFd, events, MAX_EPOLL_EVENTS, ToPollTimeout(deadline));
+    if (count < 0 && errno != EINTR) {
+        auto err = errno;
+        LOG(Error) << "FATAL: epoll_wait failed: " << strerror(err) << ". Stopping event loops.";
+        Fail();
+        // Waiting is not possible anymore, so all fibers get an error and complete their cycles
+        for (const auto& fiber: Fibers) {
+            if (fiber->Suspended) {
+                fiber->Result = -1;
+                errno = err;
+                Resume(*fiber);
+            }
+        }
+        return;
+    }
+
+    std::vector<TFiber*> ready;
+    for (int i = 0; i < count; ++i) {
+        auto fiber = static_cast<TFiber*>(events[i].data.ptr);
+        if (fiber) {
+            fiber->Result = 1;
+            ready.push_back(fiber);
+            continue;
+        }
+        uint64_t value;
+        if (read(WakeUpFd, &value, sizeof(value)) < 0) {
+            // Nothing to read, all wake ups are already processed
+        }
+        std::unique_lock<std::mutex> lock(WakeUpMutex);
+        for (auto fiber: WokenUp) {
+            // Fibers waiting for fd don't wait for WakeUp
+            if (fiber->Suspended && fiber->Fd < 0 && fiber->WakeUpRequested) {
+                fiber->WakeUpRequested = false;
+                fiber->Result = 1;
+                ready.push_back(fiber);
+            }
+        }
+        WokenUp.clear();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& fiber: Fibers) {
+        if (fiber->Suspended && fiber->Deadline <= now &&
+            std::find(ready.begin(), ready.end(), fiber.get()) == ready.end())
+        {
+            fiber->Result = 0;
+            ready.push_back(fiber.get());
+        }
+    }
+
+    for (auto fiber: ready) {
+        Resume(*fiber);
+    }
+}
+
+bool TPortReactor::InFiber()
+{
+    return CurrentFiber != nullptr;
+}
+
+TPortReactor::TWaiter TPortReactor::GetWaiter()
+{
+    return TWaiter(CurrentReactor, CurrentFiber);
+}
+
+int TPortReactor::Suspend(int fd, short events, std::chrono::steady_clock::time_point deadline)
+{
+    auto reactor = CurrentReactor;
+    auto fiber = CurrentFiber;
+    if (fd < 0) {
+        std::unique_lock<std::mutex> lock(reactor->WakeUpMutex);
+        if (fiber->WakeUpRequested) {
+            fiber->WakeUpRequested = false;
+            return 1;
+        }
+    } else {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = fiber;
+        if (epoll_ctl(reactor->EpollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            return -1;
+        }
+    }
+
+    fiber->Fd = fd;
+    fiber->Deadline = deadline;
+    fiber->Suspended = true;
+    swapcontext(&fiber->Context, &reactor->MainContext);
+
+    if (fd >= 0) {
+        epoll_ctl(reactor->EpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    fiber->Fd = -1;
+    return fiber->Result;
+}
+
+int WaitForFd(int fd, short events, const std::chrono::microseconds& timeout)
+{
+    if (TPortReactor::InFiber()) {
+        auto deadline = (timeout.count() < 0) ? std::chrono::steady_clock::time_point::max()
+                                              : std::chrono::steady_clock::now() + timeout;
+        return TPortReactor::Suspend(fd, events, deadline);
+    }
+
+    pollfd pfd{fd, events, 0};
+    timespec ts, *tsp = nullptr;
+    if (timeout.count() >= 0) {
+        ts.tv_sec = timeout.count() / 1000000;
+        ts.tv_nsec = (timeout.count() % 1000000) * 1000;
+        tsp = &ts;
+    }
+    auto res = ppoll(&pfd, 1, tsp, nullptr);
+    return (res > 0) ? 1 : res;
+}
+
+void SleepFor(const std::chrono::microseconds& timeout)
+{
+    if (!TPortReactor::InFiber()) {
+        std::this_thread::sleep_for(timeout);
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    // The fiber is not woken up by anybody, but WakeUp can remain from previous waiting
+    while (std::chrono::steady_clock::now() < deadline) {
+        TPortReactor::Suspend(-1, 0, deadline);
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ucontext.h>
+
+/**
+ * @brief Runs loops of several ports in one thread.
+ *        Each loop is executed in its own fiber with a small stack.
+ *        A fiber is suspended while its port waits for data, sleeps or waits for writes and RPC requests,
+ *        so other ports are served meanwhile and the thread sleeps in epoll_wait only when all ports wait.
+ *        Blocking functions of ports and TBinarySemaphore switch to fibers automatically
+ *        if they are called from a reactor's thread.
+ */
+class TPortReactor
+{
+    struct TFiber;
+
+public:
+    typedef std::function<void()> TCycleFn;
+
+    //! Handle to wake up a fiber from any thread
+    class TWaiter
+    {
+    public:
+        TWaiter(TPortReactor* reactor, TFiber* fiber);
+        void WakeUp() const;
+
+    private:
+        TPortReactor* Reactor;
+        TFiber* Fiber;
+    };
+
+    //! Throws TSerialDeviceErrnoException if epoll can't be created
+    TPortReactor(const std::string& name);
+    ~TPortReactor();
+
+    const std::string& GetName() const;
+
+    /**
+     * @brief Add loop calling cycle while the reactor is active. Must be called before Run.
+     *        Throws TSerialDeviceErrnoException if a stack for the loop can't be allocated.
+     */
+    void AddLoop(TCycleFn cycle);
+
+    /**
+     * @brief Run loops until Stop is called and all of them complete their current cycle.
+     *        Doesn't throw, so it can be the body of a thread.
+     *        If a loop throws an exception, it is logged and all loops are stopped.
+     *
+     * @return false if loops are stopped because of an error
+     */
+    bool Run();
+
+    //! Can be called from any thread
+    void Stop();
+
+    //! True if called from a fiber of a reactor
+    static bool InFiber();
+
+    //! Handle of current fiber. Must be called from a fiber
+    static TWaiter GetWaiter();
+
+    /**
+     * @brief Suspend current fiber until fd is ready for events or deadline is reached.
+     *        If fd is -1, the fiber is also resumed by TWaiter::WakeUp.
+     *        Must be called from a fiber.
+     *
+     * @param fd file descriptor to wait for or -1
+     * @param events poll events (POLLIN, POLLOUT)
+     * @return 1 if fd is ready or the fiber is woken up, 0 on timeout, -1 on error with errno set
+     */
+    static int Suspend(int fd, short events, std::chrono::steady_clock::time_point deadline);
+
+private:
+    void Resume(TFiber& fiber);
+    void WakeUp(TFiber* fiber);
+    void ProcessEvents();
+    void Fail();
+    static void FiberMain(uint32_t fiberLow, uint32_t fiberHigh);
+
+    std::string Name;
+    std::vector<std::unique_ptr<TFiber>> Fibers;
+    std::atomic<bool> Active{false};
+    bool Failed = false;
+    int EpollFd = -1;
+    int WakeUpFd = -1;
+    ucontext_t MainContext;
+
+    //! Fibers woken up by other threads
+    std::mutex WakeUpMutex;
+    std::vector<TFiber*> WokenUp;
+
+    static thread_local TPortReactor* CurrentReactor;
+    static thread_local TFiber* CurrentFiber;
+};
+
+typedef std::shared_ptr<TPortReactor> PPortReactor;
+
+/**
+ * @brief Wait until fd is ready for events like poll.
+ *        Other ports are served meanwhile if it is called from a reactor's fiber.
+ *
+ * @param events poll events (POLLIN, POLLOUT)
+ * @param timeout waiting timeout, negative - wait infinitely
+ * @return 1 if fd is ready, 0 on timeout, -1 on error with errno set
+ */
+int WaitForFd(int fd, short events, const std::chrono::microseconds& timeout);
+
+//! Sleep, other ports are served meanwhile if it is called from a reactor's fiber
+void SleepFor(const std::chrono::microseconds& timeout);
@@ -50,6 +50,21 @@ std::list<PRegister>& TRegisterRange::RegisterList()
     return RegList;
 }
 
+std::list<PRegister> TRegisterRange::AddRegisters(const std::list<PRegister>& registers,
+                                                 std::chrono::milliseconds pollLimit,
+                                                 bool readAtLeastOneRegister)
+{
+    auto it = registers.begin();
+    for (; it != registers.end(); ++it) {
+        const auto limit =
+            (readAtLeastOneRegister && RegisterList().empty()) ? std::chrono::milliseconds::max() : pollLimit;
+        if (!Add(*it, limit)) {
+            break;
+        }
+    }
+    return std::list<PRegister>(it, registers.end());
+}
+
 bool TRegisterRange::HasOtherDeviceAndType(PRegister reg) const
 {
     if (RegisterList().empty()) {
@@ -83,7 +98,15 @@ std::string TRegisterConfig::ToString() const
 
 bool TRegisterConfig::IsHighPriority() const
 {
-    return bool(ReadPeriod);
+    return GetPriority() != TPriority::Low;
+}
+
+TPriority TRegisterConfig::GetPriority() const
+{
+    if (PriorityClass) {
+        return *PriorityClass;
+    }
+    return ReadPeriod ? TPriority::High : TPriority::Low;
 }
 
 const IRegisterAddress& TRegisterConfig::GetAddress() const
@@ -15,6 +15,7 @@
 #include <utility>
 #include <vector>
 
+#include "poll_plan.h"
 #include "register_value.h"
 #include "serial_exc.h"
 
@@ -223,6 +224,13 @@ public:
 
     // Desired interval between register reads
     std::optional<std::chrono::milliseconds> ReadPeriod;
+
+    // Explicitly set priority class. If not set, priority is defined by ReadPeriod
+    std::optional<TPriority> PriorityClass;
+
+    // Minimal interval between register writes. Values set during the interval replace each other,
+    // only the latest one is written
+    std::optional<std::chrono::milliseconds> MinWriteInterval;
     std::optional<TRegisterValue> ErrorValue;
     EWordOrder WordOrder;
 
@@ -270,6 +278,8 @@ public:
 
     bool IsHighPriority() const;
 
+    TPriority GetPriority() const;
+
     static PRegisterConfig Create(int type = 0,
                                   const TRegisterDesc& registerAddressesDescription = {},
                                   RegisterFormat format = U16,
@@ -496,6 +506,17 @@ public:
 
     virtual bool Add(PRegister reg, std::chrono::milliseconds pollLimit) = 0;
 
+    /**
+     * @brief Add registers to the range.
+     *        Default implementation adds registers in order of the list until the first failure.
+     * @param registers due registers, the most urgent first
+     * @param readAtLeastOneRegister ignore pollLimit for the first register
+     * @return registers not added to the range, they must be read later
+     */
+    virtual std::list<PRegister> AddRegisters(const std::list<PRegister>& registers,
+                                              std::chrono::milliseconds pollLimit,
+                                              bool readAtLeastOneRegister);
+
 protected:
     bool HasOtherDeviceAndType(PRegister reg) const;
 
@@ -1,11 +1,46 @@
 #include "register_handler.h"
 #include "log.h"
 
+#include <algorithm>
+
 #define LOG(logger) ::logger.Log() << "[register handler] "
 
 using namespace std::chrono;
 
-TRegisterHandler::TRegisterHandler(PSerialDevice dev, PRegister reg): Dev(dev), Reg(reg), WriteFail(false)
+void TPendingWritesQueue::Push(TRegisterHandler* handler)
+{
+    if (handler->Queued.exchange(true)) {
+        return;
+    }
+    handler->NextQueued = Head.load();
+    while (!Head.compare_exchange_weak(handler->NextQueued, handler)) {
+    }
+}
+
+std::vector<TRegisterHandler*> TPendingWritesQueue::PopAll()
+{
+    std::vector<TRegisterHandler*> res;
+    for (auto handler = Head.exchange(nullptr); handler != nullptr;) {
+        auto next = handler->NextQueued;
+        res.push_back(handler);
+        // The handler can be pushed again from now on
+        handler->Queued.store(false);
+        handler = next;
+    }
+    std::reverse(res.begin(), res.end());
+    return res;
+}
+
+bool TPendingWritesQueue::Empty() const
+{
+    return Head.load() == nullptr;
+}
+
+TRegisterHandler::TRegisterHandler(PSerialDevice dev, PRegister reg, TPendingWritesQueue& pendingWrites)
+    : Dev(dev),
+      Reg(reg),
+      WriteFail(false),
+      PendingWrites(pendingWrites)
 {}
 
 bool TRegisterHandler::NeedToFlush()
@@ -44,39 +79,62 @@ void TRegisterHandler::HandleWriteErrorRetryWrite(const TRegisterValue& tempValu
     Reg->SetError(TRegister::TError::WriteError);
 }
 
-void TRegisterHandler::Flush()
+TRegisterValue TRegisterHandler::GetValueToFlush(steady_clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(SetValueMutex);
+    ValueIsTaken = true;
+    LastWriteTime = now;
+    return ValueToSet;
+}
+
+steady_clock::time_point TRegisterHandler::GetNextWriteTime() const
+{
+    if (!LastWriteTime || !Reg->MinWriteInterval) {
+        return steady_clock::time_point::min();
+    }
+    return *LastWriteTime + *Reg->MinWriteInterval;
+}
+
+void TRegisterHandler::CompleteFlush(const TRegisterValue& value, std::exception_ptr error)
 {
-    TRegisterValue tempValue; // must be volatile
     try {
-        {
-            std::lock_guard<std::mutex> lock(SetValueMutex);
-            tempValue = ValueToSet;
+        if (error) {
+            std::rethrow_exception(error);
         }
-        Device()->WriteRegister(Reg, tempValue);
         {
             std::lock_guard<std::mutex> lock(SetValueMutex);
-            Dirty = (tempValue != ValueToSet);
+            Dirty = (value != ValueToSet);
             WriteFail = false;
         }
-        Reg->SetValue(tempValue, false);
+        Reg->SetValue(value, false);
         Reg->ClearError(TRegister::TError::WriteError);
     } catch (const TSerialDeviceInternalErrorException& e) {
-        HandleWriteErrorNoRetry(tempValue, e.what());
-        return;
+        HandleWriteErrorNoRetry(value, e.what());
     } catch (const TSerialDevicePermanentRegisterException& e) {
-        HandleWriteErrorNoRetry(tempValue, e.what());
-        return;
+        HandleWriteErrorNoRetry(value, e.what());
     } catch (const TSerialDeviceException& e) {
-        HandleWriteErrorRetryWrite(tempValue, e.what());
+        HandleWriteErrorRetryWrite(value, e.what());
     }
 }
 
-void TRegisterHandler::SetTextValue(const std::string& v)
+bool TRegisterHandler::SetTextValue(const std::string& v)
 {
-    // don't hold the lock while notifying the client below
-    std::lock_guard<std::mutex> lock(SetValueMutex);
-    Dirty = true;
-    ValueToSet = ConvertToRawValue(*Reg, v);
+    return SetRawValue(ConvertToRawValue(*Reg, v));
+}
+
+bool TRegisterHandler::SetRawValue(const TRegisterValue& value)
+{
+    bool superseded = false;
+    {
+        // don't hold the lock while notifying the client below
+        std::lock_guard<std::mutex> lock(SetValueMutex);
+        superseded = !ValueIsTaken;
+        Dirty = true;
+        ValueIsTaken = false;
+        ValueToSet = value;
+    }
+    PendingWrites.Push(this);
+    return superseded;
 }
 
 PRegister TRegisterHandler::Register() const
@@ -2,39 +2,91 @@
 #include "bcd_utils.h"
 #include "register.h"
 #include "serial_device.h"
+#include <atomic>
 #include <cmath>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 #include <wblib/utils.h>
 
 using WBMQTT::StringFormat;
 
+class TRegisterHandler;
+
+/**
+ * @brief Lock-free queue of register handlers with pending writes.
+ *        Handlers are pushed from any thread and popped by the port thread,
+ *        so it doesn't have to check every register to find values to write.
+ */
+class TPendingWritesQueue
+{
+public:
+    //! Can be called from any thread. A handler already in the queue is not added again
+    void Push(TRegisterHandler* handler);
+
+    //! Remove all handlers from the queue in order of pushing. Must be called from one thread only
+    std::vector<TRegisterHandler*> PopAll();
+
+    bool Empty() const;
+
+private:
+    std::atomic<TRegisterHandler*> Head{nullptr};
+};
+
 class TRegisterHandler
 {
 public:
-    TRegisterHandler(PSerialDevice dev, PRegister reg);
+    TRegisterHandler(PSerialDevice dev, PRegister reg, TPendingWritesQueue& pendingWrites);
 
     PRegister Register() const;
 
     bool NeedToFlush();
 
     /**
-     * @brief Write pending register value. NeedToFlush must be checked before call.
+     * @brief Get pending register value to write. NeedToFlush must be checked before call.
+     *
+     * @param now time of writing, the next write is not allowed until min_write_interval_ms after it
      */
-    void Flush();
+    TRegisterValue GetValueToFlush(std::chrono::steady_clock::time_point now);
 
-    void SetTextValue(const std::string& v);
+    //! Time since which the pending value can be written
+    std::chrono::steady_clock::time_point GetNextWriteTime() const;
+
+    /**
+     * @brief Process result of writing the value returned by GetValueToFlush
+     *
+     * @param error nullptr on success
+     */
+    void CompleteFlush(const TRegisterValue& value, std::exception_ptr error);
+
+    /**
+     * @brief Set value to write and push the handler to pending writes queue
+     *
+     * @return true if the previous value was not written yet and is replaced by the new one
+     */
+    bool SetTextValue(const std::string& v);
+
+    //! Same as SetTextValue, but the value is already converted to register's raw value
+    bool SetRawValue(const TRegisterValue& value);
     PSerialDevice Device() const;
 
 private:
+    friend class TPendingWritesQueue;
+
     std::weak_ptr<TSerialDevice> Dev;
     TRegisterValue ValueToSet{0};
     PRegister Reg;
     volatile bool Dirty = false;
+    bool ValueIsTaken = true;
+    std::optional<std::chrono::steady_clock::time_point> LastWriteTime;
     std::mutex SetValueMutex;
     bool WriteFail;
     std::chrono::steady_clock::time_point WriteFirstTryTime;
+    TPendingWritesQueue& PendingWrites;
+    std::atomic<bool> Queued{false};
+    TRegisterHandler* NextQueued = nullptr;
 
     void HandleWriteErrorNoRetry(const TRegisterValue& tempValue, const char* msg);
     void HandleWriteErrorRetryWrite(const TRegisterValue& tempValue, const char* msg);
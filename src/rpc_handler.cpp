@@ -188,6 +188,7 @@ TRPCHandler::TRPCHandler(const std::string& requestSchemaFilePath,
         "Load",
         std::bind(&TRPCHandler::PortLoad, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     rpcServer->RegisterMethod("ports", "Load", std::bind(&TRPCHandler::LoadPorts, this, std::placeholders::_1));
+    rpcServer->RegisterMethod("metrics", "Load", std::bind(&TRPCHandler::LoadMetrics, this, std::placeholders::_1));
 }
 
 PRPCPortDriver TRPCHandler::FindPortDriver(const Json::Value& request) const
@@ -256,6 +257,72 @@ Json::Value TRPCHandler::LoadPorts(const Json::Value& request)
     return RPCConfig->GetPortConfigs();
 }
 
+Json::Value TRPCHandler::LoadMetrics(const Json::Value& request)
+{
+    Json::Value res;
+    auto rateLimiter = SerialDriver->GetRateLimiter();
+    res["rate_limit"]["total"] = static_cast<Json::UInt64>(rateLimiter->GetRateLimit());
+    res["rate_limit"]["ports"] = Json::Value(Json::arrayValue);
+    for (const auto& stats: rateLimiter->GetStats(std::chrono::steady_clock::now())) {
+        Json::Value port;
+        port["port"] = stats.Port;
+        port["min_rate_limit"] = static_cast<Json::UInt64>(stats.MinRateLimit);
+        port["reads_per_second"] = static_cast<Json::UInt64>(stats.ItemsPerSecond);
+        port["total_reads"] = static_cast<Json::UInt64>(stats.TotalItems);
+        res["rate_limit"]["ports"].append(port);
+    }
+    res["disconnected_devices"] = Json::Value(Json::arrayValue);
+    for (const auto& portDriver: SerialDriver->GetPortDrivers()) {
+        auto serialClient = portDriver->GetSerialClient();
+        Json::Value port;
+        port["port"] = serialClient->GetPort()->GetDescription(false);
+        port["bus_time_ms"] = static_cast<Json::UInt64>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(serialClient->GetDisconnectedDevicesBusTime()).count());
+        res["disconnected_devices"].append(port);
+    }
+    res["bus_time_shares"] = Json::Value(Json::arrayValue);
+    for (const auto& portDriver: SerialDriver->GetPortDrivers()) {
+        auto serialClient = portDriver->GetSerialClient();
+        Json::Value port;
+        port["port"] = serialClient->GetPort()->GetDescription(false);
+        port["devices"] = Json::Value(Json::arrayValue);
+        for (const auto& share: serialClient->GetBusTimeShares()) {
+            Json::Value device;
+            device["id"] = share.first->DeviceConfig()->Id;
+            device["share"] = share.second;
+            port["devices"].append(device);
+        }
+        res["bus_time_shares"].append(port);
+    }
+    res["writes"] = Json::Value(Json::arrayValue);
+    for (const auto& portDriver: SerialDriver->GetPortDrivers()) {
+        auto serialClient = portDriver->GetSerialClient();
+        auto stats = serialClient->GetWriteStats();
+        Json::Value port;
+        port["port"] = serialClient->GetPort()->GetDescription(false);
+        port["written"] = static_cast<Json::UInt64>(stats.Written);
+        port["superseded"] = static_cast<Json::UInt64>(stats.Superseded);
+        res["writes"].append(port);
+    }
+    res["transmit"] = Json::Value(Json::arrayValue);
+    for (const auto& portDriver: SerialDriver->GetPortDrivers()) {
+        auto serialPort = std::dynamic_pointer_cast<TSerialPort>(portDriver->GetSerialClient()->GetPort());
+        if (!serialPort) {
+            continue;
+        }
+        auto stats = serialPort->GetTransmitStats();
+        Json::Value port;
+        port["port"] = serialPort->GetDescription(false);
+        port["writes"] = static_cast<Json::UInt64>(stats.Writes);
+        port["timeouts"] = static_cast<Json::UInt64>(stats.Timeouts);
+        port["estimated_time_us"] = static_cast<Json::Int64>(stats.EstimatedTime.count());
+        port["actual_time_us"] = static_cast<Json::Int64>(stats.ActualTime.count());
+        port["max_excess_us"] = static_cast<Json::Int64>(stats.MaxExcess.count());
+        res["transmit"].append(port);
+    }
+    return res;
+}
+
 TRPCException::TRPCException(const std::string& message, TRPCResultCode resultCode)
     : std::runtime_error(message),
       ResultCode(resultCode)
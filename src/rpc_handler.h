@@ -52,6 +52,7 @@ private:
                   WBMQTT::TMqttRpcServer::TResultCallback onResult,
                   WBMQTT::TMqttRpcServer::TErrorCallback onError);
     Json::Value LoadPorts(const Json::Value& request);
+    Json::Value LoadMetrics(const Json::Value& request);
 };
 
 typedef std::shared_ptr<TRPCHandler> PRPCHandler;
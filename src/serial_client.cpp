@@ -1,4 +1,5 @@
 #include "serial_client.h"
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <unistd.h>
@@ -14,37 +15,45 @@ namespace
 {
     const auto PORT_OPEN_ERROR_NOTIFICATION_INTERVAL = 5min;
     const auto CLOSED_PORT_CYCLE_TIME = 500ms;
+    const auto OPENING_PORT_CYCLE_TIME = 50ms;
     const auto MAX_POLL_TIME = 100ms;
     // const auto MAX_FLUSHES_WHEN_POLL_IS_DUE = 20;
     const auto BALANCING_THRESHOLD = 500ms;
     // const auto MIN_READ_EVENTS_TIME = 25ms;
     const size_t MAX_EVENT_READ_ERRORS = 10;
+    const auto CAPABILITIES_SAVE_PERIOD = 1min;
+};
 
-    std::chrono::milliseconds GetReadEventsPeriod(const TPort& port)
-    {
-        auto sendByteTime = port.GetSendTimeBytes(1);
-        // >= 115200
-        if (sendByteTime < 100us) {
-            return 50ms;
-        }
-        // >= 38400
-        if (sendByteTime < 300us) {
-            return 100ms;
-        }
-        // < 38400
-        return 200ms;
+std::chrono::milliseconds GetReadEventsPeriod(const TPort& port)
+{
+    auto sendByteTime = port.GetSendTimeBytes(1);
+    // >= 115200
+    if (sendByteTime < 100us) {
+        return 50ms;
     }
-};
+    // >= 38400
+    if (sendByteTime < 300us) {
+        return 100ms;
+    }
+    // < 38400
+    return 200ms;
+}
 
 TSerialClient::TSerialClient(PPort port,
                              const TPortOpenCloseLogic::TSettings& openCloseSettings,
                              util::TGetNowFn nowFn,
-                             size_t lowPriorityRateLimit)
+                             PPortRateLimiter lowPriorityRateLimiter,
+                             const TPriorityShares& priorityShares)
     : Port(port),
       OpenCloseLogic(openCloseSettings, nowFn),
       ConnectLogger(PORT_OPEN_ERROR_NOTIFICATION_INTERVAL, "[serial client] "),
       NowFn(nowFn),
-      LowPriorityRateLimit(lowPriorityRateLimit)
+      LowPriorityRateLimiter(lowPriorityRateLimiter),
+      PriorityShares(priorityShares),
+      DisconnectedDevicesBusTime(0),
+      WrittenCount(0),
+      SupersededCount(0),
+      NextPostponedWriteTime(steady_clock::time_point::max())
 {
     FlushNeeded = std::make_shared<TBinarySemaphore>();
     RPCRequestHandler = std::make_shared<TRPCRequestHandler>();
@@ -66,7 +75,7 @@ void TSerialClient::AddDevice(PSerialDevice device)
     for (const auto& reg: device->GetRegisters()) {
         if (Handlers.find(reg) != Handlers.end())
             throw TSerialDeviceException("duplicate register");
-        auto handler = Handlers[reg] = std::make_shared<TRegisterHandler>(reg->Device(), reg);
+        auto handler = Handlers[reg] = std::make_shared<TRegisterHandler>(reg->Device(), reg, PendingWrites);
         RegList.push_back(reg);
         LOG(Debug) << "AddRegister: " << reg;
     }
@@ -76,10 +85,21 @@ void TSerialClient::AddDevice(PSerialDevice device)
 void TSerialClient::Activate()
 {
     if (!RegReader) {
-        RegReader = std::make_unique<TSerialClientRegisterAndEventsReader>(Devices,
-                                                                           GetReadEventsPeriod(*Port),
-                                                                           NowFn,
-                                                                           LowPriorityRateLimit);
+        if (CapabilitiesCache) {
+            for (const auto& device: Devices) {
+                CapabilitiesCache->Restore(*device);
+            }
+            NextCapabilitiesSaveTime = NowFn() + CAPABILITIES_SAVE_PERIOD;
+        }
+        auto regReader = std::make_unique<TSerialClientRegisterAndEventsReader>(Devices,
+                                                                                GetReadEventsPeriod(*Port),
+                                                                                NowFn,
+                                                                                LowPriorityRateLimiter,
+                                                                                PriorityShares);
+        {
+            std::unique_lock<std::mutex> lock(RegReaderMutex);
+            RegReader = std::move(regReader);
+        }
         LastAccessedDevice = std::make_unique<TSerialClientDeviceAccessHandler>(RegReader->GetEventsReader());
     }
 }
@@ -91,23 +111,77 @@ void TSerialClient::Connect()
 
 void TSerialClient::DoFlush()
 {
-    for (const auto& reg: RegList) {
-        auto handler = Handlers[reg];
-        if (!handler->NeedToFlush())
+    auto now = NowFn();
+    std::vector<TRegisterHandler*> handlers;
+    std::vector<TRegisterHandler*> postponed;
+    for (auto handler: PendingWrites.PopAll()) {
+        if (!handler->NeedToFlush()) {
             continue;
-        if (LastAccessedDevice->PrepareToAccess(handler->Device())) {
-            handler->Flush();
-        } else {
-            reg->SetError(TRegister::TError::WriteError);
         }
-        if (reg->GetErrorState().test(TRegister::TError::WriteError)) {
-            if (RegisterErrorCallback) {
-                RegisterErrorCallback(reg);
-            }
+        if (handler->GetNextWriteTime() > now) {
+            postponed.push_back(handler);
         } else {
-            if (RegisterReadCallback) {
-                RegisterReadCallback(reg);
-            }
+            handlers.push_back(handler);
+        }
+    }
+
+    // Pending writes of a device are passed together, so it can combine them into fewer requests
+    for (auto first = handlers.cbegin(); first != handlers.cend();) {
+        auto device = (*first)->Device();
+        auto last = std::find_if(first, handlers.cend(), [&device](TRegisterHandler* handler) {
+            return handler->Device() != device;
+        });
+        FlushDevice(device, first, last);
+        first = last;
+    }
+
+    // Failed writes are retried, values set during writing are written next time
+    for (auto handler: handlers) {
+        if (handler->NeedToFlush()) {
+            PendingWrites.Push(handler);
+        }
+    }
+
+    // The latest value is written by the first flush after min_write_interval_ms
+    NextPostponedWriteTime = steady_clock::time_point::max();
+    for (auto handler: postponed) {
+        PendingWrites.Push(handler);
+        NextPostponedWriteTime = std::min(NextPostponedWriteTime, handler->GetNextWriteTime());
+    }
+}
+
+void TSerialClient::FlushDevice(PSerialDevice device,
+                                std::vector<TRegisterHandler*>::const_iterator first,
+                                std::vector<TRegisterHandler*>::const_iterator last)
+{
+    std::vector<TRegisterWrite> writes;
+    for (auto it = first; it != last; ++it) {
+        writes.push_back({(*it)->Register(), (*it)->GetValueToFlush(NowFn()), nullptr});
+    }
+    WrittenCount += writes.size();
+    if (LastAccessedDevice->PrepareToAccess(device)) {
+        device->WriteRegisters(writes, [&](const TRegisterWrite& write) {
+            auto handler = *(first + (&write - writes.data()));
+            handler->CompleteFlush(write.Value, write.Error);
+            ProcessWrittenRegister(write.Register);
+        });
+    } else {
+        for (const auto& write: writes) {
+            write.Register->SetError(TRegister::TError::WriteError);
+            ProcessWrittenRegister(write.Register);
+        }
+    }
+}
+
+void TSerialClient::ProcessWrittenRegister(PRegister reg)
+{
+    if (reg->GetErrorState().test(TRegister::TError::WriteError)) {
+        if (RegisterErrorCallback) {
+            RegisterErrorCallback(reg);
+        }
+    } else {
+        if (RegisterReadCallback) {
+            RegisterReadCallback(reg);
         }
     }
 }
@@ -124,10 +198,11 @@ void TSerialClient::WaitForPollAndFlush(steady_clock::time_point currentTime, st
     }
 
     // Limit waiting time to be responsive
-    waitUntil = std::min(waitUntil, currentTime + MAX_POLL_TIME);
+    waitUntil = std::min({waitUntil, currentTime + MAX_POLL_TIME, NextPostponedWriteTime});
     while (FlushNeeded->Wait(waitUntil)) {
         if (FlushNeeded->GetSignalValue(RegisterUpdateSignal)) {
             DoFlush();
+            waitUntil = std::min(waitUntil, NextPostponedWriteTime);
         }
         if (FlushNeeded->GetSignalValue(RPCSignal)) {
             // End session with current device to make bus clean for RPC
@@ -139,12 +214,8 @@ void TSerialClient::WaitForPollAndFlush(steady_clock::time_point currentTime, st
 
 void TSerialClient::UpdateFlushNeeded()
 {
-    for (const auto& reg: RegList) {
-        auto handler = Handlers[reg];
-        if (handler->NeedToFlush()) {
-            FlushNeeded->Signal(RegisterUpdateSignal);
-            break;
-        }
+    if (!PendingWrites.Empty()) {
+        FlushNeeded->Signal(RegisterUpdateSignal);
     }
 }
 
@@ -174,41 +245,64 @@ void TSerialClient::Cycle()
     if (Port->IsOpen()) {
         ConnectLogger.DropTimeout();
         OpenPortCycle();
+    } else if (OpenCloseLogic.IsOpening()) {
+        OpeningPortCycle();
     } else {
         ClosedPortCycle();
     }
 }
 
-void TSerialClient::ClosedPortCycle()
+void TSerialClient::WaitForClosedPortRequests(steady_clock::time_point waitUntil)
 {
-    auto wait_until = NowFn() + CLOSED_PORT_CYCLE_TIME;
-
-    while (FlushNeeded->Wait(wait_until)) {
+    while (FlushNeeded->Wait(waitUntil)) {
         if (FlushNeeded->GetSignalValue(RegisterUpdateSignal)) {
-            for (const auto& reg: RegList) {
-                auto handler = Handlers[reg];
+            for (auto handler: PendingWrites.PopAll()) {
                 if (!handler->NeedToFlush())
                     continue;
-                reg->SetError(TRegister::TError::WriteError);
+                handler->Register()->SetError(TRegister::TError::WriteError);
                 if (RegisterErrorCallback) {
-                    RegisterErrorCallback(reg);
+                    RegisterErrorCallback(handler->Register());
                 }
+                // Write after the port is opened
+                PendingWrites.Push(handler);
             }
         }
         if (FlushNeeded->GetSignalValue(RPCSignal)) {
             RPCRequestHandler->RPCRequestHandling(Port);
         }
     }
+}
 
+void TSerialClient::ClosedPortCycle()
+{
+    auto wait_until = NowFn() + CLOSED_PORT_CYCLE_TIME;
+    WaitForClosedPortRequests(wait_until);
     RegReader->ClosedPortCycle(
         wait_until,
         [this](PRegister reg) { ProcessPolledRegister(reg); },
         DeviceConnectionStateChangedCallback);
 }
 
+void TSerialClient::OpeningPortCycle()
+{
+    // Registers are not failed until the connection is established or failed,
+    // but writes and RPC requests are served without waiting for it
+    WaitForClosedPortRequests(NowFn() + OPENING_PORT_CYCLE_TIME);
+}
+
 void TSerialClient::SetTextValue(PRegister reg, const std::string& value)
 {
-    GetHandler(reg)->SetTextValue(value);
+    if (GetHandler(reg)->SetTextValue(value)) {
+        ++SupersededCount;
+    }
+    FlushNeeded->Signal(RegisterUpdateSignal);
+}
+
+void TSerialClient::SetRawValue(PRegister reg, const TRegisterValue& value)
+{
+    if (GetHandler(reg)->SetRawValue(value)) {
+        ++SupersededCount;
+    }
     FlushNeeded->Signal(RegisterUpdateSignal);
 }
 
@@ -246,10 +340,16 @@ void TSerialClient::OpenPortCycle()
         [this](PRegister reg) { ProcessPolledRegister(reg); },
         DeviceConnectionStateChangedCallback,
         *LastAccessedDevice);
+    DisconnectedDevicesBusTime = RegReader->GetDisconnectedDevicesBusTime().count();
 
     if (device) {
         OpenCloseLogic.CloseIfNeeded(Port, device->GetConnectionState() == TDeviceConnectionState::DISCONNECTED);
     }
+
+    if (CapabilitiesCache && NowFn() >= NextCapabilitiesSaveTime) {
+        SaveCapabilities();
+        NextCapabilitiesSaveTime = NowFn() + CAPABILITIES_SAVE_PERIOD;
+    }
 }
 
 PPort TSerialClient::GetPort()
@@ -257,6 +357,41 @@ PPort TSerialClient::GetPort()
     return Port;
 }
 
+std::chrono::microseconds TSerialClient::GetDisconnectedDevicesBusTime() const
+{
+    return std::chrono::microseconds(DisconnectedDevicesBusTime);
+}
+
+TBusTimeShares TSerialClient::GetBusTimeShares() const
+{
+    std::unique_lock<std::mutex> lock(RegReaderMutex);
+    return RegReader ? RegReader->GetBusTimeShares() : TBusTimeShares();
+}
+
+TSerialClient::TWriteStats TSerialClient::GetWriteStats() const
+{
+    TWriteStats res;
+    res.Written = WrittenCount;
+    res.Superseded = SupersededCount;
+    return res;
+}
+
+void TSerialClient::SetCapabilitiesCache(PDeviceCapabilitiesCache cache)
+{
+    CapabilitiesCache = cache;
+}
+
+void TSerialClient::SaveCapabilities()
+{
+    if (!CapabilitiesCache) {
+        return;
+    }
+    for (const auto& device: Devices) {
+        CapabilitiesCache->Update(*device);
+    }
+    CapabilitiesCache->Save();
+}
+
 void TSerialClient::RPCTransceive(PRPCRequest request) const
 {
     RPCRequestHandler->RPCTransceive(request, FlushNeeded, RPCSignal);
@@ -265,9 +400,10 @@ void TSerialClient::RPCTransceive(PRPCRequest request) const
 TSerialClientRegisterAndEventsReader::TSerialClientRegisterAndEventsReader(const std::list<PSerialDevice>& devices,
                                                                            std::chrono::milliseconds readEventsPeriod,
                                                                            util::TGetNowFn nowFn,
-                                                                           size_t lowPriorityRateLimit)
+                                                                           PPortRateLimiter lowPriorityRateLimiter,
+                                                                           const TPriorityShares& priorityShares)
     : EventsReader(MAX_EVENT_READ_ERRORS),
-      RegisterPoller(lowPriorityRateLimit),
+      RegisterPoller(lowPriorityRateLimiter, priorityShares),
       TimeBalancer(BALANCING_THRESHOLD),
       ReadEventsPeriod(readEventsPeriod),
       SpentTime(nowFn),
@@ -317,7 +453,7 @@ PSerialDevice TSerialClientRegisterAndEventsReader::OpenPortCycle(TPort& port,
 {
     // Count idle time as high priority task time to faster reach time balancing threshold
     if (LastCycleWasTooSmallToPoll) {
-        TimeBalancer.UpdateSelectionTime(ceil<milliseconds>(SpentTime.GetSpentTime()), TPriority::High);
+        TimeBalancer.UpdateSelectionTime(SpentTime.GetSpentTime(), TPriority::High);
     }
 
     SpentTime.Start();
@@ -339,7 +475,7 @@ PSerialDevice TSerialClientRegisterAndEventsReader::OpenPortCycle(TPort& port,
                     RegisterPoller.DeviceDisconnected(device, NowFn());
                 },
                 NowFn);
-            TimeBalancer.UpdateSelectionTime(ceil<milliseconds>(SpentTime.GetSpentTime()), TPriority::High);
+            TimeBalancer.UpdateSelectionTime(SpentTime.GetSpentTime(), TPriority::High);
             TimeBalancer.AddEntry(TClientTaskType::EVENTS,
                                   SpentTime.GetStartTime() + ReadEventsPeriod,
                                   TPriority::High);
@@ -379,7 +515,7 @@ PSerialDevice TSerialClientRegisterAndEventsReader::OpenPortCycle(TPort& port,
         LastCycleWasTooSmallToPoll = true;
     } else {
         LastCycleWasTooSmallToPoll = false;
-        TimeBalancer.UpdateSelectionTime(ceil<milliseconds>(SpentTime.GetSpentTime()), TPriority::Low);
+        TimeBalancer.UpdateSelectionTime(SpentTime.GetSpentTime(), TPriority::Low);
     }
 
     if (EventsReader.HasDevicesWithEnabledEvents() && !TimeBalancer.Contains(TClientTaskType::EVENTS)) {
@@ -400,3 +536,13 @@ TSerialClientEventsReader& TSerialClientRegisterAndEventsReader::GetEventsReader
 {
     return EventsReader;
 }
+
+std::chrono::microseconds TSerialClientRegisterAndEventsReader::GetDisconnectedDevicesBusTime() const
+{
+    return RegisterPoller.GetDisconnectedDevicesBusTime();
+}
+
+TBusTimeShares TSerialClientRegisterAndEventsReader::GetBusTimeShares() const
+{
+    return RegisterPoller.GetBusTimeShares();
+}
@@ -2,6 +2,7 @@
 
 #include "binary_semaphore.h"
 #include "common_utils.h"
+#include "device_capabilities_cache.h"
 #include "log.h"
 #include "modbus_ext_common.h"
 #include "poll_plan.h"
@@ -10,9 +11,11 @@
 #include "serial_client_device_access_handler.h"
 #include "serial_client_events_reader.h"
 #include "serial_client_register_poller.h"
+#include <atomic>
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 class TSerialDevice;
@@ -24,6 +27,11 @@ enum TClientTaskType
     EVENTS
 };
 
+/**
+ * @brief Period of events reading depending on port speed
+ */
+std::chrono::milliseconds GetReadEventsPeriod(const TPort& port);
+
 class TSerialClientRegisterAndEventsReader: public util::TNonCopyable
 {
 public:
@@ -33,7 +41,8 @@ public:
     TSerialClientRegisterAndEventsReader(const std::list<PSerialDevice>& devices,
                                          std::chrono::milliseconds readEventsPeriod,
                                          util::TGetNowFn nowFn,
-                                         size_t lowPriorityRateLimit = std::numeric_limits<size_t>::max());
+                                         PPortRateLimiter lowPriorityRateLimiter = nullptr,
+                                         const TPriorityShares& priorityShares = TPriorityShares());
 
     void ClosedPortCycle(std::chrono::steady_clock::time_point currentTime,
                          TRegisterCallback regCallback,
@@ -47,6 +56,11 @@ public:
 
     TSerialClientEventsReader& GetEventsReader();
 
+    std::chrono::microseconds GetDisconnectedDevicesBusTime() const;
+
+    //! Bus time shares of devices during the last finished accounting interval. Can be called from any thread
+    TBusTimeShares GetBusTimeShares() const;
+
 private:
     TSerialClientEventsReader EventsReader;
     TSerialClientRegisterPoller RegisterPoller;
@@ -64,30 +78,64 @@ public:
     typedef std::function<void(PRegister reg)> TRegisterCallback;
     typedef std::function<void(PSerialDevice dev)> TDeviceCallback;
 
+    struct TWriteStats
+    {
+        //! Register writes sent to devices, including failed ones
+        uint64_t Written = 0;
+
+        //! Values replaced by newer ones before they were written
+        uint64_t Superseded = 0;
+    };
+
     TSerialClient(PPort port,
                   const TPortOpenCloseLogic::TSettings& openCloseSettings,
                   util::TGetNowFn nowFn,
-                  size_t lowPriorityRateLimit = std::numeric_limits<size_t>::max());
+                  PPortRateLimiter lowPriorityRateLimiter = nullptr,
+                  const TPriorityShares& priorityShares = TPriorityShares());
     ~TSerialClient();
 
     void AddDevice(PSerialDevice device);
     void Cycle();
     void SetTextValue(PRegister reg, const std::string& value);
+
+    //! Queue writing of raw register value. Can be called from any thread
+    void SetRawValue(PRegister reg, const TRegisterValue& value);
     void SetReadCallback(const TRegisterCallback& callback);
     void SetErrorCallback(const TRegisterCallback& callback);
     void SetDeviceConnectionStateChangedCallback(const TDeviceCallback& callback);
     PPort GetPort();
     void RPCTransceive(PRPCRequest request) const;
 
+    //! Bus time spent on reading disconnected devices. Can be called from any thread
+    std::chrono::microseconds GetDisconnectedDevicesBusTime() const;
+
+    //! Bus time shares of devices during the last finished accounting interval. Can be called from any thread
+    TBusTimeShares GetBusTimeShares() const;
+
+    //! Can be called from any thread
+    TWriteStats GetWriteStats() const;
+
+    //! Capabilities are restored on activation and periodically stored to the cache
+    void SetCapabilitiesCache(PDeviceCapabilitiesCache cache);
+
+    //! Store capabilities of devices and save the cache. Must not be called during Cycle()
+    void SaveCapabilities();
+
 private:
     void Activate();
     void Connect();
     void DoFlush();
+    void FlushDevice(PSerialDevice device,
+                     std::vector<TRegisterHandler*>::const_iterator first,
+                     std::vector<TRegisterHandler*>::const_iterator last);
+    void ProcessWrittenRegister(PRegister reg);
     void WaitForPollAndFlush(std::chrono::steady_clock::time_point now,
                              std::chrono::steady_clock::time_point waitUntil);
     PRegisterHandler GetHandler(PRegister) const;
     void ClosedPortCycle();
+    void OpeningPortCycle();
     void OpenPortCycle();
+    void WaitForClosedPortRequests(std::chrono::steady_clock::time_point waitUntil);
     void UpdateFlushNeeded();
     void ProcessPolledRegister(PRegister reg);
 
@@ -95,6 +143,7 @@ private:
     std::list<PRegister> RegList;
     std::list<PSerialDevice> Devices;
     std::unordered_map<PRegister, PRegisterHandler> Handlers;
+    TPendingWritesQueue PendingWrites;
 
     TRegisterCallback RegisterReadCallback;
     TRegisterCallback RegisterErrorCallback;
@@ -110,9 +159,24 @@ private:
     std::unique_ptr<TSerialClientDeviceAccessHandler> LastAccessedDevice;
     std::unique_ptr<TSerialClientRegisterAndEventsReader> RegReader;
 
+    //! Guards creation of RegReader, it is read by GetBusTimeShares from other threads
+    mutable std::mutex RegReaderMutex;
+
     util::TGetNowFn NowFn;
 
-    size_t LowPriorityRateLimit;
+    PPortRateLimiter LowPriorityRateLimiter;
+    TPriorityShares PriorityShares;
+
+    std::atomic<std::chrono::microseconds::rep> DisconnectedDevicesBusTime;
+
+    std::atomic<uint64_t> WrittenCount;
+    std::atomic<uint64_t> SupersededCount;
+
+    //! Earliest time when a write postponed by min_write_interval_ms is allowed
+    std::chrono::steady_clock::time_point NextPostponedWriteTime;
+
+    PDeviceCapabilitiesCache CapabilitiesCache;
+    std::chrono::steady_clock::time_point NextCapabilitiesSaveTime;
 };
 
 typedef std::shared_ptr<TSerialClient> PSerialClient;
@@ -14,6 +14,9 @@ using namespace std::chrono;
 namespace
 {
     const auto MAX_LOW_PRIORITY_LAG = 1s;
+    const auto BUS_TIME_QUANTUM = 100ms;
+    const auto BUS_TIME_SHARES_LOG_INTERVAL = 1min;
+    const auto MIN_PROBE_INTERVAL = 1s;
 
     class TDeviceReader
     {
@@ -24,17 +27,23 @@ namespace
         const util::TSpentTimeMeter& SessionTime;
         TSerialClientDeviceAccessHandler& LastAccessedDevice;
         TDeviceConnectionState InitialConnectionState;
+        const TDeficitRoundRobin<PSerialDevice>* BusTimeSharing;
+        std::vector<PPollableDevice> DeferredDevices;
+        bool ForceNextDevice;
 
     public:
         TDeviceReader(const util::TSpentTimeMeter& sessionTime,
                       milliseconds maxPollTime,
                       bool readAtLeastOneRegister,
-                      TSerialClientDeviceAccessHandler& lastAccessedDevice)
+                      TSerialClientDeviceAccessHandler& lastAccessedDevice,
+                      const TDeficitRoundRobin<PSerialDevice>* busTimeSharing)
             : MaxPollTime(maxPollTime),
               ReadAtLeastOneRegister(readAtLeastOneRegister),
               SessionTime(sessionTime),
               LastAccessedDevice(lastAccessedDevice),
-              InitialConnectionState(TDeviceConnectionState::UNKNOWN)
+              InitialConnectionState(TDeviceConnectionState::UNKNOWN),
+              BusTimeSharing(busTimeSharing),
+              ForceNextDevice(false)
         {}
 
         bool operator()(const PPollableDevice& device, TItemAccumulationPolicy policy, milliseconds pollLimit)
@@ -43,6 +52,16 @@ namespace
                 return false;
             }
 
+            // The device has used up its bus time share, give a chance to other ready devices
+            if (BusTimeSharing && !BusTimeSharing->HasCredit(device->GetDevice())) {
+                DeferredDevices.push_back(device);
+                ForceNextDevice = ForceNextDevice || (policy == TItemAccumulationPolicy::Force);
+                return true;
+            }
+            if (ForceNextDevice) {
+                policy = TItemAccumulationPolicy::Force;
+            }
+
             pollLimit = std::min(MaxPollTime, pollLimit);
             if (policy != TItemAccumulationPolicy::Force) {
                 ReadAtLeastOneRegister = false;
@@ -70,6 +89,17 @@ namespace
         {
             return InitialConnectionState;
         }
+
+        const std::vector<PPollableDevice>& GetDeferredDevices() const
+        {
+            return DeferredDevices;
+        }
+
+        void ClearDeferredDevices()
+        {
+            DeferredDevices.clear();
+            ForceNextDevice = false;
+        }
     };
 
     class TClosedPortDeviceReader
@@ -120,25 +150,37 @@ namespace
     };
 };
 
-TSerialClientRegisterPoller::TSerialClientRegisterPoller(size_t lowPriorityRateLimit)
-    : Scheduler(MAX_LOW_PRIORITY_LAG),
+TSerialClientRegisterPoller::TSerialClientRegisterPoller(PPortRateLimiter lowPriorityRateLimiter,
+                                                         const TPriorityShares& priorityShares)
+    : Scheduler(MAX_LOW_PRIORITY_LAG, priorityShares),
       ThrottlingStateLogger(),
-      LowPriorityRateLimiter(lowPriorityRateLimit)
+      LowPriorityRateLimiter(lowPriorityRateLimiter),
+      BusTimeSharing(BUS_TIME_QUANTUM),
+      BusTimeSharingEnabled(false),
+      DisconnectedDevicesBusTime(microseconds::zero())
 {}
 
 void TSerialClientRegisterPoller::SetDevices(const std::list<PSerialDevice>& devices,
                                              steady_clock::time_point currentTime)
 {
+    // Bus time sharing is enabled if weight is set at least for one device on the port
+    for (const auto& dev: devices) {
+        if (dev->DeviceConfig()->BusTimeWeight > 0) {
+            BusTimeSharingEnabled = true;
+        }
+    }
+    // Avoid reading all registers at once after start
+    auto pollPhases = GetPollPhases(devices);
     for (const auto& dev: devices) {
-        auto pollableDevice = std::make_shared<TPollableDevice>(dev, currentTime, TPriority::High);
-        if (pollableDevice->HasRegisters()) {
-            Scheduler.AddEntry(pollableDevice, currentTime, TPriority::High);
-            Devices.insert({dev, pollableDevice});
+        if (BusTimeSharingEnabled) {
+            BusTimeSharing.SetWeight(dev, dev->DeviceConfig()->BusTimeWeight);
         }
-        pollableDevice = std::make_shared<TPollableDevice>(dev, currentTime, TPriority::Low);
-        if (pollableDevice->HasRegisters()) {
-            Scheduler.AddEntry(pollableDevice, currentTime, TPriority::Low);
-            Devices.insert({dev, pollableDevice});
+        for (auto priority: {TPriority::Alarm, TPriority::High, TPriority::Low}) {
+            auto pollableDevice = std::make_shared<TPollableDevice>(dev, currentTime, priority, pollPhases[dev]);
+            if (pollableDevice->HasRegisters()) {
+                Scheduler.AddEntry(pollableDevice, pollableDevice->GetDeadline(), priority);
+                Devices.insert({dev, pollableDevice});
+            }
         }
     }
 }
@@ -190,7 +232,8 @@ std::chrono::steady_clock::time_point TSerialClientRegisterPoller::GetDeadline(
         auto lowPriorityDeadline = Scheduler.GetLowPriorityDeadline();
         // There are some low priority items
         if (lowPriorityDeadline != std::chrono::steady_clock::time_point::max()) {
-            lowPriorityDeadline = std::max(lowPriorityDeadline, LowPriorityRateLimiter.GetStartTime() + 1s);
+            lowPriorityDeadline =
+                std::max(lowPriorityDeadline, LowPriorityRateLimiter->GetNextItemTime(spentTime.GetStartTime()));
         }
         return std::min(Scheduler.GetHighPriorityDeadline(), lowPriorityDeadline);
     }
@@ -207,14 +250,30 @@ TPollResult TSerialClientRegisterPoller::OpenPortCycle(TPort& port,
 {
     TPollResult res;
 
-    TDeviceReader reader(spentTime, maxPollingTime, readAtLeastOneRegister, lastAccessedDevice);
-
-    bool lowPriorityRateLimitIsExceeded = LowPriorityRateLimiter.IsOverLimit(spentTime.GetStartTime());
-
-    Scheduler.AccumulateNext(spentTime.GetStartTime(),
-                             reader,
-                             lowPriorityRateLimitIsExceeded ? TItemSelectionPolicy::OnlyHighPriority
-                                                            : TItemSelectionPolicy::All);
+    TDeviceReader reader(spentTime,
+                         maxPollingTime,
+                         readAtLeastOneRegister,
+                         lastAccessedDevice,
+                         BusTimeSharingEnabled ? &BusTimeSharing : nullptr);
+
+    bool lowPriorityRateLimitIsExceeded =
+        LowPriorityRateLimiter && LowPriorityRateLimiter->IsOverLimit(spentTime.GetStartTime());
+    const auto selectionPolicy =
+        lowPriorityRateLimitIsExceeded ? TItemSelectionPolicy::OnlyHighPriority : TItemSelectionPolicy::All;
+
+    Scheduler.AccumulateNext(spentTime.GetStartTime(), reader, selectionPolicy);
+    RescheduleDeferredDevices(reader.GetDeferredDevices());
+    if (!reader.GetDevice() && !reader.GetDeferredDevices().empty()) {
+        // All ready devices have used up their bus time shares
+        std::vector<PSerialDevice> waitingDevices;
+        for (const auto& device: reader.GetDeferredDevices()) {
+            waitingDevices.push_back(device->GetDevice());
+        }
+        BusTimeSharing.NextRound(waitingDevices);
+        reader.ClearDeferredDevices();
+        Scheduler.AccumulateNext(spentTime.GetStartTime(), reader, selectionPolicy);
+        RescheduleDeferredDevices(reader.GetDeferredDevices());
+    }
     if (lowPriorityRateLimitIsExceeded) {
         auto throttlingMsg = ThrottlingStateLogger.GetMessage();
         if (!throttlingMsg.empty()) {
@@ -232,8 +291,8 @@ TPollResult TSerialClientRegisterPoller::OpenPortCycle(TPort& port,
     // There are registers waiting read, but they don't fit in allowed poll limit
     if (range->RegisterList().empty()) {
         res.NotEnoughTime = true;
-        if (reader.GetDevice()->GetPriority() == TPriority::High) {
-            // High priority registers are limited by maxPollingTime
+        if (reader.GetDevice()->GetPriority() != TPriority::Low) {
+            // Alarm and high priority registers are limited by maxPollingTime
             res.Deadline = spentTime.GetStartTime() + maxPollingTime;
         } else {
             // Low priority registers are limited by high priority and maxPollingTime
@@ -248,8 +307,8 @@ TPollResult TSerialClientRegisterPoller::OpenPortCycle(TPort& port,
         if (callback) {
             callback(reg);
         }
-        if (reader.GetDevice()->GetPriority() == TPriority::Low) {
-            LowPriorityRateLimiter.NewItem(spentTime.GetStartTime());
+        if (LowPriorityRateLimiter && reader.GetDevice()->GetPriority() == TPriority::Low) {
+            LowPriorityRateLimiter->NewItem(spentTime.GetStartTime());
         }
     }
     ScheduleNextPoll(reader.GetDevice());
@@ -262,12 +321,102 @@ TPollResult TSerialClientRegisterPoller::OpenPortCycle(TPort& port,
             deviceConnectionStateChangedCallback(res.Device);
         }
     }
+    if (res.Device->GetConnectionState() == TDeviceConnectionState::DISCONNECTED) {
+        DisconnectedDevicesBusTime += ceil<microseconds>(spentTime.GetSpentTime());
+    }
+    UpdateProbeSchedule(res.Device, spentTime.GetStartTime());
 
-    Scheduler.UpdateSelectionTime(ceil<milliseconds>(spentTime.GetSpentTime()), reader.GetDevice()->GetPriority());
+    Scheduler.UpdateSelectionTime(spentTime.GetSpentTime(), reader.GetDevice()->GetPriority());
+    UpdateBusTimeShares(res.Device, spentTime);
     res.Deadline = GetDeadline(lowPriorityRateLimitIsExceeded, spentTime);
     return res;
 }
 
+void TSerialClientRegisterPoller::RescheduleDeferredDevices(const std::vector<PPollableDevice>& devices)
+{
+    for (const auto& device: devices) {
+        ScheduleNextPoll(device);
+    }
+}
+
+void TSerialClientRegisterPoller::UpdateBusTimeShares(PSerialDevice device, const util::TSpentTimeMeter& spentTime)
+{
+    BusTimeSharing.Spend(device, spentTime.GetSpentTime());
+    auto now = spentTime.GetStartTime() + spentTime.GetSpentTime();
+    if (BusTimeSharesLogTime == steady_clock::time_point()) {
+        BusTimeSharesLogTime = now;
+        return;
+    }
+    if (now - BusTimeSharesLogTime < BUS_TIME_SHARES_LOG_INTERVAL) {
+        return;
+    }
+    TBusTimeShares shares;
+    // Devices map can contain several entries for the same device, take it once
+    for (auto it = Devices.begin(); it != Devices.end(); it = Devices.upper_bound(it->first)) {
+        auto share = BusTimeSharing.GetShare(it->first);
+        shares.emplace(it->first, share);
+        LOG(Debug) << it->first->ToString() << " bus time share: " << share * 100 << "%";
+    }
+    {
+        std::unique_lock<std::mutex> lock(LastBusTimeSharesMutex);
+        LastBusTimeShares.swap(shares);
+    }
+    BusTimeSharing.ResetShares();
+    BusTimeSharesLogTime = now;
+}
+
+double TSerialClientRegisterPoller::GetBusTimeShare(PSerialDevice device) const
+{
+    std::unique_lock<std::mutex> lock(LastBusTimeSharesMutex);
+    auto it = LastBusTimeShares.find(device);
+    return (it != LastBusTimeShares.end()) ? it->second : 0;
+}
+
+TBusTimeShares TSerialClientRegisterPoller::GetBusTimeShares() const
+{
+    std::unique_lock<std::mutex> lock(LastBusTimeSharesMutex);
+    return LastBusTimeShares;
+}
+
+std::chrono::microseconds TSerialClientRegisterPoller::GetDisconnectedDevicesBusTime() const
+{
+    return DisconnectedDevicesBusTime;
+}
+
+void TSerialClientRegisterPoller::UpdateProbeSchedule(PSerialDevice device,
+                                                      std::chrono::steady_clock::time_point currentTime)
+{
+    auto maxProbeInterval = device->DeviceConfig()->MaxProbeInterval;
+    if (maxProbeInterval.count() <= 0) {
+        return;
+    }
+    auto range = Devices.equal_range(device);
+    if (device->GetConnectionState() != TDeviceConnectionState::DISCONNECTED) {
+        if (ProbeIntervals.erase(device)) {
+            for (auto it = range.first; it != range.second; ++it) {
+                it->second->ResumePolling(currentTime);
+                ScheduleNextPoll(it->second);
+            }
+        }
+        return;
+    }
+
+    // Double probe interval after every failed probe
+    auto probeInterval = ProbeIntervals.find(device);
+    if (probeInterval == ProbeIntervals.end()) {
+        probeInterval =
+            ProbeIntervals.emplace(device, std::min(duration_cast<milliseconds>(MIN_PROBE_INTERVAL), maxProbeInterval))
+                .first;
+    } else {
+        probeInterval->second = std::min(probeInterval->second * 2, maxProbeInterval);
+    }
+    LOG(Debug) << device->ToString() << " is disconnected, next probe in " << probeInterval->second.count() << "ms";
+    for (auto it = range.first; it != range.second; ++it) {
+        it->second->DelayPolling(currentTime + probeInterval->second);
+        ScheduleNextPoll(it->second);
+    }
+}
+
 void TSerialClientRegisterPoller::DeviceDisconnected(PSerialDevice device,
                                                      std::chrono::steady_clock::time_point currentTime)
 {
@@ -1,15 +1,20 @@
 #pragma once
 
 #include <map>
+#include <mutex>
 
 #include "poll_plan.h"
 #include "pollable_device.h"
 #include "port.h"
 #include "serial_client_device_access_handler.h"
+#include "shared_rate_limiter.h"
 
 class TSerialDevice;
 typedef std::shared_ptr<TSerialDevice> PSerialDevice;
 
+//! Parts of the port's bus time used by devices
+typedef std::map<PSerialDevice, double> TBusTimeShares;
+
 struct TPollableDeviceComparePredicate
 {
     bool operator()(const PPollableDevice& d1, const PPollableDevice& d2) const;
@@ -38,7 +43,8 @@ public:
     typedef std::function<void(PRegister reg)> TRegisterCallback;
     typedef std::function<void(PSerialDevice dev)> TDeviceCallback;
 
-    TSerialClientRegisterPoller(size_t lowPriorityRateLimit = std::numeric_limits<size_t>::max());
+    TSerialClientRegisterPoller(PPortRateLimiter lowPriorityRateLimiter = nullptr,
+                                const TPriorityShares& priorityShares = TPriorityShares());
 
     void SetDevices(const std::list<PSerialDevice>& devices, std::chrono::steady_clock::time_point currentTime);
     void ClosedPortCycle(std::chrono::steady_clock::time_point currentTime,
@@ -53,8 +59,28 @@ public:
                               TDeviceCallback deviceConnectionStateChangedCallback);
     void DeviceDisconnected(PSerialDevice device, std::chrono::steady_clock::time_point currentTime);
 
+    /**
+     * @brief Part of the port's bus time used by the device during the last finished accounting interval.
+     *        Can be called from any thread
+     */
+    double GetBusTimeShare(PSerialDevice device) const;
+
+    /**
+     * @brief Bus time shares of all devices during the last finished accounting interval.
+     *        Can be called from any thread
+     */
+    TBusTimeShares GetBusTimeShares() const;
+
+    /**
+     * @brief Bus time spent on reading disconnected devices
+     */
+    std::chrono::microseconds GetDisconnectedDevicesBusTime() const;
+
 private:
     void ScheduleNextPoll(PPollableDevice device);
+    void RescheduleDeferredDevices(const std::vector<PPollableDevice>& devices);
+    void UpdateBusTimeShares(PSerialDevice device, const util::TSpentTimeMeter& spentTime);
+    void UpdateProbeSchedule(PSerialDevice device, std::chrono::steady_clock::time_point currentTime);
     std::chrono::steady_clock::time_point GetDeadline(bool lowPriorityRateLimitIsExceeded,
                                                       const util::TSpentTimeMeter& spentTime) const;
 
@@ -64,5 +90,18 @@ private:
 
     TThrottlingStateLogger ThrottlingStateLogger;
 
-    TRateLimiter LowPriorityRateLimiter;
+    //! Can be nullptr if low priority registers reads are not limited
+    PPortRateLimiter LowPriorityRateLimiter;
+
+    TDeficitRoundRobin<PSerialDevice> BusTimeSharing;
+    bool BusTimeSharingEnabled;
+    std::chrono::steady_clock::time_point BusTimeSharesLogTime;
+
+    //! Shares of the last finished interval, current ones are changed while polling
+    TBusTimeShares LastBusTimeShares;
+    mutable std::mutex LastBusTimeSharesMutex;
+
+    //! Current intervals between probe reads of disconnected devices
+    std::map<PSerialDevice, std::chrono::milliseconds> ProbeIntervals;
+    std::chrono::microseconds DisconnectedDevicesBusTime;
 };
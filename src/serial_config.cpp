@@ -183,6 +183,80 @@ namespace
         return std::make_optional(res);
     }
 
+    std::optional<std::chrono::milliseconds> GetMinWriteInterval(const Json::Value& data)
+    {
+        std::chrono::milliseconds res(0);
+        Get(data, "min_write_interval_ms", res);
+        if (res <= 0ms) {
+            return std::nullopt;
+        }
+        return std::make_optional(res);
+    }
+
+    TPriority ParsePriorityClass(const std::string& name)
+    {
+        if (name == "alarm") {
+            return TPriority::Alarm;
+        }
+        if (name == "control") {
+            return TPriority::High;
+        }
+        if (name == "bulk") {
+            return TPriority::Low;
+        }
+        throw TConfigParserException("invalid priority class: '" + name + "'");
+    }
+
+    std::optional<TPriority> GetPriorityClass(const Json::Value& data)
+    {
+        if (!data.isMember("priority_class")) {
+            return std::nullopt;
+        }
+        return ParsePriorityClass(data["priority_class"].asString());
+    }
+
+    TPriorityClassesConfig LoadPriorityClassesConfig(const Json::Value& data)
+    {
+        TPriorityClassesConfig res;
+        for (auto it = data.begin(); it != data.end(); ++it) {
+            auto priority = ParsePriorityClass(it.name());
+            if (it->isMember("read_period_ms")) {
+                res.ReadPeriods[priority] = std::chrono::milliseconds((*it)["read_period_ms"].asInt());
+            }
+            if (it->isMember("min_share")) {
+                auto share = (*it)["min_share"].asInt() / 100.0;
+                if (priority == TPriority::High) {
+                    res.MinShares.High = share;
+                }
+                if (priority == TPriority::Low) {
+                    res.MinShares.Low = share;
+                }
+            }
+        }
+        if (res.MinShares.High <= 0 || res.MinShares.Low <= 0 || res.MinShares.High + res.MinShares.Low >= 1) {
+            throw TConfigParserException(
+                "min_share of control and bulk priority classes must be positive and their sum must be less than 100");
+        }
+        return res;
+    }
+
+    TModbusTcpServerConfig LoadModbusTcpServerConfig(const Json::Value& data)
+    {
+        TModbusTcpServerConfig res;
+        Get(data, "address", res.Address);
+        res.Port = Read(data, "port", int(res.Port));
+        Get(data, "max_value_age_ms", res.MaxValueAge);
+        res.StaleValueException = Read(data, "stale_value_exception", int(res.StaleValueException));
+        Get(data, "allow_writes", res.AllowWrites);
+        if (data.isMember("unit_id_offsets")) {
+            const auto& offsets = data["unit_id_offsets"];
+            for (auto it = offsets.begin(); it != offsets.end(); ++it) {
+                res.UnitIdOffsets[it.name()] = it->asInt();
+            }
+        }
+        return res;
+    }
+
     struct TLoadingContext
     {
         // Full path to loaded item composed from device and channels names
@@ -285,6 +359,8 @@ namespace
 
         res.RegisterConfig->ReadRateLimit = GetReadRateLimit(register_data);
         res.RegisterConfig->ReadPeriod = GetReadPeriod(register_data);
+        res.RegisterConfig->PriorityClass = GetPriorityClass(register_data);
+        res.RegisterConfig->MinWriteInterval = GetMinWriteInterval(register_data);
         return res;
     }
 
@@ -372,12 +448,16 @@ namespace
 
             auto read_rate_limit_ms = GetReadRateLimit(channel_data);
             auto read_period = GetReadPeriod(channel_data);
+            auto priority_class = GetPriorityClass(channel_data);
+            auto min_write_interval = GetMinWriteInterval(channel_data);
 
             const Json::Value& reg_data = channel_data["consists_of"];
             for (Json::ArrayIndex i = 0; i < reg_data.size(); ++i) {
                 auto reg = LoadRegisterConfig(reg_data[i], *device_config, errorMsgPrefix, context);
                 reg.RegisterConfig->ReadRateLimit = read_rate_limit_ms;
                 reg.RegisterConfig->ReadPeriod = read_period;
+                reg.RegisterConfig->PriorityClass = priority_class;
+                reg.RegisterConfig->MinWriteInterval = min_write_interval;
                 registers.push_back(reg.RegisterConfig);
                 if (!i)
                     default_type_str = reg.DefaultControlType;
@@ -583,6 +663,9 @@ namespace
         Get(device_data, "shift", device_config->Shift);
         Get(device_data, "access_level", device_config->AccessLevel);
         Get(device_data, "min_request_interval", device_config->MinRequestInterval);
+        Get(device_data, "bus_time_weight", device_config->BusTimeWeight);
+        Get(device_data, "poll_lookahead_ms", device_config->PollLookahead);
+        Get(device_data, "max_probe_interval_ms", device_config->MaxProbeInterval);
 
         if (device_data.isMember("channels")) {
             for (const auto& channel_data: device_data["channels"]) {
@@ -614,6 +697,7 @@ namespace
 
         Get(port_data, "data_bits", settings.DataBits);
         Get(port_data, "stop_bits", settings.StopBits);
+        Get(port_data, "adaptive_timing", settings.AdaptiveTiming);
 
         PPort port = std::make_shared<TSerialPort>(settings);
 
@@ -649,11 +733,20 @@ namespace
         Get(port_data, "response_timeout_ms", port_config->ResponseTimeout);
         Get(port_data, "guard_interval_us", port_config->RequestDelay);
         port_config->ReadRateLimit = GetReadRateLimit(port_data);
+        if (port_data.isMember("min_rate_limit")) {
+            port_config->MinRateLimit = port_data["min_rate_limit"].asUInt();
+        }
+        Get(port_data, "poll_lookahead_ms", port_config->PollLookahead);
+        Get(port_data, "max_probe_interval_ms", port_config->MaxProbeInterval);
+        if (port_data.isMember("priority_classes")) {
+            port_config->PriorityClasses = LoadPriorityClassesConfig(port_data["priority_classes"]);
+        }
 
         auto port_type = port_data.get("port_type", "serial").asString();
 
         Get(port_data, "connection_timeout_ms", port_config->OpenCloseSettings.MaxFailTime);
         Get(port_data, "connection_max_fail_cycles", port_config->OpenCloseSettings.ConnectionMaxFailCycles);
+        Get(port_data, "max_pipelined_requests", port_config->MaxPipelinedRequests);
 
         std::tie(port_config->Port, port_config->IsModbusTcp) = portFactory(port_data, rpcConfig);
 
@@ -765,6 +858,12 @@ PHandlerConfig LoadConfig(const std::string& configFileName,
     }
     handlerConfig->PublishParameters.Set(maxUnchangedInterval.count());
 
+    Get(Root, "tcp_port_threads", handlerConfig->TcpPortThreads);
+
+    if (Root.isMember("modbus_tcp_server")) {
+        handlerConfig->ModbusTcpServer = LoadModbusTcpServerConfig(Root["modbus_tcp_server"]);
+    }
+
     const Json::Value& array = Root["ports"];
     for (Json::Value::ArrayIndex index = 0; index < array.size(); ++index) {
         // old default prefix for compat
@@ -933,6 +1032,36 @@ void THandlerConfig::AddPortConfig(PPortConfig portConfig)
     PortConfigs.push_back(portConfig);
 }
 
+size_t THandlerConfig::GetMinLowPriorityRegistersRateLimit(const TPortConfig& portConfig) const
+{
+    if (portConfig.MinRateLimit) {
+        return *portConfig.MinRateLimit;
+    }
+
+    auto getChannelsCount = [](const TPortConfig& portConfig) {
+        size_t res = 0;
+        for (const auto& device: portConfig.Devices) {
+            res += device->DeviceConfig()->DeviceChannelConfigs.size();
+        }
+        return res;
+    };
+
+    size_t totalChannels = 0;
+    for (const auto& config: PortConfigs) {
+        totalChannels += getChannelsCount(*config);
+    }
+
+    auto rateLimit = LowPriorityRegistersRateLimit;
+    if (totalChannels != 0) {
+        rateLimit *= getChannelsCount(portConfig);
+        rateLimit /= totalChannels;
+    }
+    if (rateLimit < 1) {
+        rateLimit = 1;
+    }
+    return rateLimit;
+}
+
 TConfigParserException::TConfigParserException(const std::string& message)
     : std::runtime_error("Error parsing config file: " + message)
 {}
@@ -1028,6 +1157,10 @@ PSerialDevice TSerialDeviceFactory::CreateDevice(const Json::Value& deviceConfig
     params.DefaultRequestDelay = portConfig->RequestDelay;
     params.PortResponseTimeout = portConfig->ResponseTimeout;
     params.DefaultReadRateLimit = portConfig->ReadRateLimit;
+    params.PriorityReadPeriods = portConfig->PriorityClasses.ReadPeriods;
+    params.DefaultPollLookahead = portConfig->PollLookahead;
+    params.DefaultMaxProbeInterval = portConfig->MaxProbeInterval;
+    params.MaxPipelinedRequests = portConfig->MaxPipelinedRequests;
     auto baseDeviceConfig = LoadBaseDeviceConfig(*cfg, protocol, deviceFactory, params);
 
     return deviceFactory.CreateDevice(*cfg, baseDeviceConfig, portConfig->Port, protocol);
@@ -1105,6 +1238,16 @@ PDeviceConfig LoadBaseDeviceConfig(const Json::Value& dev,
         res->ResponseTimeout = DefaultResponseTimeout;
     }
 
+    if (res->PollLookahead.count() < 0) {
+        res->PollLookahead = parameters.DefaultPollLookahead;
+    }
+
+    if (res->MaxProbeInterval.count() < 0) {
+        res->MaxProbeInterval = parameters.DefaultMaxProbeInterval;
+    }
+
+    res->MaxPipelinedRequests = parameters.MaxPipelinedRequests;
+
     auto read_rate_limit_ms = GetReadRateLimit(dev);
     if (!read_rate_limit_ms) {
         read_rate_limit_ms = parameters.DefaultReadRateLimit;
@@ -1114,6 +1257,12 @@ PDeviceConfig LoadBaseDeviceConfig(const Json::Value& dev,
             if (!reg->ReadRateLimit) {
                 reg->ReadRateLimit = read_rate_limit_ms;
             }
+            if (reg->PriorityClass && !reg->ReadPeriod) {
+                auto readPeriod = parameters.PriorityReadPeriods.find(*reg->PriorityClass);
+                if (readPeriod != parameters.PriorityReadPeriods.end()) {
+                    reg->ReadPeriod = readPeriod->second;
+                }
+            }
         }
     }
 
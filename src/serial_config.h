@@ -1,6 +1,7 @@
 #pragma once
 
 #include <exception>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -12,11 +13,21 @@
 #include <wblib/json_utils.h>
 
 #include "confed_schemas_map.h"
+#include "modbus_tcp_server.h"
 #include "port.h"
 #include "rpc_config.h"
 #include "serial_device.h"
 #include "templates_map.h"
 
+struct TPriorityClassesConfig
+{
+    //! Read periods for channels with explicitly set priority class and without read_period_ms
+    std::map<TPriority, std::chrono::milliseconds> ReadPeriods = {{TPriority::Alarm, std::chrono::milliseconds(100)},
+                                                                  {TPriority::High, std::chrono::milliseconds(1000)}};
+
+    TPriorityShares MinShares;
+};
+
 struct TPortConfig
 {
     PPort Port;
@@ -34,6 +45,20 @@ struct TPortConfig
 
     bool IsModbusTcp = false;
 
+    TPriorityClassesConfig PriorityClasses;
+
+    //! Guaranteed part of global low priority registers rate limit
+    std::optional<size_t> MinRateLimit;
+
+    //! Default poll look-ahead interval for devices of the port
+    std::chrono::milliseconds PollLookahead = std::chrono::milliseconds::zero();
+
+    //! Default maximum interval between probe reads of disconnected devices of the port
+    std::chrono::milliseconds MaxProbeInterval = std::chrono::milliseconds::zero();
+
+    //! Maximum number of requests sent to a Modbus TCP device before reading responses
+    int MaxPipelinedRequests = 1;
+
     void AddDevice(PSerialDevice device);
 };
 
@@ -46,7 +71,20 @@ struct THandlerConfig
     size_t LowPriorityRegistersRateLimit;
     std::vector<PPortConfig> PortConfigs;
 
+    //! Settings of embedded Modbus TCP server, it is disabled if not set
+    std::optional<TModbusTcpServerConfig> ModbusTcpServer;
+
+    //! Number of threads serving all TCP ports together, 0 - each port has its own thread
+    size_t TcpPortThreads = 0;
+
     void AddPortConfig(PPortConfig portConfig);
+
+    /**
+     * @brief Part of LowPriorityRegistersRateLimit guaranteed to the port.
+     *        If it is not set in port's config,
+     *        the limit is divided between ports proportionally to their channels count.
+     */
+    size_t GetMinLowPriorityRegistersRateLimit(const TPortConfig& portConfig) const;
 };
 
 typedef std::shared_ptr<THandlerConfig> PHandlerConfig;
@@ -155,6 +193,10 @@ struct TDeviceConfigLoadParams
     std::chrono::microseconds DefaultRequestDelay;
     std::chrono::milliseconds PortResponseTimeout;
     std::optional<std::chrono::milliseconds> DefaultReadRateLimit;
+    std::map<TPriority, std::chrono::milliseconds> PriorityReadPeriods;
+    std::chrono::milliseconds DefaultPollLookahead = std::chrono::milliseconds::zero();
+    std::chrono::milliseconds DefaultMaxProbeInterval = std::chrono::milliseconds::zero();
+    int MaxPipelinedRequests = 1;
     std::string DeviceTemplateTitle;
     const Json::Value* Translations = nullptr;
 };
@@ -75,6 +75,15 @@ void TSerialDevice::Prepare()
     try {
         PrepareImpl();
         if (deviceWasDisconnected) {
+            auto signature = ReadSignature();
+            if (!Signature.empty() && signature != Signature) {
+                LOG(Info) << "device " << ToString() << " signature is changed from '" << Signature << "' to '"
+                          << signature << "', learned capabilities are dropped";
+                TDeviceCapabilities capabilities;
+                capabilities.Signature = signature;
+                SetCapabilities(capabilities);
+            }
+            Signature = signature;
             WriteSetupRegisters();
         }
     } catch (const TSerialDeviceException& ex) {
@@ -83,6 +92,36 @@ void TSerialDevice::Prepare()
     }
 }
 
+std::string TSerialDevice::ReadSignature()
+{
+    return std::string();
+}
+
+TDeviceCapabilities TSerialDevice::GetCapabilities() const
+{
+    TDeviceCapabilities res;
+    res.Signature = Signature;
+    res.SupportsHoles = SupportsHoles;
+    res.SingleWriteTypes = SingleWriteTypes;
+    for (const auto& reg: Registers) {
+        if (reg->GetAvailable() != TRegisterAvailability::UNKNOWN) {
+            res.Registers.emplace(reg->TRegisterConfig::ToString(), reg->GetAvailable());
+        }
+    }
+    return res;
+}
+
+void TSerialDevice::SetCapabilities(const TDeviceCapabilities& capabilities)
+{
+    Signature = capabilities.Signature;
+    SupportsHoles = capabilities.SupportsHoles;
+    SingleWriteTypes = capabilities.SingleWriteTypes;
+    for (const auto& reg: Registers) {
+        auto it = capabilities.Registers.find(reg->TRegisterConfig::ToString());
+        reg->SetAvailable((it != capabilities.Registers.end()) ? it->second : TRegisterAvailability::UNKNOWN);
+    }
+}
+
 void TSerialDevice::PrepareImpl()
 {
     Port()->SleepSinceLastInteraction(DeviceConfig()->FrameTimeout);
@@ -113,6 +152,24 @@ void TSerialDevice::WriteRegister(PRegister reg, uint64_t value)
     WriteRegister(reg, TRegisterValue{value});
 }
 
+void TSerialDevice::WriteRegisters(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten)
+{
+    WriteRegistersImpl(writes, [this, &onWritten](const TRegisterWrite& write) {
+        if (!write.Error) {
+            SetTransferResult(true);
+        } else {
+            try {
+                std::rethrow_exception(write.Error);
+            } catch (const TSerialDevicePermanentRegisterException& e) {
+                SetTransferResult(true);
+            } catch (const TSerialDeviceException& ex) {
+                SetTransferResult(false);
+            }
+        }
+        onWritten(write);
+    });
+}
+
 TRegisterValue TSerialDevice::ReadRegisterImpl(PRegister reg)
 {
     throw TSerialDeviceException("single register reading is not supported");
@@ -123,6 +180,18 @@ void TSerialDevice::WriteRegisterImpl(PRegister reg, const TRegisterValue& value
     throw TSerialDeviceException(ToString() + ": register writing is not supported");
 }
 
+void TSerialDevice::WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten)
+{
+    for (auto& write: writes) {
+        try {
+            WriteRegisterImpl(write.Register, write.Value);
+        } catch (const TSerialDeviceException& e) {
+            write.Error = std::current_exception();
+        }
+        onWritten(write);
+    }
+}
+
 void TSerialDevice::ReadRegisterRange(PRegisterRange range)
 {
     for (auto& reg: range->RegisterList()) {
@@ -245,10 +314,25 @@ void TSerialDevice::SetSupportsHoles(bool supportsHoles)
     SupportsHoles = supportsHoles;
 }
 
+bool TSerialDevice::GetSupportsWriteTogether(int registerType) const
+{
+    return SingleWriteTypes.count(registerType) == 0;
+}
+
+void TSerialDevice::SetSupportsWriteTogether(int registerType, bool supportsWriteTogether)
+{
+    if (supportsWriteTogether) {
+        SingleWriteTypes.erase(registerType);
+    } else {
+        SingleWriteTypes.insert(registerType);
+    }
+}
+
 void TSerialDevice::SetDisconnected()
 {
     ConnectionState = TDeviceConnectionState::DISCONNECTED;
     SetSupportsHoles(true);
+    SingleWriteTypes.clear();
     LOG(Warn) << "device " << ToString() << " is disconnected";
 }
 
@@ -2,8 +2,10 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <map>
 #include <memory>
 #include <set>
 #include <stdint.h>
@@ -112,6 +114,25 @@ struct TDeviceConfig
     //! Minimal time between two consecutive requests to the device.
     std::chrono::milliseconds MinRequestInterval = std::chrono::milliseconds::zero();
 
+    //! Relative share of port bus time for the device. 0 - not set
+    int BusTimeWeight = 0;
+
+    /**
+     * @brief Registers due within the interval are read ahead of time
+     *        if they fit into the request being built for already ready registers.
+     *        -1 if not set, port's value will be used.
+     */
+    std::chrono::milliseconds PollLookahead = std::chrono::milliseconds(-1);
+
+    /**
+     * @brief Maximum interval between probe reads of disconnected device.
+     *        0 - disconnected device is polled as usual, -1 if not set, port's value will be used.
+     */
+    std::chrono::milliseconds MaxProbeInterval = std::chrono::milliseconds(-1);
+
+    //! Maximum number of requests sent to the device before reading responses, set by port's config
+    int MaxPipelinedRequests = 1;
+
     std::chrono::seconds MaxWriteFailTime = DefaultMaxWriteFailTime;
 
     int AccessLevel = DEFAULT_ACCESS_LEVEL;
@@ -171,6 +192,48 @@ struct TUInt32SlaveId
     bool operator==(const TUInt32SlaveId& id) const;
 };
 
+//! Read request limits learned for a register type
+struct TLearnedReadLimits
+{
+    size_t AcceptedLength;
+    size_t RejectedLength;
+    size_t AcceptedHole;
+    size_t RejectedHole;
+};
+
+//! Device capabilities learned by polling, they are kept between restarts
+struct TDeviceCapabilities
+{
+    //! Identifies device firmware, capabilities are learned again if it is changed
+    std::string Signature;
+
+    bool SupportsHoles = true;
+
+    //! Register types the device can't write by one request for several registers
+    std::set<int> SingleWriteTypes;
+
+    //! Availability of registers by TRegisterConfig::ToString(), registers with unknown availability are omitted
+    std::map<std::string, TRegisterAvailability> Registers;
+
+    //! By register type
+    std::map<int, TLearnedReadLimits> ReadLimits;
+
+    //! Addresses read requests must not cross, by register type
+    std::map<int, std::set<uint32_t>> ReadSplits;
+};
+
+//! Pending write of a register value
+struct TRegisterWrite
+{
+    PRegister Register;
+    TRegisterValue Value;
+
+    //! Set if writing failed, holds TSerialDeviceException
+    std::exception_ptr Error;
+};
+
+typedef std::function<void(const TRegisterWrite& write)> TRegisterWrittenFn;
+
 enum class TDeviceConnectionState
 {
     UNKNOWN,
@@ -203,6 +266,14 @@ public:
 
     void WriteRegister(PRegister reg, uint64_t value);
 
+    /**
+     * @brief Write several registers of the device.
+     *        A device can combine them into fewer requests, but errors are still reported per register.
+     *        onWritten is called for every element of writes in the original order
+     *        right after its request is finished.
+     */
+    void WriteRegisters(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten);
+
     // Read multiple registers
     virtual void ReadRegisterRange(PRegisterRange range);
 
@@ -220,6 +291,8 @@ public:
     void SetDisconnected();
     bool GetSupportsHoles() const;
     void SetSupportsHoles(bool supportsHoles);
+    bool GetSupportsWriteTogether(int registerType) const;
+    void SetSupportsWriteTogether(int registerType, bool supportsWriteTogether);
 
     // Reset values caches
     virtual void InvalidateReadCache();
@@ -231,12 +304,26 @@ public:
     std::chrono::steady_clock::time_point GetLastReadTime() const;
     void SetLastReadTime(std::chrono::steady_clock::time_point readTime);
 
+    virtual TDeviceCapabilities GetCapabilities() const;
+
+    //! Registers missing in capabilities get unknown availability
+    virtual void SetCapabilities(const TDeviceCapabilities& capabilities);
+
 protected:
     std::vector<PDeviceSetupItem> SetupItems;
 
+    /**
+     * @brief Read a value identifying device firmware. Called on connection.
+     *        Empty string if the device doesn't provide it.
+     */
+    virtual std::string ReadSignature();
+
     virtual void PrepareImpl();
     virtual TRegisterValue ReadRegisterImpl(PRegister reg);
     virtual void WriteRegisterImpl(PRegister reg, const TRegisterValue& value);
+
+    //! Writes registers one by one by default
+    virtual void WriteRegistersImpl(std::vector<TRegisterWrite>& writes, const TRegisterWrittenFn& onWritten);
     virtual void WriteSetupRegisters();
 
 private:
@@ -247,6 +334,8 @@ private:
     TDeviceConnectionState ConnectionState;
     int RemainingFailCycles;
     bool SupportsHoles;
+    std::set<int> SingleWriteTypes;
+    std::string Signature;
     std::list<PRegister> Registers;
     std::chrono::steady_clock::time_point LastReadTime;
 };
@@ -1,53 +1,47 @@
 #include "serial_driver.h"
 #include "log.h"
+#include "tcp_port.h"
 
 #include <wblib/driver.h>
 
+#include <algorithm>
+#include <csignal>
 #include <iostream>
 #include <thread>
+#include <unistd.h>
 
 using namespace std;
 using namespace WBMQTT;
 
 #define LOG(logger) ::logger.Log() << "[serial] "
 
-namespace
+TMQTTSerialDriver::TMQTTSerialDriver(PDeviceDriver mqttDriver,
+                                     PHandlerConfig config,
+                                     PDeviceCapabilitiesCache capabilitiesCache)
+    : RateLimiter(make_shared<TSharedRateLimiter>(config->LowPriorityRegistersRateLimit)),
+      Active(false)
 {
-    size_t GetChannelsCount(PPortConfig portConfig)
-    {
-        size_t res = 0;
-        for (const auto& device: portConfig->Devices) {
-            res += device->DeviceConfig()->DeviceChannelConfigs.size();
-        }
-        return res;
+    if (config->ModbusTcpServer) {
+        ModbusTcpServer = make_shared<TModbusTcpServer>(*config->ModbusTcpServer);
     }
-
-    size_t GetChannelsCount(PHandlerConfig config)
-    {
-        size_t res = 0;
-        for (const auto& portConfig: config->PortConfigs) {
-            res += GetChannelsCount(portConfig);
-        }
-        return res;
-    }
-}
-
-TMQTTSerialDriver::TMQTTSerialDriver(PDeviceDriver mqttDriver, PHandlerConfig config): Active(false)
-{
     try {
-        size_t totalChannels = GetChannelsCount(config);
         for (const auto& portConfig: config->PortConfigs) {
-            auto rateLimit = config->LowPriorityRegistersRateLimit;
-            if (totalChannels != 0) {
-                rateLimit *= GetChannelsCount(portConfig);
-                rateLimit /= totalChannels;
-            }
-            if (rateLimit < 1) {
-                rateLimit = 1;
-            }
+            auto portRateLimiter = RateLimiter->AddPort(portConfig->Port->GetDescription(false),
+                                                        config->GetMinLowPriorityRegistersRateLimit(*portConfig));
             PortDrivers.push_back(
-                make_shared<TSerialPortDriver>(mqttDriver, portConfig, config->PublishParameters, rateLimit));
+                make_shared<TSerialPortDriver>(mqttDriver,
+                                               portConfig,
+                                               config->PublishParameters,
+                                               portRateLimiter,
+                                               capabilitiesCache,
+                                               ModbusTcpServer));
             PortDrivers.back()->SetUpDevices();
+            if (config->TcpPortThreads > 0 && dynamic_cast<TTcpPort*>(portConfig->Port.get())) {
+                ReactorPortDrivers.push_back(PortDrivers.back());
+            }
+        }
+        for (size_t i = 0; i < std::min(config->TcpPortThreads, ReactorPortDrivers.size()); ++i) {
+            Reactors.push_back(make_shared<TPortReactor>("tcp ports " + std::to_string(i)));
         }
     } catch (const exception& e) {
         LOG(Error) << "unable to create port driver: '" << e.what() << "'. Cleaning.";
@@ -86,7 +80,20 @@ void TMQTTSerialDriver::Start()
         Active = true;
     }
 
+    if (ModbusTcpServer) {
+        try {
+            ModbusTcpServer->Start();
+        } catch (const std::exception& e) {
+            LOG(Error) << "unable to start Modbus TCP server: " << e.what();
+        }
+    }
+
+    size_t reactorIndex = 0;
     for (const auto& portDriver: PortDrivers) {
+        if (std::find(ReactorPortDrivers.begin(), ReactorPortDrivers.end(), portDriver) != ReactorPortDrivers.end()) {
+            Reactors[reactorIndex++ % Reactors.size()]->AddLoop([portDriver] { portDriver->Cycle(); });
+            continue;
+        }
         PortLoops.emplace_back([&] {
             WBMQTT::SetThreadName(portDriver->GetShortDescription());
             while (Active) {
@@ -94,6 +101,20 @@ void TMQTTSerialDriver::Start()
             }
         });
     }
+
+    if (!Reactors.empty()) {
+        LOG(Info) << ReactorPortDrivers.size() << " TCP port(s) are served by " << Reactors.size() << " thread(s)";
+    }
+    for (const auto& reactor: Reactors) {
+        PortLoops.emplace_back([reactor] {
+            WBMQTT::SetThreadName(reactor->GetName());
+            if (!reactor->Run()) {
+                // Stop the driver the same way as by a signal, so learned data is saved and ports are closed
+                LOG(Error) << reactor->GetName() << " failed, stopping the driver";
+                kill(getpid(), SIGTERM);
+            }
+        });
+    }
 }
 
 void TMQTTSerialDriver::Stop()
@@ -107,12 +128,24 @@ void TMQTTSerialDriver::Stop()
         Active = false;
     }
 
+    for (const auto& reactor: Reactors) {
+        reactor->Stop();
+    }
+
     for (auto& loopThread: PortLoops) {
         if (loopThread.joinable()) {
             loopThread.join();
         }
     }
 
+    if (ModbusTcpServer) {
+        ModbusTcpServer->Stop();
+    }
+
+    for (const auto& portDriver: PortDrivers) {
+        portDriver->GetSerialClient()->SaveCapabilities();
+    }
+
     ClearDevices();
 }
 
@@ -120,3 +153,8 @@ std::vector<PSerialPortDriver> TMQTTSerialDriver::GetPortDrivers()
 {
     return PortDrivers;
 }
+
+PSharedRateLimiter TMQTTSerialDriver::GetRateLimiter()
+{
+    return RateLimiter;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "port_reactor.h"
 #include "serial_config.h"
 #include "serial_port_driver.h"
 
@@ -9,7 +10,9 @@
 class TMQTTSerialDriver
 {
 public:
-    TMQTTSerialDriver(WBMQTT::PDeviceDriver mqtt_driver, PHandlerConfig handler_config);
+    TMQTTSerialDriver(WBMQTT::PDeviceDriver mqtt_driver,
+                      PHandlerConfig handler_config,
+                      PDeviceCapabilitiesCache capabilitiesCache = nullptr);
     void LoopOnce();
     void ClearDevices();
 
@@ -17,10 +20,17 @@ public:
     void Stop();
 
     std::vector<PSerialPortDriver> GetPortDrivers();
+    PSharedRateLimiter GetRateLimiter();
 
 private:
+    PSharedRateLimiter RateLimiter;
+    PModbusTcpServer ModbusTcpServer;
     std::vector<PSerialPortDriver> PortDrivers;
     std::vector<std::thread> PortLoops;
+
+    //! Reactors serving TCP ports if tcp_port_threads is set
+    std::vector<PPortReactor> Reactors;
+    std::vector<PSerialPortDriver> ReactorPortDrivers;
     std::mutex ActiveMutex;
     bool Active;
 };
@@ -1,8 +1,10 @@
 #include "serial_port.h"
 #include "iec_common.h"
 #include "log.h"
+#include "port_reactor.h"
 #include "serial_exc.h"
 
+#include <algorithm>
 #include <cmath>
 #include <fcntl.h>
 #include <filesystem>
@@ -70,6 +72,9 @@ namespace
         }
     }
 
+    // Transmit must complete in twice estimated time, the margin covers USB adapters' latency
+    const std::chrono::milliseconds TRANSMIT_TIMEOUT_MARGIN(100);
+
     std::chrono::milliseconds GetLinuxLag(int baudRate)
     {
         return std::chrono::milliseconds(baudRate < 9600 ? 34 : 24);
@@ -151,7 +156,9 @@ namespace
 TSerialPort::TSerialPort(const TSerialPortSettings& settings)
     : Settings(settings),
       InitialSettings(settings),
-      RxTrigBytes(GetRxTrigBytes(Settings.Device))
+      RxTrigBytes(GetRxTrigBytes(Settings.Device)),
+      OutputQueueSupported(true),
+      LineStatusSupported(true)
 {
     memset(&OldTermios, 0, sizeof(termios));
 }
@@ -203,6 +210,7 @@ void TSerialPort::ApplySerialPortSettings(const TSerialPortConnectionSettings& s
     if (tcflush(Fd, TCIOFLUSH) != 0) {
         throw std::runtime_error("can't flush port" + FormatErrno(errno));
     }
+    ClearRxBuffer();
 
     Settings.Set(settings);
     LOG(Debug) << "Setup " << Settings.Device << " port: " << settings.BaudRate << " " << settings.DataBits << " "
@@ -230,9 +238,63 @@ std::chrono::microseconds TSerialPort::GetSendTimeBits(size_t bitsNumber) const
     return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(us));
 }
 
+bool TSerialPort::IsTimingCalibrated() const
+{
+    if (!Settings.AdaptiveTiming) {
+        return false;
+    }
+    auto it = Timings.find(Settings.BaudRate);
+    return (it != Timings.end()) && it->second.IsCalibrated();
+}
+
+std::chrono::microseconds TSerialPort::GetResponseLag() const
+{
+    std::chrono::microseconds lag = GetLinuxLag(Settings.BaudRate);
+    if (IsTimingCalibrated()) {
+        lag = std::min(lag, Timings.at(Settings.BaudRate).GetDriverLatency());
+    }
+    return lag;
+}
+
+std::chrono::microseconds TSerialPort::GetFrameLag() const
+{
+    std::chrono::microseconds lag = std::chrono::milliseconds(15) + GetSendTimeBytes(RxTrigBytes);
+    if (IsTimingCalibrated()) {
+        lag = std::min(lag, Timings.at(Settings.BaudRate).GetFrameGap());
+    }
+    return lag;
+}
+
+void TSerialPort::OnFramePartReceived(size_t size, const std::chrono::microseconds& gap)
+{
+    if (!Settings.AdaptiveTiming) {
+        return;
+    }
+    auto& timing = Timings[Settings.BaudRate];
+    auto wasCalibrated = timing.IsCalibrated();
+    timing.AddFramePart(gap, GetSendTimeBytes(size));
+    if (!wasCalibrated && timing.IsCalibrated()) {
+        LOG(Info) << Settings.Device << " timing is calibrated for " << Settings.BaudRate
+                  << " baud: response lag " << GetResponseLag().count() << " us, frame lag "
+                  << GetFrameLag().count() << " us";
+    }
+}
+
+void TSerialPort::ReportFrameError()
+{
+    if (!Settings.AdaptiveTiming) {
+        return;
+    }
+    auto& timing = Timings[Settings.BaudRate];
+    if (timing.IsCalibrated()) {
+        LOG(Warn) << Settings.Device << " framing error, fall back to fixed timing until recalibration";
+    }
+    timing.Reset();
+}
+
 uint8_t TSerialPort::ReadByte(const std::chrono::microseconds& timeout)
 {
-    return Base::ReadByte(timeout + GetLinuxLag(Settings.BaudRate));
+    return Base::ReadByte(timeout + GetResponseLag());
 }
 
 TReadFrameResult TSerialPort::ReadFrame(uint8_t* buf,
@@ -243,18 +305,84 @@ TReadFrameResult TSerialPort::ReadFrame(uint8_t* buf,
 {
     return Base::ReadFrame(buf,
                            count,
-                           responseTimeout + GetLinuxLag(Settings.BaudRate) + GetSendTimeBytes(RxTrigBytes),
-                           frameTimeout + std::chrono::milliseconds(15) + GetSendTimeBytes(RxTrigBytes),
+                           responseTimeout + GetResponseLag() + GetSendTimeBytes(RxTrigBytes),
+                           frameTimeout + GetFrameLag(),
                            frameComplete);
 }
 
 void TSerialPort::WriteBytes(const uint8_t* buf, int count)
 {
     Base::WriteBytes(buf, count);
-    SleepSinceLastInteraction(GetSendTimeBytes(count));
+    auto estimatedTime = GetSendTimeBytes(count);
+    if (!WaitForTransmitCompletion(estimatedTime)) {
+        SleepSinceLastInteraction(estimatedTime);
+    }
     LastInteraction = std::chrono::steady_clock::now();
 }
 
+bool TSerialPort::WaitForTransmitCompletion(const std::chrono::microseconds& estimatedTime)
+{
+    if (!OutputQueueSupported) {
+        return false;
+    }
+    // LastInteraction is set right after write
+    auto start = LastInteraction;
+    auto deadline = start + 2 * estimatedTime + TRANSMIT_TIMEOUT_MARGIN;
+    bool timeout = false;
+    while (true) {
+        int queued = 0;
+        if (ioctl(Fd, TIOCOUTQ, &queued) != 0) {
+            LOG(Debug) << Settings.Device << " doesn't report output queue size, transmit time is estimated";
+            OutputQueueSupported = false;
+            return false;
+        }
+        // Empty output queue doesn't mean that UART's FIFO and shift register are empty
+        if (queued == 0 && LineStatusSupported) {
+            unsigned int lsr = 0;
+            if (ioctl(Fd, TIOCSERGETLSR, &lsr) != 0) {
+                LineStatusSupported = false;
+            } else if (!(lsr & TIOCSER_TEMT)) {
+                queued = 1;
+            }
+        }
+        if (queued == 0) {
+            break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            timeout = true;
+            break;
+        }
+        auto deadlineDelay = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+        SleepFor(std::min(GetSendTimeBytes(queued), deadlineDelay));
+    }
+    if (!LineStatusSupported) {
+        // Without line status empty output queue can mean that bytes are still in adapter's buffers,
+        // but transmit can't be faster than baud rate allows
+        SleepSinceLastInteraction(estimatedTime);
+    }
+
+    auto actualTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (timeout) {
+        LOG(Debug) << Settings.Device << " transmit isn't completed in " << actualTime.count() << " us";
+    }
+    std::unique_lock<std::mutex> lock(TransmitStatsMutex);
+    ++TransmitStats.Writes;
+    if (timeout) {
+        ++TransmitStats.Timeouts;
+    }
+    TransmitStats.EstimatedTime += estimatedTime;
+    TransmitStats.ActualTime += actualTime;
+    TransmitStats.MaxExcess = std::max(TransmitStats.MaxExcess, actualTime - estimatedTime);
+    return true;
+}
+
+TSerialPort::TTransmitStats TSerialPort::GetTransmitStats() const
+{
+    std::unique_lock<std::mutex> lock(TransmitStatsMutex);
+    return TransmitStats;
+}
+
 std::string TSerialPort::GetDescription(bool verbose) const
 {
     if (verbose) {
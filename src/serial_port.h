@@ -1,15 +1,36 @@
 #pragma once
 #include <chrono>
+#include <mutex>
 #include <termios.h>
+#include <unordered_map>
 
 #include "file_descriptor_port.h"
 #include "serial_port_settings.h"
+#include "serial_port_timing.h"
 
 class TSerialPort: public TFileDescriptorPort
 {
     using Base = TFileDescriptorPort;
 
 public:
+    struct TTransmitStats
+    {
+        //! Writes with transmit completion tracked by the driver
+        uint64_t Writes = 0;
+
+        //! Writes not completed during maximum waiting time
+        uint64_t Timeouts = 0;
+
+        //! Total transmit time calculated from baud rate
+        std::chrono::microseconds EstimatedTime = std::chrono::microseconds::zero();
+
+        //! Total time from write to transmitter empty
+        std::chrono::microseconds ActualTime = std::chrono::microseconds::zero();
+
+        //! Maximum excess of actual transmit time over estimated one
+        std::chrono::microseconds MaxExcess = std::chrono::microseconds::zero();
+    };
+
     TSerialPort(const TSerialPortSettings& settings);
     ~TSerialPort() = default;
 
@@ -36,11 +57,39 @@ public:
 
     const TSerialPortSettings& GetSettings() const;
 
+    void ReportFrameError() override;
+
+    //! Can be called from any thread
+    TTransmitStats GetTransmitStats() const;
+
+protected:
+    void OnFramePartReceived(size_t size, const std::chrono::microseconds& gap) override;
+
 private:
+    bool IsTimingCalibrated() const;
+    std::chrono::microseconds GetResponseLag() const;
+    std::chrono::microseconds GetFrameLag() const;
+
+    /**
+     * @brief Wait until the driver sends all written bytes
+     *
+     * @param estimatedTime transmit time calculated from baud rate
+     * @return false if the driver can't report output queue size
+     */
+    bool WaitForTransmitCompletion(const std::chrono::microseconds& estimatedTime);
+
     TSerialPortSettings Settings;
     TSerialPortConnectionSettings InitialSettings;
     termios OldTermios;
     size_t RxTrigBytes;
+
+    //! Delivery latency estimations for baud rates used by devices on the port
+    std::unordered_map<int, TSerialPortTimingEstimator> Timings;
+
+    bool OutputQueueSupported;
+    bool LineStatusSupported;
+    mutable std::mutex TransmitStatsMutex;
+    TTransmitStats TransmitStats;
 };
 
 using PSerialPort = std::shared_ptr<TSerialPort>;
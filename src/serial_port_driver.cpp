@@ -19,16 +19,21 @@ using namespace WBMQTT;
 TSerialPortDriver::TSerialPortDriver(WBMQTT::PDeviceDriver mqttDriver,
                                      PPortConfig portConfig,
                                      const WBMQTT::TPublishParameters& publishPolicy,
-                                     size_t lowPriorityRateLimit)
+                                     PPortRateLimiter lowPriorityRateLimiter,
+                                     PDeviceCapabilitiesCache capabilitiesCache,
+                                     PModbusTcpServer modbusTcpServer)
     : MqttDriver(mqttDriver),
       Config(portConfig),
-      PublishPolicy(publishPolicy)
+      PublishPolicy(publishPolicy),
+      ModbusTcpServer(modbusTcpServer)
 {
     Description = Config->Port->GetDescription(false);
     SerialClient = PSerialClient(new TSerialClient(Config->Port,
                                                    Config->OpenCloseSettings,
                                                    std::chrono::steady_clock::now,
-                                                   lowPriorityRateLimit));
+                                                   lowPriorityRateLimiter,
+                                                   Config->PriorityClasses.MinShares));
+    SerialClient->SetCapabilitiesCache(capabilitiesCache);
 }
 
 const std::string& TSerialPortDriver::GetShortDescription() const
@@ -66,6 +71,13 @@ void TSerialPortDriver::SetUpDevices()
             }
             mqttDevice->RemoveUnusedControls(tx).Sync();
             SerialClient->AddDevice(device);
+            if (ModbusTcpServer && device->Protocol()->IsModbus()) {
+                ModbusTcpServer->AddDevice(device,
+                                           Description,
+                                           [client = SerialClient](PRegister reg, const TRegisterValue& value) {
+                                               client->SetRawValue(reg, value);
+                                           });
+            }
         }
     } catch (const exception& e) {
         LOG(Error) << "unable to create device: '" << e.what() << "' Cleaning.";
@@ -136,6 +148,9 @@ void TSerialPortDriver::SetValueToChannel(const PDeviceChannel& channel, const s
 
 void TSerialPortDriver::OnValueRead(PRegister reg)
 {
+    if (ModbusTcpServer) {
+        ModbusTcpServer->UpdateRegister(reg);
+    }
     auto it = RegisterToChannelMap.find(reg);
     if (it == RegisterToChannelMap.end()) {
         LOG(Warn) << "got unexpected register from serial client";
@@ -148,6 +163,9 @@ void TSerialPortDriver::OnValueRead(PRegister reg)
 
 void TSerialPortDriver::UpdateError(PRegister reg)
 {
+    if (ModbusTcpServer) {
+        ModbusTcpServer->UpdateRegister(reg);
+    }
     auto it = RegisterToChannelMap.find(reg);
     if (it == RegisterToChannelMap.end()) {
         LOG(Warn) << "got unexpected register from serial client";
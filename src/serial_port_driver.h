@@ -60,7 +60,9 @@ public:
     TSerialPortDriver(WBMQTT::PDeviceDriver mqttDriver,
                       PPortConfig port_config,
                       const WBMQTT::TPublishParameters& publishPolicy,
-                      size_t lowPriorityRateLimit);
+                      PPortRateLimiter lowPriorityRateLimiter,
+                      PDeviceCapabilitiesCache capabilitiesCache = nullptr,
+                      PModbusTcpServer modbusTcpServer = nullptr);
 
     void SetUpDevices();
     void Cycle(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
@@ -89,6 +91,8 @@ private:
     WBMQTT::TPublishParameters PublishPolicy;
 
     std::unordered_map<PRegister, PDeviceChannel> RegisterToChannelMap;
+
+    PModbusTcpServer ModbusTcpServer;
 };
 
 typedef std::shared_ptr<TSerialPortDriver> PSerialPortDriver;
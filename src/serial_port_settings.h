@@ -46,4 +46,7 @@ struct TSerialPortSettings: public TSerialPortConnectionSettings
     }
 
     std::string Device;
+
+    //! Replace fixed delivery lags by ones measured on received frames
+    bool AdaptiveTiming = false;
 };
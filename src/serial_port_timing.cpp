@@ -0,0 +1,95 @@
+#include "serial_port_timing.h"
+
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace
+{
+    // Estimations use the latest samples, so they follow changes of system load
+    const size_t WINDOW_SIZE = 256;
+
+    const size_t MIN_SAMPLES_COUNT = 32;
+
+    // Required samples count is doubled after every framing error
+    const size_t MAX_REQUIRED_SAMPLES_COUNT = 16 * WINDOW_SIZE;
+
+    // Estimations are recalculated after every UPDATE_PERIOD samples
+    const size_t UPDATE_PERIOD = 16;
+
+    // 99th percentile of WINDOW_SIZE samples
+    const size_t PERCENTILE_INDEX = WINDOW_SIZE - WINDOW_SIZE / 100 - 1;
+
+    const microseconds SAFETY_MARGIN = milliseconds(1);
+
+    microseconds GetPercentile(std::vector<microseconds> samples)
+    {
+        auto index = std::min(samples.size() - 1, PERCENTILE_INDEX * samples.size() / WINDOW_SIZE);
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        // Half of the percentile and a fixed margin cover rare delays not seen in the window
+        return samples[index] + samples[index] / 2 + SAFETY_MARGIN;
+    }
+}
+
+TSerialPortTimingEstimator::TSerialPortTimingEstimator()
+    : NextSample(0),
+      SamplesCount(0),
+      RequiredSamplesCount(MIN_SAMPLES_COUNT),
+      FrameGap(microseconds::zero()),
+      DriverLatency(microseconds::zero())
+{
+    Gaps.reserve(WINDOW_SIZE);
+    Latencies.reserve(WINDOW_SIZE);
+}
+
+void TSerialPortTimingEstimator::AddFramePart(const microseconds& gap, const microseconds& sendTime)
+{
+    // Bytes of the part could be received before the previous part was read, so the latency can't be calculated
+    auto latency = std::max(gap - sendTime, microseconds::zero());
+    if (Gaps.size() < WINDOW_SIZE) {
+        Gaps.push_back(gap);
+        Latencies.push_back(latency);
+    } else {
+        Gaps[NextSample] = gap;
+        Latencies[NextSample] = latency;
+    }
+    NextSample = (NextSample + 1) % WINDOW_SIZE;
+    ++SamplesCount;
+    if (SamplesCount == RequiredSamplesCount ||
+        (SamplesCount > RequiredSamplesCount && NextSample % UPDATE_PERIOD == 0))
+    {
+        Update();
+    }
+}
+
+void TSerialPortTimingEstimator::Reset()
+{
+    if (IsCalibrated()) {
+        RequiredSamplesCount = std::min(RequiredSamplesCount * 2, MAX_REQUIRED_SAMPLES_COUNT);
+    }
+    Gaps.clear();
+    Latencies.clear();
+    NextSample = 0;
+    SamplesCount = 0;
+}
+
+bool TSerialPortTimingEstimator::IsCalibrated() const
+{
+    return SamplesCount >= RequiredSamplesCount;
+}
+
+microseconds TSerialPortTimingEstimator::GetFrameGap() const
+{
+    return FrameGap;
+}
+
+microseconds TSerialPortTimingEstimator::GetDriverLatency() const
+{
+    return DriverLatency;
+}
+
+void TSerialPortTimingEstimator::Update()
+{
+    FrameGap = GetPercentile(Gaps);
+    DriverLatency = GetPercentile(Latencies);
+}
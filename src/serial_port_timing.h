@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Estimates delays of delivering received bytes from UART to user space.
+ *        Samples are gaps between parts of a frame returned by read().
+ *        A gap consists of sending time of the part over the line and latency of the tty driver.
+ *        Estimations are based on high percentile of the latest samples with a safety margin,
+ *        so they can replace fixed worst case lags added to timeouts.
+ */
+class TSerialPortTimingEstimator
+{
+public:
+    TSerialPortTimingEstimator();
+
+    /**
+     * @brief Store a gap between parts of a received frame
+     *
+     * @param gap time between receiving of the previous part and the part
+     * @param sendTime time of sending the part over the line
+     */
+    void AddFramePart(const std::chrono::microseconds& gap, const std::chrono::microseconds& sendTime);
+
+    /**
+     * @brief Drop collected samples after a framing error.
+     *        Estimations are not available until more samples than before are collected.
+     */
+    void Reset();
+
+    //! Enough samples are collected for estimations
+    bool IsCalibrated() const;
+
+    //! Maximum expected gap between parts of a frame. Valid if IsCalibrated returns true
+    std::chrono::microseconds GetFrameGap() const;
+
+    //! Maximum expected latency of the tty driver. Valid if IsCalibrated returns true
+    std::chrono::microseconds GetDriverLatency() const;
+
+private:
+    void Update();
+
+    std::vector<std::chrono::microseconds> Gaps;
+    std::vector<std::chrono::microseconds> Latencies;
+    size_t NextSample;
+    size_t SamplesCount;
+    size_t RequiredSamplesCount;
+    std::chrono::microseconds FrameGap;
+    std::chrono::microseconds DriverLatency;
+};
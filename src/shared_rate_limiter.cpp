@@ -0,0 +1,173 @@
+#include "shared_rate_limiter.h"
+
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace
+{
+    const auto STATS_WINDOW = 1s;
+}
+
+TPortRateLimiter::TPortRateLimiter(std::shared_ptr<TSharedRateLimiter> limiter, size_t index)
+    : Limiter(limiter),
+      Index(index)
+{}
+
+void TPortRateLimiter::NewItem(steady_clock::time_point time)
+{
+    Limiter->NewItem(Index, time);
+}
+
+bool TPortRateLimiter::IsOverLimit(steady_clock::time_point time)
+{
+    return Limiter->IsOverLimit(Index, time);
+}
+
+steady_clock::time_point TPortRateLimiter::GetNextItemTime(steady_clock::time_point time)
+{
+    return Limiter->GetNextItemTime(Index, time);
+}
+
+TSharedRateLimiter::TSharedRateLimiter(size_t rateLimit)
+    : RateLimit(rateLimit),
+      CommonRate(rateLimit),
+      CommonTokens(rateLimit)
+{}
+
+PPortRateLimiter TSharedRateLimiter::AddPort(const std::string& description, size_t minRateLimit)
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    TPortBucket port;
+    port.Stats.Port = description;
+    port.Stats.MinRateLimit = minRateLimit;
+    Ports.push_back(port);
+    UpdateReservedRates();
+    for (auto& port: Ports) {
+        port.Tokens = port.ReservedRate;
+    }
+    CommonTokens = CommonRate;
+    return std::make_shared<TPortRateLimiter>(shared_from_this(), Ports.size() - 1);
+}
+
+size_t TSharedRateLimiter::GetRateLimit() const
+{
+    return RateLimit;
+}
+
+std::vector<TPortRateLimiterStats> TSharedRateLimiter::GetStats(steady_clock::time_point time) const
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    std::vector<TPortRateLimiterStats> res;
+    for (const auto& port: Ports) {
+        res.push_back(port.Stats);
+        res.back().ItemsPerSecond = GetItemsPerSecond(port, time);
+    }
+    return res;
+}
+
+size_t TSharedRateLimiter::GetItemsPerSecond(const TPortBucket& port, steady_clock::time_point time)
+{
+    if (time - port.WindowStart < STATS_WINDOW) {
+        return port.Stats.ItemsPerSecond;
+    }
+    // Current window is already full, the next one would start at the time
+    return (time - port.WindowStart < 2 * STATS_WINDOW) ? port.WindowItems : 0;
+}
+
+void TSharedRateLimiter::UpdateReservedRates()
+{
+    double minRatesSum = 0;
+    for (const auto& port: Ports) {
+        minRatesSum += port.Stats.MinRateLimit;
+    }
+    double scale = (minRatesSum > RateLimit) ? RateLimit / minRatesSum : 1.0;
+    CommonRate = RateLimit;
+    for (auto& port: Ports) {
+        port.ReservedRate = port.Stats.MinRateLimit * scale;
+        CommonRate -= port.ReservedRate;
+    }
+    CommonRate = std::max(CommonRate, 0.0);
+}
+
+void TSharedRateLimiter::Refill(steady_clock::time_point time)
+{
+    if (LastRefillTime == steady_clock::time_point()) {
+        LastRefillTime = time;
+        return;
+    }
+    if (time <= LastRefillTime) {
+        return;
+    }
+    double dt = duration_cast<duration<double>>(time - LastRefillTime).count();
+    LastRefillTime = time;
+
+    // Reserved tokens that don't fit in full port's bucket go to common bucket
+    double spilledTokens = 0;
+    for (auto& port: Ports) {
+        port.Tokens += port.ReservedRate * dt;
+        if (port.Tokens > port.ReservedRate) {
+            spilledTokens += port.Tokens - port.ReservedRate;
+            port.Tokens = port.ReservedRate;
+        }
+    }
+    CommonTokens = std::min(CommonTokens + CommonRate * dt + spilledTokens, static_cast<double>(RateLimit));
+}
+
+void TSharedRateLimiter::NewItem(size_t index, steady_clock::time_point time)
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    auto& port = Ports[index];
+
+    if (time - port.WindowStart >= STATS_WINDOW) {
+        port.Stats.ItemsPerSecond = GetItemsPerSecond(port, time);
+        port.WindowStart = time;
+        port.WindowItems = 0;
+    }
+    ++port.WindowItems;
+    ++port.Stats.TotalItems;
+
+    if (RateLimit == 0) {
+        return;
+    }
+    Refill(time);
+    if (port.Tokens >= 1 || CommonTokens < 1) {
+        // If there are no tokens at all, the port gets into debt
+        port.Tokens -= 1;
+    } else {
+        CommonTokens -= 1;
+    }
+}
+
+bool TSharedRateLimiter::IsOverLimit(size_t index, steady_clock::time_point time)
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (RateLimit == 0) {
+        return false;
+    }
+    Refill(time);
+    return Ports[index].Tokens < 1 && CommonTokens < 1;
+}
+
+steady_clock::time_point TSharedRateLimiter::GetNextItemTime(size_t index, steady_clock::time_point time)
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (RateLimit == 0) {
+        return time;
+    }
+    Refill(time);
+    const auto& port = Ports[index];
+    if (port.Tokens >= 1 || CommonTokens >= 1) {
+        return time;
+    }
+    // Spilled tokens of other ports are not taken into account.
+    // Wait no more than a second, the limit will be checked again anyway
+    double waitTime = 1;
+    if (port.ReservedRate > 0) {
+        waitTime = std::min(waitTime, (1 - port.Tokens) / port.ReservedRate);
+    }
+    if (CommonRate > 0) {
+        waitTime = std::min(waitTime, (1 - CommonTokens) / CommonRate);
+    }
+    return time + ceil<milliseconds>(duration<double>(waitTime));
+}
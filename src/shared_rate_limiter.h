@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class TSharedRateLimiter;
+
+/**
+ * @brief Port's view of TSharedRateLimiter
+ */
+class TPortRateLimiter
+{
+public:
+    TPortRateLimiter(std::shared_ptr<TSharedRateLimiter> limiter, size_t index);
+
+    //! Takes one token for read item
+    void NewItem(std::chrono::steady_clock::time_point time);
+
+    bool IsOverLimit(std::chrono::steady_clock::time_point time);
+
+    //! Approximate time when a token will be available for the port
+    std::chrono::steady_clock::time_point GetNextItemTime(std::chrono::steady_clock::time_point time);
+
+private:
+    std::shared_ptr<TSharedRateLimiter> Limiter;
+    size_t Index;
+};
+
+typedef std::shared_ptr<TPortRateLimiter> PPortRateLimiter;
+
+struct TPortRateLimiterStats
+{
+    std::string Port;
+    size_t MinRateLimit = 0;
+
+    //! Items read during last full second
+    size_t ItemsPerSecond = 0;
+
+    size_t TotalItems = 0;
+};
+
+/**
+ * @brief Token bucket limiter of registers reads per second shared by all ports.
+ *        Every port has a reserved bucket refilled with the port's minimal rate.
+ *        Tokens that don't fit in full reserved buckets and the rest of total rate go to common bucket,
+ *        so capacity unused by idle ports is available to busy ones.
+ *        A port takes tokens from its reserved bucket first and then from common bucket.
+ *        Buckets hold tokens for one second.
+ *        Methods are thread safe as ports are polled in separate threads.
+ */
+class TSharedRateLimiter: public std::enable_shared_from_this<TSharedRateLimiter>
+{
+public:
+    //! rateLimit - total registers reads per second, 0 - unlimited
+    TSharedRateLimiter(size_t rateLimit);
+
+    /**
+     * @brief Add port to the limiter.
+     *        If sum of minimal rates exceeds total rate, reserved rates are reduced proportionally
+     */
+    PPortRateLimiter AddPort(const std::string& description, size_t minRateLimit);
+
+    size_t GetRateLimit() const;
+
+    //! Stats at the time, ItemsPerSecond of idle ports goes down without new items
+    std::vector<TPortRateLimiterStats> GetStats(std::chrono::steady_clock::time_point time) const;
+
+private:
+    friend class TPortRateLimiter;
+
+    struct TPortBucket
+    {
+        TPortRateLimiterStats Stats;
+        double ReservedRate = 0;
+        double Tokens = 0;
+        std::chrono::steady_clock::time_point WindowStart;
+        size_t WindowItems = 0;
+    };
+
+    size_t RateLimit;
+    double CommonRate;
+    double CommonTokens;
+    std::chrono::steady_clock::time_point LastRefillTime;
+    std::vector<TPortBucket> Ports;
+    mutable std::mutex Mutex;
+
+    static size_t GetItemsPerSecond(const TPortBucket& port, std::chrono::steady_clock::time_point time);
+
+    void UpdateReservedRates();
+    void Refill(std::chrono::steady_clock::time_point time);
+
+    void NewItem(size_t index, std::chrono::steady_clock::time_point time);
+    bool IsOverLimit(size_t index, std::chrono::steady_clock::time_point time);
+    std::chrono::steady_clock::time_point GetNextItemTime(size_t index, std::chrono::steady_clock::time_point time);
+};
+
+typedef std::shared_ptr<TSharedRateLimiter> PSharedRateLimiter;
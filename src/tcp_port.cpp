@@ -1,16 +1,22 @@
 #include "tcp_port.h"
+#include "port_reactor.h"
 #include "serial_exc.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 #include <unistd.h>
 
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
@@ -24,13 +30,57 @@ namespace
 {
     const int CONNECTION_TIMEOUT_S = 5;
 
-    // Additional timeout for reading from tcp port. It is caused by intermediate hardware and internal Linux processing
+    // Maximum time of waiting for connection in TryOpen, connection to a gateway in LAN is usually established faster
+    const std::chrono::milliseconds CONNECT_STEP_TIMEOUT(50);
+
+    const std::chrono::seconds DNS_CACHE_TTL(60);
+
+    // Period of checking if the host name is resolved by another thread
+    const std::chrono::milliseconds RESOLVE_CHECK_PERIOD(10);
+
+    const int KEEPALIVE_IDLE_S = 30;
+    const int KEEPALIVE_INTERVAL_S = 10;
+    const int KEEPALIVE_COUNT = 3;
+
+    // Upper bounds of additional timeouts for reading from tcp port.
+    // They are used until RTT of the connection is known.
     // Values are taken from old default timeouts
     const std::chrono::microseconds ResponseTCPLag = std::chrono::microseconds(500000);
     const std::chrono::microseconds FrameTCPLag = std::chrono::microseconds(150000);
+
+    // Lower bound of additional timeouts. It covers internal Linux processing and scheduling
+    const std::chrono::microseconds MinTCPLag = std::chrono::microseconds(10000);
+
+    // RTT estimation of the kernel is changing slowly, so there is no need to query it on every read
+    const std::chrono::seconds LAGS_UPDATE_PERIOD(1);
+
+    int GetAddrInfo(const TTcpPortSettings& settings, int flags, addrinfo** info)
+    {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = flags;
+        return getaddrinfo(settings.Address.c_str(), std::to_string(settings.Port).c_str(), &hints, info);
+    }
+
+    std::vector<sockaddr_storage> ToAddresses(const addrinfo* info)
+    {
+        std::vector<sockaddr_storage> res;
+        for (auto p = info; p; p = p->ai_next) {
+            sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            memcpy(&addr, p->ai_addr, p->ai_addrlen);
+            res.push_back(addr);
+        }
+        return res;
+    }
 }
 
-TTcpPort::TTcpPort(const TTcpPortSettings& settings): Settings(settings)
+TTcpPort::TTcpPort(const TTcpPortSettings& settings)
+    : Settings(settings),
+      ResponseLag(ResponseTCPLag),
+      FrameLag(FrameTCPLag)
 {}
 
 void TTcpPort::Open()
@@ -38,63 +88,244 @@ void TTcpPort::Open()
     if (IsOpen()) {
         throw TSerialDeviceException("port is already open");
     }
+    // Connect() throws if connection is not established before the deadline
+    while (!Connect(std::chrono::seconds(CONNECTION_TIMEOUT_S))) {
+    }
+}
+
+bool TTcpPort::TryOpen()
+{
+    if (IsOpen()) {
+        throw TSerialDeviceException("port is already open");
+    }
+    return Connect(CONNECT_STEP_TIMEOUT);
+}
+
+bool TTcpPort::IsOpen() const
+{
+    return Base::IsOpen() && !Connecting;
+}
+
+void TTcpPort::Close()
+{
+    if (Connecting) {
+        close(Fd);
+        Fd = -1;
+        Connecting = false;
+    } else {
+        Base::Close();
+    }
+}
+
+struct TTcpPort::TResolveRequest
+{
+    std::mutex Mutex;
+    bool Done = false;
+    int Error = 0;
+    std::vector<sockaddr_storage> Addresses;
+};
+
+bool TTcpPort::ResolveAddress()
+{
+    if (NumericAddress) {
+        return true;
+    }
+    if (ResolveRequest && !CompleteResolve()) {
+        return !ResolvedAddresses.empty();
+    }
+    if (!ResolvedAddresses.empty() && std::chrono::steady_clock::now() - ResolveTime < DNS_CACHE_TTL) {
+        return true;
+    }
+    if (ResolvedAddresses.empty()) {
+        // Numeric address doesn't need name server
+        addrinfo* info = nullptr;
+        if (GetAddrInfo(Settings, AI_NUMERICHOST, &info) == 0) {
+            ResolvedAddresses = ToAddresses(info);
+            freeaddrinfo(info);
+            NumericAddress = true;
+            return true;
+        }
+    }
+    StartResolve();
+    // Previously resolved addresses are used until the name is resolved again
+    return !ResolvedAddresses.empty();
+}
+
+void TTcpPort::StartResolve()
+{
+    auto request = std::make_shared<TResolveRequest>();
+    ResolveRequest = request;
+    auto settings = Settings;
+    // The thread is detached, so a port can be destroyed while resolving is in progress
+    std::thread([request, settings]() {
+        addrinfo* info = nullptr;
+        auto res = GetAddrInfo(settings, 0, &info);
+        std::unique_lock<std::mutex> lock(request->Mutex);
+        request->Error = res;
+        if (res == 0) {
+            request->Addresses = ToAddresses(info);
+            freeaddrinfo(info);
+        }
+        request->Done = true;
+    }).detach();
+}
 
-    struct hostent* server = gethostbyname(Settings.Address.c_str());
-    if (!server) {
+bool TTcpPort::CompleteResolve()
+{
+    std::unique_lock<std::mutex> lock(ResolveRequest->Mutex);
+    if (!ResolveRequest->Done) {
+        return false;
+    }
+    auto error = ResolveRequest->Error;
+    auto addresses = std::move(ResolveRequest->Addresses);
+    lock.unlock();
+    ResolveRequest.reset();
+
+    // Name server is queried again after DNS_CACHE_TTL even if it is not available now
+    ResolveTime = std::chrono::steady_clock::now();
+    if (error == 0) {
+        ResolvedAddresses = std::move(addresses);
+        return true;
+    }
+    if (ResolvedAddresses.empty()) {
+        throw TSerialDeviceException("no such host: " + Settings.Address + " (" + gai_strerror(error) + ")");
+    }
+    // Keep using previously resolved addresses while name server is not available
+    LOG(Debug) << "can't resolve " << Settings.Address << ": " << gai_strerror(error);
+    return true;
+}
+
+void TTcpPort::StartConnect()
+{
+    if (ResolvedAddresses.empty()) {
         throw TSerialDeviceException("no such host: " + Settings.Address);
     }
+    const auto& addr = ResolvedAddresses[AddressIndex % ResolvedAddresses.size()];
 
-    Fd = socket(AF_INET, SOCK_STREAM, 0);
+    Fd = socket(addr.ss_family, SOCK_STREAM, 0);
     if (Fd < 0) {
         throw TSerialDeviceErrnoException("cannot open tcp port: ", errno);
     }
 
-    struct sockaddr_in serv_addr;
-    memset((char*)&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    memmove((char*)&serv_addr.sin_addr.s_addr, (char*)server->h_addr, server->h_length);
-    serv_addr.sin_port = htons(Settings.Port);
-
     // set socket to non-blocking state
     auto arg = fcntl(Fd, F_GETFL, NULL);
     arg |= O_NONBLOCK;
     fcntl(Fd, F_SETFL, arg);
 
+    Connecting = true;
+    ConnectDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(CONNECTION_TIMEOUT_S);
+    socklen_t len = (addr.ss_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+    if (connect(Fd, reinterpret_cast<const sockaddr*>(&addr), len) < 0 && errno != EINPROGRESS) {
+        throw std::runtime_error("connect error: " + FormatErrno(errno));
+    }
+}
+
+bool TTcpPort::Connect(const std::chrono::microseconds& timeout)
+{
     try {
-        if (connect(Fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-            if (errno != EINPROGRESS) {
-                throw std::runtime_error("connect error: " + FormatErrno(errno));
-            }
-            timeval tv = {CONNECTION_TIMEOUT_S, 0};
-            fd_set myset;
-            FD_ZERO(&myset);
-            FD_SET(Fd, &myset);
-            auto res = select(Fd + 1, NULL, &myset, NULL, &tv);
-            if (res > 0) {
-                socklen_t lon = sizeof(int);
-                int valopt;
-                getsockopt(Fd, SOL_SOCKET, SO_ERROR, (void*)(&valopt), &lon);
-                if (valopt) {
-                    throw std::runtime_error("connect error: " + FormatErrno(valopt));
+        if (!Connecting) {
+            if (!ResolveAddress()) {
+                SleepFor(std::min<std::chrono::microseconds>(timeout, RESOLVE_CHECK_PERIOD));
+                if (!ResolveAddress()) {
+                    return false;
                 }
-            } else if (res < 0 && errno != EINTR) {
-                throw std::runtime_error("connect error: " + FormatErrno(errno));
-            } else {
+            }
+            StartConnect();
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto waitTime = std::min(std::chrono::duration_cast<std::chrono::microseconds>(ConnectDeadline - now),
+                                 timeout);
+        auto res = WaitForFd(Fd, POLLOUT, std::max(waitTime, std::chrono::microseconds::zero()));
+        if (res < 0 && errno != EINTR) {
+            throw std::runtime_error("connect error: " + FormatErrno(errno));
+        }
+        if (res <= 0) {
+            if (std::chrono::steady_clock::now() >= ConnectDeadline) {
                 throw std::runtime_error("connect error: timeout");
             }
+            return false;
+        }
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(Fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            throw std::runtime_error("connect error: " + FormatErrno(err));
         }
+    } catch (const TSerialDeviceException&) {
+        AbortConnect();
+        throw;
     } catch (const std::runtime_error& e) {
-        close(Fd);
-        Fd = -1;
+        AbortConnect();
         throw TSerialDeviceException(GetDescription() + " " + e.what());
     }
 
+    Connecting = false;
+
     // set socket back to blocking state
-    arg = fcntl(Fd, F_GETFL, NULL);
+    auto arg = fcntl(Fd, F_GETFL, NULL);
     arg &= (~O_NONBLOCK);
     fcntl(Fd, F_SETFL, arg);
 
+    SetSocketOptions();
+
     LastInteraction = std::chrono::steady_clock::now();
+    LagsUpdateTime = std::chrono::steady_clock::time_point();
+    UpdateLags();
+    return true;
+}
+
+void TTcpPort::AbortConnect()
+{
+    if (Base::IsOpen()) {
+        close(Fd);
+        Fd = -1;
+    }
+    Connecting = false;
+    // Try next address of the host
+    ++AddressIndex;
+}
+
+void TTcpPort::SetSocketOptions()
+{
+    // Requests are sent by one write, so there is no need to wait for more data before sending
+    int on = 1;
+    if (setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) {
+        LOG(Debug) << GetDescription() << " can't set TCP_NODELAY: " << FormatErrno(errno);
+    }
+
+    // Detect broken connections to gateways even if there are no requests
+    int idle = KEEPALIVE_IDLE_S;
+    int interval = KEEPALIVE_INTERVAL_S;
+    int count = KEEPALIVE_COUNT;
+    if (setsockopt(Fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) != 0 ||
+        setsockopt(Fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0 ||
+        setsockopt(Fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0 ||
+        setsockopt(Fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) != 0)
+    {
+        LOG(Debug) << GetDescription() << " can't enable keepalive: " << FormatErrno(errno);
+    }
+}
+
+void TTcpPort::UpdateLags()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - LagsUpdateTime < LAGS_UPDATE_PERIOD) {
+        return;
+    }
+    LagsUpdateTime = now;
+    tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(Fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 || info.tcpi_rtt == 0) {
+        ResponseLag = ResponseTCPLag;
+        FrameLag = FrameTCPLag;
+        return;
+    }
+    // Like retransmission timeout in TCP (RFC 6298): smoothed RTT + 4 * RTT variation.
+    // Parts of a frame are delayed relative to each other only by RTT variation
+    std::chrono::microseconds rtt(info.tcpi_rtt);
+    std::chrono::microseconds rttVar(info.tcpi_rttvar);
+    ResponseLag = std::clamp(rtt + 4 * rttVar, MinTCPLag, ResponseTCPLag);
+    FrameLag = std::clamp(4 * rttVar, MinTCPLag, FrameTCPLag);
 }
 
 void TTcpPort::OnReadyEmptyFd()
@@ -114,7 +345,10 @@ void TTcpPort::WriteBytes(const uint8_t* buf, int count)
 
 uint8_t TTcpPort::ReadByte(const std::chrono::microseconds& timeout)
 {
-    return Base::ReadByte(timeout + ResponseTCPLag);
+    if (IsOpen()) {
+        UpdateLags();
+    }
+    return Base::ReadByte(timeout + ResponseLag);
 }
 
 TReadFrameResult TTcpPort::ReadFrame(uint8_t* buf,
@@ -124,10 +358,11 @@ TReadFrameResult TTcpPort::ReadFrame(uint8_t* buf,
                                      TFrameCompletePred frame_complete)
 {
     if (IsOpen()) {
+        UpdateLags();
         return Base::ReadFrame(buf,
                                count,
-                               responseTimeout + ResponseTCPLag,
-                               frameTimeout + FrameTCPLag,
+                               responseTimeout + ResponseLag,
+                               frameTimeout + FrameLag,
                                frame_complete);
     }
     LOG(Debug) << "Attempt to read from not open port";
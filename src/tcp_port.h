@@ -3,6 +3,9 @@
 #include "file_descriptor_port.h"
 #include "tcp_port_settings.h"
 
+#include <memory>
+#include <sys/socket.h>
+
 class TTcpPort final: public TFileDescriptorPort
 {
     using Base = TFileDescriptorPort;
@@ -11,7 +14,14 @@ public:
     TTcpPort(const TTcpPortSettings& settings);
     ~TTcpPort() = default;
 
+    //! Connect to remote host, blocks up to 5 seconds
     void Open() override;
+
+    //! Start or continue non-blocking connection to remote host
+    bool TryOpen() override;
+
+    bool IsOpen() const override;
+    void Close() override;
     void WriteBytes(const uint8_t* buf, int count) override;
     uint8_t ReadByte(const std::chrono::microseconds& timeout) override;
     TReadFrameResult ReadFrame(uint8_t* buf,
@@ -25,5 +35,55 @@ public:
 private:
     void OnReadyEmptyFd() override;
 
+    struct TResolveRequest;
+
+    /**
+     * @brief Fill ResolvedAddresses. Numeric addresses are converted immediately.
+     *        Host names are resolved by a separate thread, because getaddrinfo blocks up to resolver's timeout.
+     *        Names are resolved again after DNS_CACHE_TTL, old addresses are used meanwhile.
+     *        Throws TSerialDeviceException if the name can't be resolved.
+     *
+     * @return false if there are no addresses yet and resolving is in progress
+     */
+    bool ResolveAddress();
+
+    //! Start resolving of the host name by a separate thread
+    void StartResolve();
+
+    //! Take results of completed resolving, returns false if it is still in progress
+    bool CompleteResolve();
+
+    void StartConnect();
+
+    /**
+     * @brief Start connection if needed and wait for its completion.
+     *        Throws TSerialDeviceException on errors and if connection is not established during CONNECTION_TIMEOUT_S
+     *
+     * @return true if connection is established
+     */
+    bool Connect(const std::chrono::microseconds& timeout);
+
+    //! Close socket after failed connection
+    void AbortConnect();
+
+    void SetSocketOptions();
+
+    //! Periodically recalculate additional read timeouts from RTT of the connection measured by the kernel
+    void UpdateLags();
+
     TTcpPortSettings Settings;
+
+    bool Connecting = false;
+    std::chrono::steady_clock::time_point ConnectDeadline;
+
+    std::vector<sockaddr_storage> ResolvedAddresses;
+    std::chrono::steady_clock::time_point ResolveTime;
+    bool NumericAddress = false;
+    std::shared_ptr<TResolveRequest> ResolveRequest;
+    size_t AddressIndex = 0;
+
+    //! Additional timeouts for reading caused by network delays
+    std::chrono::microseconds ResponseLag;
+    std::chrono::microseconds FrameLag;
+    std::chrono::steady_clock::time_point LagsUpdateTime;
 };
@@ -0,0 +1,217 @@
+#include "device_capabilities_cache.h"
+#include "modbus_common.h"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+
+namespace
+{
+    class TDummyPort: public TPort
+    {
+    public:
+        void Open() override
+        {}
+        void Close() override
+        {}
+        bool IsOpen() const override
+        {
+            return true;
+        }
+        void CheckPortOpen() const override
+        {}
+        void WriteBytes(const uint8_t* buf, int count) override
+        {}
+        uint8_t ReadByte(const std::chrono::microseconds& timeout) override
+        {
+            return 0;
+        }
+        TReadFrameResult ReadFrame(uint8_t* buf,
+                                   size_t count,
+                                   const std::chrono::microseconds& responseTimeout,
+                                   const std::chrono::microseconds& frameTimeout,
+                                   TFrameCompletePred frameComplete = 0) override
+        {
+            return TReadFrameResult();
+        }
+        void SkipNoise() override
+        {}
+        void SleepSinceLastInteraction(const std::chrono::microseconds& us) override
+        {}
+        std::string GetDescription(bool verbose) const override
+        {
+            return "dummy";
+        }
+    };
+
+    //! Device with a firmware version set by test
+    class TSignedDevice: public TSerialDevice
+    {
+    public:
+        std::string Version;
+
+        TSignedDevice(const std::string& slaveId, const std::string& version)
+            : TSerialDevice(MakeConfig(slaveId), std::make_shared<TDummyPort>(), nullptr),
+              Version(version)
+        {}
+
+        std::string ToString() const override
+        {
+            return "signed:" + DeviceConfig()->SlaveId;
+        }
+
+    protected:
+        std::string ReadSignature() override
+        {
+            return Version;
+        }
+
+    private:
+        static PDeviceConfig MakeConfig(const std::string& slaveId)
+        {
+            auto config = std::make_shared<TDeviceConfig>("test", slaveId);
+            config->DeviceType = "signed";
+            return config;
+        }
+    };
+
+    std::shared_ptr<TSignedDevice> MakeDevice(const std::string& slaveId, const std::string& version)
+    {
+        auto device = std::make_shared<TSignedDevice>(slaveId, version);
+        device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, 1));
+        device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, 2));
+        return device;
+    }
+
+    class TTmpFile
+    {
+    public:
+        std::string Path;
+
+        TTmpFile(): Path(testing::TempDir() + "capabilities_" + std::to_string(rand()) + ".json")
+        {}
+
+        ~TTmpFile()
+        {
+            std::remove(Path.c_str());
+        }
+    };
+}
+
+TEST(TDeviceCapabilitiesCacheTest, JsonRoundTrip)
+{
+    TDeviceCapabilities capabilities;
+    capabilities.Signature = "1.2.3";
+    capabilities.SupportsHoles = false;
+    capabilities.SingleWriteTypes = {0, 3};
+    capabilities.Registers["holding: 1"] = TRegisterAvailability::AVAILABLE;
+    capabilities.Registers["input: 5:0:16"] = TRegisterAvailability::UNAVAILABLE;
+    capabilities.ReadLimits[3] = TLearnedReadLimits{63, 94, 2, 3};
+    capabilities.ReadSplits[4] = {10, 200};
+
+    auto res = CapabilitiesFromJson(CapabilitiesToJson(capabilities));
+    EXPECT_EQ(res.Signature, capabilities.Signature);
+    EXPECT_FALSE(res.SupportsHoles);
+    EXPECT_EQ(res.SingleWriteTypes, capabilities.SingleWriteTypes);
+    EXPECT_EQ(res.Registers, capabilities.Registers);
+    ASSERT_EQ(res.ReadLimits.size(), 1);
+    EXPECT_EQ(res.ReadLimits[3].AcceptedLength, 63);
+    EXPECT_EQ(res.ReadLimits[3].RejectedLength, 94);
+    EXPECT_EQ(res.ReadLimits[3].AcceptedHole, 2);
+    EXPECT_EQ(res.ReadLimits[3].RejectedHole, 3);
+    EXPECT_EQ(res.ReadSplits, capabilities.ReadSplits);
+}
+
+TEST(TDeviceCapabilitiesCacheTest, EmptyJson)
+{
+    auto res = CapabilitiesFromJson(Json::Value(Json::objectValue));
+    EXPECT_TRUE(res.Signature.empty());
+    EXPECT_TRUE(res.SupportsHoles);
+    EXPECT_TRUE(res.SingleWriteTypes.empty());
+    EXPECT_TRUE(res.Registers.empty());
+    EXPECT_TRUE(res.ReadLimits.empty());
+    EXPECT_TRUE(res.ReadSplits.empty());
+}
+
+TEST(TDeviceCapabilitiesCacheTest, SignatureChangeDropsCapabilities)
+{
+    auto device = MakeDevice("1", "1.0");
+    TDeviceCapabilities capabilities;
+    capabilities.Signature = "1.0";
+    capabilities.SupportsHoles = false;
+    auto regName = device->GetRegisters().front()->TRegisterConfig::ToString();
+    capabilities.Registers[regName] = TRegisterAvailability::UNAVAILABLE;
+    device->SetCapabilities(capabilities);
+
+    // The same firmware keeps learned data
+    device->Prepare();
+    EXPECT_FALSE(device->GetCapabilities().SupportsHoles);
+    EXPECT_EQ(device->GetRegisters().front()->GetAvailable(), TRegisterAvailability::UNAVAILABLE);
+
+    // Updated firmware can have other registers
+    device->SetDisconnected();
+    device->Version = "1.1";
+    device->Prepare();
+    auto res = device->GetCapabilities();
+    EXPECT_EQ(res.Signature, "1.1");
+    EXPECT_TRUE(res.SupportsHoles);
+    EXPECT_TRUE(res.Registers.empty());
+    EXPECT_EQ(device->GetRegisters().front()->GetAvailable(), TRegisterAvailability::UNKNOWN);
+}
+
+TEST(TDeviceCapabilitiesCacheTest, RestoreAndUpdate)
+{
+    TTmpFile file;
+    auto device1 = MakeDevice("1", "1.0");
+    auto device2 = MakeDevice("2", "2.0");
+    auto unsignedDevice = MakeDevice("3", "");
+    device1->Prepare();
+    device2->Prepare();
+    device1->GetRegisters().front()->SetAvailable(TRegisterAvailability::UNAVAILABLE);
+    device2->GetRegisters().back()->SetAvailable(TRegisterAvailability::UNAVAILABLE);
+    unsignedDevice->GetRegisters().front()->SetAvailable(TRegisterAvailability::UNAVAILABLE);
+    unsignedDevice->GetRegisters().back()->SetAvailable(TRegisterAvailability::AVAILABLE);
+    unsignedDevice->SetSupportsHoles(false);
+    unsignedDevice->SetSupportsWriteTogether(Modbus::REG_HOLDING, false);
+    device1->SetSupportsHoles(false);
+    {
+        TDeviceCapabilitiesCache cache(file.Path);
+        cache.Update(*device1);
+        cache.Update(*device2);
+        cache.Update(*unsignedDevice);
+        cache.Save();
+    }
+
+    TDeviceCapabilitiesCache cache(file.Path);
+    cache.Load();
+    auto restored1 = MakeDevice("1", "1.0");
+    auto restored2 = MakeDevice("2", "2.0");
+    auto restoredUnsigned = MakeDevice("3", "");
+    cache.Restore(*restored2);
+    cache.Restore(*restored1);
+    cache.Restore(*restoredUnsigned);
+    EXPECT_EQ(restored1->GetCapabilities().Signature, "1.0");
+    EXPECT_FALSE(restored1->GetCapabilities().SupportsHoles);
+    EXPECT_EQ(restored1->GetRegisters().front()->GetAvailable(), TRegisterAvailability::UNAVAILABLE);
+    EXPECT_EQ(restored1->GetRegisters().back()->GetAvailable(), TRegisterAvailability::UNKNOWN);
+    EXPECT_EQ(restored2->GetCapabilities().Signature, "2.0");
+    EXPECT_EQ(restored2->GetRegisters().front()->GetAvailable(), TRegisterAvailability::UNKNOWN);
+    EXPECT_EQ(restored2->GetRegisters().back()->GetAvailable(), TRegisterAvailability::UNAVAILABLE);
+
+    // Restrictions learned from a device without signature are checked again after restart
+    EXPECT_EQ(restoredUnsigned->GetRegisters().front()->GetAvailable(), TRegisterAvailability::UNKNOWN);
+    EXPECT_EQ(restoredUnsigned->GetRegisters().back()->GetAvailable(), TRegisterAvailability::AVAILABLE);
+    EXPECT_TRUE(restoredUnsigned->GetCapabilities().SupportsHoles);
+    EXPECT_TRUE(restoredUnsigned->GetSupportsWriteTogether(Modbus::REG_HOLDING));
+
+    // Restored devices are stored under the same keys, so nothing is changed
+    cache.Update(*restored1);
+    cache.Update(*restored2);
+    cache.Update(*restoredUnsigned);
+    std::remove(file.Path.c_str());
+    cache.Save();
+    FILE* f = fopen(file.Path.c_str(), "r");
+    EXPECT_EQ(f, nullptr);
+    if (f) {
+        fclose(f);
+    }
+}
@@ -1457,64 +1457,30 @@ void TModbusExpectations::EnqueueHoldingWriteS64Response(uint8_t exception)
         __func__);
 }
 
-// write RGB register which consists of 3 holding
+// write RGB register which consists of 3 holding, they are written by one request
 void TModbusExpectations::EnqueueRGBWriteResponse(uint8_t exception)
 {
-    // R
     Expector()->Expect(
         WrapPDU({
-            0x06, // function code
+            0x10, // function code
             0x00, // starting address Hi
             4,    // starting address Lo
-            0x00, // data Hi
-            0x0a, // data Lo
+            0x00, // quantity Hi
+            0x03, // quantity Lo
+            0x06, // byte count
+            0x00, // R Hi
+            0x0a, // R Lo
+            0x00, // G Hi
+            0x14, // G Lo
+            0x00, // B Hi
+            0x1E, // B Lo
         }),
         WrapPDU(exception == 0 ? std::vector<int>{
-                                     0x06, // function code
+                                     0x10, // function code
                                      0x00, // starting address Hi
                                      4,    // starting address Lo
-                                     0x00, // data Hi
-                                     0x0a, // data Lo
-                                 }
-                               : std::vector<int>{0x90, // function code + 80
-                                                  exception}),
-        __func__);
-
-    // G
-    Expector()->Expect(
-        WrapPDU({
-            0x06, // function code
-            0x00, // starting address Hi
-            5,    // starting address Lo
-            0x00, // data Hi
-            0x14, // data Lo
-        }),
-        WrapPDU(exception == 0 ? std::vector<int>{
-                                     0x06, // function code
-                                     0x00, // starting address Hi
-                                     5,    // starting address Lo
-                                     0x00, // data Hi
-                                     0x14, // data Lo
-                                 }
-                               : std::vector<int>{0x90, // function code + 80
-                                                  exception}),
-        __func__);
-
-    // B
-    Expector()->Expect(
-        WrapPDU({
-            0x06, // function code
-            0x00, // starting address Hi
-            6,    // starting address Lo
-            0x00, // data Hi
-            0x1E, // data Lo
-        }),
-        WrapPDU(exception == 0 ? std::vector<int>{
-                                     0x06, // function code
-                                     0x00, // starting address Hi
-                                     6,    // starting address Lo
-                                     0x00, // data Hi
-                                     0x1E, // data Lo
+                                     0x00, // quantity Hi
+                                     0x03, // quantity Lo
                                  }
                                : std::vector<int>{0x90, // function code + 80
                                                   exception}),
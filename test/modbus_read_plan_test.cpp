@@ -0,0 +1,516 @@
+#include "crc16.h"
+#include "modbus_common.h"
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    // 10 ms for response time, delays and frame, 1 ms for every register
+    std::chrono::microseconds GetRequestTime(size_t count)
+    {
+        return 10ms + count * 1ms;
+    }
+
+    std::vector<size_t> Plan(const std::vector<Modbus::TRegisterSpan>& spans,
+                             size_t maxRegs,
+                             size_t maxHole,
+                             std::chrono::milliseconds pollLimit = std::chrono::milliseconds::max(),
+                             const std::set<uint32_t>& splits = std::set<uint32_t>())
+    {
+        return Modbus::PlanReadRequests(spans, maxRegs, maxHole, pollLimit, GetRequestTime, splits);
+    }
+
+    //! Start and count of requests
+    typedef std::vector<std::pair<uint16_t, uint16_t>> TRequests;
+
+    //! Modbus RTU slave with holding registers and coils, rejects requests by IsRejected predicate
+    class TModbusSlavePort: public TPort
+    {
+    public:
+        typedef std::function<bool(uint16_t start, uint16_t count)> TRejectFn;
+
+        TRequests Requests;
+
+        //! Don't respond to rejected requests instead of responding with an exception
+        bool DropRejected = false;
+
+        TModbusSlavePort(TRejectFn isRejected): IsRejected(isRejected)
+        {}
+
+        void Open() override
+        {}
+        void Close() override
+        {}
+        bool IsOpen() const override
+        {
+            return true;
+        }
+        void CheckPortOpen() const override
+        {}
+        uint8_t ReadByte(const std::chrono::microseconds& timeout) override
+        {
+            return 0;
+        }
+        void SkipNoise() override
+        {}
+        void SleepSinceLastInteraction(const std::chrono::microseconds& us) override
+        {}
+        std::string GetDescription(bool verbose) const override
+        {
+            return "slave";
+        }
+
+        void WriteBytes(const uint8_t* buf, int count) override
+        {
+            bool isSingleWrite = (buf[1] == 0x05) || (buf[1] == 0x06);
+            bool isWrite = isSingleWrite || (buf[1] == 0x0F) || (buf[1] == 0x10);
+            uint16_t start = (buf[2] << 8) | buf[3];
+            uint16_t regCount = isSingleWrite ? 1 : (buf[4] << 8) | buf[5];
+            Requests.emplace_back(start, regCount);
+            Response = {buf[0]};
+            if (IsRejected(start, regCount) && DropRejected) {
+                Response.clear();
+                return;
+            }
+            if (IsRejected(start, regCount)) {
+                Response.push_back(buf[1] | 0x80);
+                Response.push_back(0x02); // ILLEGAL DATA ADDRESS
+            } else if (isWrite) {
+                Response.insert(Response.end(), buf + 1, buf + 6);
+            } else {
+                Response.push_back(buf[1]);
+                Response.push_back(regCount * 2);
+                for (uint16_t addr = start; addr < start + regCount; ++addr) {
+                    Response.push_back(0);
+                    Response.push_back(addr);
+                }
+            }
+            auto crc = CRC16::CalculateCRC16(Response.data(), Response.size());
+            Response.push_back(crc >> 8);
+            Response.push_back(crc & 0xFF);
+        }
+
+        TReadFrameResult ReadFrame(uint8_t* buf,
+                                   size_t count,
+                                   const std::chrono::microseconds& responseTimeout,
+                                   const std::chrono::microseconds& frameTimeout,
+                                   TFrameCompletePred frameComplete = 0) override
+        {
+            if (Response.empty()) {
+                throw TResponseTimeoutException();
+            }
+            TReadFrameResult res;
+            res.Count = std::min(count, Response.size());
+            memcpy(buf, Response.data(), res.Count);
+            return res;
+        }
+
+    private:
+        TRejectFn IsRejected;
+        std::vector<uint8_t> Response;
+    };
+
+    class TTestDevice: public TSerialDevice
+    {
+    public:
+        using TSerialDevice::TSerialDevice;
+
+        std::string ToString() const override
+        {
+            return "test";
+        }
+
+        PRegisterRange CreateRegisterRange() const override
+        {
+            return Modbus::CreateRegisterRange(std::chrono::microseconds::zero());
+        }
+    };
+}
+
+class TModbusRangeSplitTest: public testing::Test
+{
+protected:
+    std::shared_ptr<TModbusSlavePort> Port;
+    PSerialDevice Device;
+    Modbus::PReadSplits Splits;
+    std::vector<PRegister> Registers;
+
+    void Init(TModbusSlavePort::TRejectFn isRejected)
+    {
+        Port = std::make_shared<TModbusSlavePort>(isRejected);
+        auto config = std::make_shared<TDeviceConfig>("test", "1");
+        config->MaxReadRegisters = 0;
+        Device = std::make_shared<TTestDevice>(config, Port, nullptr);
+        Splits = std::make_shared<Modbus::TReadSplits>();
+        for (uint32_t addr = 0; addr < 8; ++addr) {
+            Registers.push_back(Device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, addr)));
+            Registers.back()->SetAvailable(TRegisterAvailability::AVAILABLE);
+        }
+    }
+
+    void Read(Modbus::PAdaptiveReadLimits limits = nullptr)
+    {
+        Modbus::TModbusRTUTraits traits;
+        Modbus::TRegisterCache cache;
+        std::list<PRegister> registers;
+        for (const auto& reg: Registers) {
+            if (reg->GetAvailable() != TRegisterAvailability::UNAVAILABLE) {
+                registers.push_back(reg);
+            }
+        }
+        while (!registers.empty()) {
+            Modbus::TModbusRegisterRange range(std::chrono::microseconds::zero(), limits, Splits);
+            registers = range.AddRegisters(registers, std::chrono::milliseconds::max(), true);
+            Modbus::ReadRegisterRange(traits, *Port, 1, range, cache);
+        }
+    }
+};
+
+TEST(ModbusReadPlanTest, Continuous)
+{
+    EXPECT_EQ(Plan({{0, 1}, {1, 2}, {2, 4}, {4, 5}}, 125, 0), std::vector<size_t>({0}));
+}
+
+TEST(ModbusReadPlanTest, Holes)
+{
+    // Reading 4 registers of a hole is cheaper than a new request
+    EXPECT_EQ(Plan({{0, 1}, {5, 6}}, 125, 10), std::vector<size_t>({0}));
+
+    // The hole is longer than device allows
+    EXPECT_EQ(Plan({{0, 1}, {5, 6}}, 125, 3), std::vector<size_t>({0, 1}));
+
+    // Reading 20 registers of a hole is more expensive than a new request
+    EXPECT_EQ(Plan({{0, 1}, {21, 22}}, 125, 30), std::vector<size_t>({0, 1}));
+}
+
+TEST(ModbusReadPlanTest, MaxReadRegisters)
+{
+    // Greedy builder reads 0-9 and 10-13, splitting at the hole reads less registers by the same requests count
+    EXPECT_EQ(Plan({{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}, {8, 9}, {9, 10}, {10, 11}, {11, 12}, {12, 13}},
+                   10,
+                   2),
+              std::vector<size_t>({0, 6}));
+
+    // Overlapping registers are read together
+    EXPECT_EQ(Plan({{0, 2}, {0, 1}, {1, 2}, {2, 4}}, 4, 0), std::vector<size_t>({0}));
+    EXPECT_EQ(Plan({{0, 2}, {0, 1}, {1, 2}, {2, 4}, {4, 5}}, 4, 0), std::vector<size_t>({0, 4}));
+}
+
+TEST(ModbusReadPlanTest, PollLimit)
+{
+    EXPECT_EQ(Plan({{0, 5}, {5, 10}, {10, 15}}, 125, 0, 20ms), std::vector<size_t>({0, 2}));
+
+    // A register longer than poll limit is read by separate request
+    EXPECT_EQ(Plan({{0, 5}, {5, 30}, {30, 35}}, 125, 0, 20ms), std::vector<size_t>({0, 1, 2}));
+}
+
+TEST(ModbusReadPlanTest, Splits)
+{
+    EXPECT_EQ(Plan({{0, 1}, {1, 2}, {2, 3}, {3, 4}}, 125, 0, std::chrono::milliseconds::max(), {2}),
+              std::vector<size_t>({0, 2}));
+
+    // A register crossing the split point is read with registers inside it
+    EXPECT_EQ(Plan({{0, 4}, {2, 3}, {4, 5}}, 125, 0, std::chrono::milliseconds::max(), {2}),
+              std::vector<size_t>({0, 2}));
+}
+
+TEST_F(TModbusRangeSplitTest, UnsupportedRegister)
+{
+    Init([](uint16_t start, uint16_t count) { return start <= 5 && 5 < start + count; });
+    Read();
+    EXPECT_EQ(Port->Requests,
+              TRequests({{0, 8}, {0, 4}, {4, 4}, {4, 2}, {6, 2}, {4, 1}, {5, 1}}));
+    for (size_t i = 0; i < Registers.size(); ++i) {
+        EXPECT_EQ(Registers[i]->GetAvailable(),
+                  (i == 5) ? TRegisterAvailability::UNAVAILABLE : TRegisterAvailability::AVAILABLE);
+    }
+    EXPECT_TRUE(Splits->GetPoints(Modbus::REG_HOLDING).empty());
+
+    Port->Requests.clear();
+    Read();
+    EXPECT_EQ(Port->Requests, TRequests({{0, 5}, {6, 2}}));
+}
+
+TEST_F(TModbusRangeSplitTest, FullyRejectedRange)
+{
+    // The device doesn't support the whole block, it is not split down to single registers
+    Init([](uint16_t, uint16_t) { return true; });
+    Read();
+    EXPECT_EQ(Port->Requests, TRequests({{0, 8}, {0, 4}, {4, 4}}));
+    for (const auto& reg: Registers) {
+        EXPECT_EQ(reg->GetAvailable(), TRegisterAvailability::UNAVAILABLE);
+    }
+    EXPECT_TRUE(Splits->GetPoints(Modbus::REG_HOLDING).empty());
+
+    Port->Requests.clear();
+    Read();
+    EXPECT_TRUE(Port->Requests.empty());
+}
+
+TEST_F(TModbusRangeSplitTest, SplitPoint)
+{
+    // Requests can't cross address 6
+    Init([](uint16_t start, uint16_t count) { return start < 6 && 6 < start + count; });
+    Read();
+    EXPECT_EQ(Port->Requests,
+              TRequests({{0, 8}, {0, 4}, {4, 4}, {4, 2}, {6, 2}}));
+    for (const auto& reg: Registers) {
+        EXPECT_EQ(reg->GetAvailable(), TRegisterAvailability::AVAILABLE);
+    }
+    EXPECT_EQ(Splits->GetPoints(Modbus::REG_HOLDING), std::set<uint32_t>({6}));
+
+    Port->Requests.clear();
+    Read();
+    EXPECT_EQ(Port->Requests, TRequests({{0, 6}, {6, 2}}));
+}
+
+TEST_F(TModbusRangeSplitTest, AdaptiveLimitsByTimeouts)
+{
+    // The slave doesn't respond to requests of more than 3 registers
+    Init([](uint16_t start, uint16_t count) { return count > 3; });
+    Port->DropRejected = true;
+    Device->SetTransferResult(true);
+    auto limits = std::make_shared<Modbus::TAdaptiveReadLimits>();
+    Read(limits);
+    // After a timeout the first register is read to check that the device responds to shorter requests.
+    // Other registers are read by requests fitting reduced limits in the same cycle
+    EXPECT_EQ(Port->Requests, TRequests({{0, 8}, {0, 1}, {1, 4}, {1, 1}, {2, 2}, {4, 1}, {5, 3}}));
+    for (const auto& reg: Registers) {
+        EXPECT_FALSE(reg->GetErrorState().test(TRegister::TError::ReadError));
+        EXPECT_EQ(reg->GetAvailable(), TRegisterAvailability::AVAILABLE);
+    }
+    EXPECT_EQ(limits->GetMaxReadRegisters(Modbus::REG_HOLDING), 3);
+
+    Port->Requests.clear();
+    Read(limits);
+    EXPECT_EQ(Port->Requests, TRequests({{0, 3}, {3, 3}, {6, 2}}));
+}
+
+TEST_F(TModbusRangeSplitTest, AdaptiveLimitsOfSilentDevice)
+{
+    // The device is off at start
+    Init([](uint16_t, uint16_t) { return true; });
+    Port->DropRejected = true;
+    auto limits = std::make_shared<Modbus::TAdaptiveReadLimits>();
+    Read(limits);
+    EXPECT_EQ(Port->Requests, TRequests({{0, 8}, {0, 1}}));
+    for (const auto& reg: Registers) {
+        EXPECT_TRUE(reg->GetErrorState().test(TRegister::TError::ReadError));
+    }
+    EXPECT_EQ(limits->GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+
+    // The device is turned off after it was connected
+    Device->SetTransferResult(true);
+    Port->Requests.clear();
+    Read(limits);
+    EXPECT_EQ(Port->Requests, TRequests({{0, 8}, {0, 1}}));
+    EXPECT_EQ(limits->GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+}
+
+TEST_F(TModbusRangeSplitTest, AdaptiveLimitsByExceptions)
+{
+    Init([](uint16_t start, uint16_t count) { return count > 5; });
+    auto limits = std::make_shared<Modbus::TAdaptiveReadLimits>();
+    Read(limits);
+    EXPECT_EQ(Port->Requests, TRequests({{0, 8}, {0, 4}, {4, 4}}));
+    for (const auto& reg: Registers) {
+        EXPECT_FALSE(reg->GetErrorState().test(TRegister::TError::ReadError));
+    }
+}
+
+TEST(ModbusWriteRegistersTest, Coalesce)
+{
+    // Holding 5 can't be written
+    auto port = std::make_shared<TModbusSlavePort>(
+        [](uint16_t start, uint16_t count) { return start <= 5 && 5 < start + count; });
+    auto config = std::make_shared<TDeviceConfig>("test", "1");
+    config->MaxReadRegisters = 0;
+    auto device = std::make_shared<TTestDevice>(config, port, nullptr);
+
+    std::vector<TRegisterWrite> writes;
+    for (uint32_t addr: {0, 1, 2, 4, 5, 6}) {
+        writes.push_back({device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, addr)), TRegisterValue(addr)});
+    }
+    for (uint32_t addr: {0, 1}) {
+        writes.push_back({device->AddRegister(TRegister::Create(Modbus::REG_COIL, addr)), TRegisterValue(1)});
+    }
+    // Not contiguous with previous writes
+    writes.push_back({device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, 3)), TRegisterValue(3)});
+
+    Modbus::TModbusRTUTraits traits;
+    Modbus::TRegisterCache cache;
+    std::vector<PRegister> written;
+    Modbus::WriteRegisters(traits, *port, 1, writes, cache, [&](const TRegisterWrite& write) {
+        written.push_back(write.Register);
+        EXPECT_EQ(!!write.Error, write.Register == writes[4].Register);
+    });
+
+    // Rejected request is repeated by single writes to find the failed register
+    EXPECT_EQ(port->Requests, TRequests({{0, 3}, {4, 3}, {4, 1}, {5, 1}, {6, 1}, {0, 2}, {3, 1}}));
+    ASSERT_EQ(written.size(), writes.size());
+    for (size_t i = 0; i < writes.size(); ++i) {
+        EXPECT_EQ(written[i], writes[i].Register);
+    }
+
+    // Requests are limited by max_read_registers
+    config->MaxReadRegisters = 2;
+    port->Requests.clear();
+    writes.erase(writes.begin() + 3, writes.end());
+    Modbus::WriteRegisters(traits, *port, 1, writes, cache, [](const TRegisterWrite& write) {});
+    EXPECT_EQ(port->Requests, TRequests({{0, 2}, {2, 1}}));
+}
+
+TEST(ModbusWriteRegistersTest, SingleWritesOnly)
+{
+    // The device implements 0x06 and 0x0F, but not 0x10
+    auto port = std::make_shared<TModbusSlavePort>([](uint16_t start, uint16_t count) { return count > 1; });
+    auto config = std::make_shared<TDeviceConfig>("test", "1");
+    config->MaxReadRegisters = 0;
+    auto device = std::make_shared<TTestDevice>(config, port, nullptr);
+
+    std::vector<TRegisterWrite> writes;
+    for (uint32_t addr: {0, 1, 2}) {
+        writes.push_back({device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, addr)), TRegisterValue(addr)});
+    }
+
+    Modbus::TModbusRTUTraits traits;
+    Modbus::TRegisterCache cache;
+    auto noErrors = [](const TRegisterWrite& write) { EXPECT_FALSE(write.Error); };
+    Modbus::WriteRegisters(traits, *port, 1, writes, cache, noErrors);
+    EXPECT_EQ(port->Requests, TRequests({{0, 3}, {0, 1}, {1, 1}, {2, 1}}));
+    EXPECT_FALSE(device->GetSupportsWriteTogether(Modbus::REG_HOLDING));
+    EXPECT_TRUE(device->GetSupportsWriteTogether(Modbus::REG_COIL));
+
+    // Rejected request is not sent again
+    port->Requests.clear();
+    Modbus::WriteRegisters(traits, *port, 1, writes, cache, noErrors);
+    EXPECT_EQ(port->Requests, TRequests({{0, 1}, {1, 1}, {2, 1}}));
+
+    // The device could be replaced while it was disconnected
+    device->SetDisconnected();
+    EXPECT_TRUE(device->GetSupportsWriteTogether(Modbus::REG_HOLDING));
+}
+
+TEST(ModbusWriteSetupRegistersTest, Verify)
+{
+    auto port = std::make_shared<TModbusSlavePort>([](uint16_t start, uint16_t count) { return false; });
+    auto config = std::make_shared<TDeviceConfig>("test", "1");
+    config->MaxReadRegisters = 0;
+    auto device = std::make_shared<TTestDevice>(config, port, nullptr);
+
+    // The slave returns register address as its value, so holdings 1 and 3 are already set
+    std::vector<PDeviceSetupItem> items;
+    for (uint32_t addr: {0, 1, 2, 3}) {
+        auto regConfig = TRegister::Create(Modbus::REG_HOLDING, addr);
+        auto itemConfig =
+            std::make_shared<TDeviceSetupItemConfig>("setup", regConfig, std::to_string((addr % 2) ? addr : 10));
+        items.push_back(
+            std::make_shared<TDeviceSetupItem>(device, itemConfig, std::make_shared<TRegister>(device, regConfig)));
+    }
+
+    Modbus::TModbusRTUTraits traits;
+    Modbus::TRegisterCache cache;
+    Modbus::WriteSetupRegisters(traits, *port, 1, items, cache);
+    EXPECT_EQ(port->Requests, TRequests({{0, 4}}));
+
+    port->Requests.clear();
+    Modbus::WriteSetupRegisters(traits, *port, 1, items, cache, 0, true);
+    EXPECT_EQ(port->Requests, TRequests({{0, 4}, {0, 1}, {2, 1}}));
+}
+
+TEST(ModbusAdaptiveReadLimitsTest, BinarySearch)
+{
+    Modbus::TAdaptiveLimit limit(1, 125);
+    EXPECT_EQ(limit.Get(), 125);
+
+    EXPECT_TRUE(limit.Reject(125));
+    EXPECT_EQ(limit.Get(), 63);
+    limit.Accept(63);
+    EXPECT_EQ(limit.Get(), 94);
+    EXPECT_TRUE(limit.Reject(94));
+    EXPECT_EQ(limit.Get(), 78);
+
+    // Rejection of accepted length is caused by registers
+    EXPECT_FALSE(limit.Reject(50));
+    EXPECT_EQ(limit.Get(), 78);
+}
+
+TEST(ModbusAdaptiveReadLimitsTest, Retry)
+{
+    Modbus::TAdaptiveLimit limit(0, 10);
+    EXPECT_TRUE(limit.Reject(10));
+    EXPECT_TRUE(limit.Reject(5));
+    EXPECT_TRUE(limit.Reject(2));
+    EXPECT_TRUE(limit.Reject(1));
+    EXPECT_EQ(limit.Get(), 0);
+    for (size_t i = 0; i + 1 < Modbus::TAdaptiveLimit::RETRY_ACCEPTS_COUNT; ++i) {
+        limit.Accept(0);
+    }
+    EXPECT_EQ(limit.Get(), 0);
+    // Only one step above accepted value is tried
+    limit.Accept(0);
+    EXPECT_EQ(limit.Get(), 1);
+    EXPECT_TRUE(limit.Reject(1));
+    EXPECT_EQ(limit.Get(), 0);
+
+    limit.Restore(3, 6);
+    for (size_t i = 0; i < Modbus::TAdaptiveLimit::RETRY_ACCEPTS_COUNT; ++i) {
+        limit.Accept(3);
+    }
+    EXPECT_EQ(limit.Get(), 4);
+    limit.Accept(4);
+    EXPECT_EQ(limit.Get(), 4);
+}
+
+TEST(ModbusAdaptiveReadLimitsTest, PerType)
+{
+    Modbus::TAdaptiveReadLimits limits;
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_COIL), 2000);
+    EXPECT_EQ(limits.GetMaxHole(Modbus::REG_INPUT), 10);
+
+    // Hole is suspected first
+    EXPECT_TRUE(limits.Reject(Modbus::REG_HOLDING, 20, 10));
+    EXPECT_EQ(limits.GetMaxHole(Modbus::REG_HOLDING), 5);
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+    EXPECT_EQ(limits.GetMaxHole(Modbus::REG_INPUT), 10);
+
+    EXPECT_TRUE(limits.Reject(Modbus::REG_INPUT, 100, 0));
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_INPUT), 50);
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+}
+
+TEST(ModbusAdaptiveReadLimitsTest, Restore)
+{
+    Modbus::TAdaptiveReadLimits limits;
+    EXPECT_TRUE(limits.Reject(Modbus::REG_INPUT, 100, 0));
+    limits.Accept(Modbus::REG_INPUT, 50, 0);
+
+    Modbus::TAdaptiveReadLimits restored;
+    restored.Set(limits.Get());
+    EXPECT_EQ(restored.GetMaxReadRegisters(Modbus::REG_INPUT), 75);
+    EXPECT_EQ(restored.GetMaxHole(Modbus::REG_INPUT), 10);
+    EXPECT_EQ(restored.GetMaxReadRegisters(Modbus::REG_HOLDING), 125);
+
+    restored.Set({});
+    EXPECT_EQ(restored.GetMaxReadRegisters(Modbus::REG_INPUT), 125);
+}
+
+TEST(ModbusAdaptiveReadLimitsTest, TimeoutsAreNotSaved)
+{
+    // A request could time out because of noise, so a limit learned by timeouts is kept only till restart
+    Modbus::TAdaptiveReadLimits limits;
+    EXPECT_TRUE(limits.Reject(Modbus::REG_INPUT, 100, 0, true));
+    limits.Accept(Modbus::REG_INPUT, 50, 0);
+    EXPECT_EQ(limits.GetMaxReadRegisters(Modbus::REG_INPUT), 75);
+
+    Modbus::TAdaptiveReadLimits restored;
+    restored.Set(limits.Get());
+    EXPECT_EQ(restored.GetMaxReadRegisters(Modbus::REG_INPUT), 125);
+
+    // The device answers with an exception, so the limit is saved
+    EXPECT_TRUE(limits.Reject(Modbus::REG_INPUT, 75, 0));
+    restored.Set(limits.Get());
+    EXPECT_EQ(restored.GetMaxReadRegisters(Modbus::REG_INPUT), 62);
+}
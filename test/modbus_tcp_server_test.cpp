@@ -0,0 +1,198 @@
+#include "modbus_common.h"
+#include "modbus_tcp_server.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    class TTestDevice: public TSerialDevice
+    {
+    public:
+        using TSerialDevice::TSerialDevice;
+
+        std::string ToString() const override
+        {
+            return "test";
+        }
+    };
+
+    typedef std::vector<uint8_t> TPdu;
+}
+
+class TModbusTcpServerTest: public testing::Test
+{
+protected:
+    std::chrono::steady_clock::time_point Now;
+    TModbusTcpServerConfig Config;
+    std::unique_ptr<TModbusTcpServer> Server;
+    PSerialDevice Device;
+    std::vector<std::pair<PRegister, uint64_t>> Writes;
+    int Fd = -1;
+    uint16_t TransactionId = 0;
+
+    void SetUp() override
+    {
+        Config.Port = 0;
+        Config.MaxValueAge = 1s;
+        Device = std::make_shared<TTestDevice>(std::make_shared<TDeviceConfig>("test", "5"), nullptr, nullptr);
+    }
+
+    void TearDown() override
+    {
+        if (Fd >= 0) {
+            close(Fd);
+        }
+        Server->Stop();
+    }
+
+    PRegister AddRegister(int type, uint32_t address, RegisterFormat format = U16)
+    {
+        return Device->AddRegister(TRegisterConfig::Create(type, address, format));
+    }
+
+    void Start(const std::vector<PSerialDevice>& otherPortDevices = {})
+    {
+        Server = std::make_unique<TModbusTcpServer>(Config, [this]() { return Now; });
+        auto writeFn = [this](PRegister reg, const TRegisterValue& value) {
+            Writes.emplace_back(reg, value.Get<uint64_t>());
+        };
+        Server->AddDevice(Device, "/dev/ttyRS485-1", writeFn);
+        for (const auto& device: otherPortDevices) {
+            Server->AddDevice(device, "/dev/ttyRS485-2", writeFn);
+        }
+        Server->Start();
+
+        Fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(Server->GetPort());
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        ASSERT_EQ(connect(Fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    }
+
+    TPdu Request(const TPdu& pdu, uint8_t unitId = 5)
+    {
+        ++TransactionId;
+        TPdu adu = {uint8_t(TransactionId >> 8),
+                    uint8_t(TransactionId),
+                    0,
+                    0,
+                    uint8_t((pdu.size() + 1) >> 8),
+                    uint8_t(pdu.size() + 1),
+                    unitId};
+        adu.insert(adu.end(), pdu.begin(), pdu.end());
+        EXPECT_EQ(write(Fd, adu.data(), adu.size()), ssize_t(adu.size()));
+
+        TPdu response;
+        uint8_t buf[300];
+        while (response.size() < 7 || response.size() < 6u + ((response[4] << 8) | response[5])) {
+            auto res = read(Fd, buf, sizeof(buf));
+            if (res <= 0) {
+                ADD_FAILURE() << "connection is closed";
+                return TPdu();
+            }
+            response.insert(response.end(), buf, buf + res);
+        }
+        EXPECT_EQ((response[0] << 8) | response[1], TransactionId);
+        EXPECT_EQ(response[6], unitId);
+        return TPdu(response.begin() + 7, response.end());
+    }
+};
+
+TEST_F(TModbusTcpServerTest, Read)
+{
+    auto holding = AddRegister(Modbus::REG_HOLDING, 0);
+    auto holding32 = AddRegister(Modbus::REG_HOLDING, 1, U32);
+    auto coil = AddRegister(Modbus::REG_COIL, 3);
+    Start();
+
+    // Not read yet
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x01}), TPdu({0x83, 0x0B}));
+
+    holding->SetValue(TRegisterValue(0x1234));
+    holding32->SetValue(TRegisterValue(0x56789ABC));
+    coil->SetValue(TRegisterValue(1));
+    for (const auto& reg: {holding, holding32, coil}) {
+        Server->UpdateRegister(reg);
+    }
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x03}), TPdu({0x03, 0x06, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC}));
+    EXPECT_EQ(Request({0x01, 0x00, 0x03, 0x00, 0x01}), TPdu({0x01, 0x01, 0x01}));
+
+    // Not configured registers
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x04}), TPdu({0x83, 0x02}));
+    EXPECT_EQ(Request({0x04, 0x00, 0x00, 0x00, 0x01}), TPdu({0x84, 0x02}));
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x01}, 6), TPdu({0x83, 0x0A}));
+
+    // Read error and too old value
+    holding->SetError(TRegister::TError::ReadError);
+    Server->UpdateRegister(holding);
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x01}), TPdu({0x83, 0x0B}));
+    Now += 2s;
+    EXPECT_EQ(Request({0x01, 0x00, 0x03, 0x00, 0x01}), TPdu({0x81, 0x0B}));
+}
+
+TEST_F(TModbusTcpServerTest, Write)
+{
+    auto holding = AddRegister(Modbus::REG_HOLDING, 0);
+    auto holding32 = AddRegister(Modbus::REG_HOLDING, 1, U32);
+    auto coil = AddRegister(Modbus::REG_COIL, 3);
+    auto readOnly = TRegisterConfig::Create(Modbus::REG_HOLDING, 10);
+    readOnly->AccessType = TRegisterConfig::EAccessType::READ_ONLY;
+    Device->AddRegister(readOnly);
+    Config.AllowWrites = true;
+    Start();
+
+    EXPECT_EQ(Request({0x10, 0x00, 0x00, 0x00, 0x03, 0x06, 0x00, 0x07, 0x00, 0x01, 0x00, 0x02}),
+              TPdu({0x10, 0x00, 0x00, 0x00, 0x03}));
+    EXPECT_EQ(Request({0x05, 0x00, 0x03, 0xFF, 0x00}), TPdu({0x05, 0x00, 0x03, 0xFF, 0x00}));
+    ASSERT_EQ(Writes.size(), 3);
+    EXPECT_EQ(Writes[0], std::make_pair(holding, uint64_t(7)));
+    EXPECT_EQ(Writes[1], std::make_pair(holding32, uint64_t(0x10002)));
+    EXPECT_EQ(Writes[2], std::make_pair(coil, uint64_t(1)));
+
+    // Part of a register, read-only and not configured registers can't be written
+    Writes.clear();
+    EXPECT_EQ(Request({0x06, 0x00, 0x01, 0x00, 0x01}), TPdu({0x86, 0x02}));
+    EXPECT_EQ(Request({0x06, 0x00, 0x0A, 0x00, 0x01}), TPdu({0x86, 0x02}));
+    EXPECT_EQ(Request({0x0F, 0x00, 0x03, 0x00, 0x02, 0x01, 0x03}), TPdu({0x8F, 0x02}));
+    EXPECT_TRUE(Writes.empty());
+
+    EXPECT_EQ(Request({0x2B, 0x0E, 0x01, 0x00}), TPdu({0xAB, 0x01}));
+}
+
+TEST_F(TModbusTcpServerTest, WritesAreNotAllowed)
+{
+    AddRegister(Modbus::REG_HOLDING, 0);
+    AddRegister(Modbus::REG_COIL, 3);
+    Start();
+
+    EXPECT_EQ(Request({0x06, 0x00, 0x00, 0x00, 0x01}), TPdu({0x86, 0x01}));
+    EXPECT_EQ(Request({0x10, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x01}), TPdu({0x90, 0x01}));
+    EXPECT_EQ(Request({0x05, 0x00, 0x03, 0xFF, 0x00}), TPdu({0x85, 0x01}));
+    EXPECT_EQ(Request({0x0F, 0x00, 0x03, 0x00, 0x01, 0x01, 0x01}), TPdu({0x8F, 0x01}));
+    EXPECT_TRUE(Writes.empty());
+}
+
+TEST_F(TModbusTcpServerTest, UnitIdOffsets)
+{
+    // Devices on different ports have the same slave id
+    auto holding = AddRegister(Modbus::REG_HOLDING, 0);
+    auto otherDevice =
+        std::make_shared<TTestDevice>(std::make_shared<TDeviceConfig>("other", "5"), nullptr, nullptr);
+    auto otherHolding = otherDevice->AddRegister(TRegisterConfig::Create(Modbus::REG_HOLDING, 0));
+    Config.UnitIdOffsets["/dev/ttyRS485-2"] = 100;
+    Start({otherDevice});
+
+    holding->SetValue(TRegisterValue(1));
+    otherHolding->SetValue(TRegisterValue(2));
+    Server->UpdateRegister(holding);
+    Server->UpdateRegister(otherHolding);
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x01}), TPdu({0x03, 0x02, 0x00, 0x01}));
+    EXPECT_EQ(Request({0x03, 0x00, 0x00, 0x00, 0x01}, 105), TPdu({0x03, 0x02, 0x00, 0x02}));
+}
@@ -1,6 +1,10 @@
+#include "crc16.h"
 #include "fake_serial_port.h"
 #include "modbus_common.h"
 
+#include <deque>
+#include <limits>
+
 namespace
 {
     class TPortMock: public TPort
@@ -59,6 +63,122 @@ namespace
             return std::string();
         }
     };
+
+    //! Modbus TCP slave answering write requests, W and R in Log are writes to the port and read responses
+    class TModbusTcpSlavePort: public TPort
+    {
+        std::deque<uint8_t> Stream;
+        size_t RequestsCount = 0;
+
+    public:
+        std::string Log;
+
+        //! Index of request without response
+        size_t LostResponse = std::numeric_limits<size_t>::max();
+
+        void Open() override
+        {}
+        void Close() override
+        {}
+        bool IsOpen() const override
+        {
+            return true;
+        }
+        void CheckPortOpen() const override
+        {}
+
+        void WriteBytes(const uint8_t* buf, int count) override
+        {
+            Log += "W";
+            for (auto end = buf + count; buf < end; buf += 6 + ((buf[4] << 8) | buf[5])) {
+                if (RequestsCount++ != LostResponse) {
+                    // MBAP with length of unit id and 5 bytes of write response PDU
+                    Stream.insert(Stream.end(), {buf[0], buf[1], 0, 0, 0, 6});
+                    Stream.insert(Stream.end(), buf + 6, buf + 12);
+                }
+            }
+        }
+
+        uint8_t ReadByte(const std::chrono::microseconds& timeout) override
+        {
+            return 0;
+        }
+
+        TReadFrameResult ReadFrame(uint8_t* buf,
+                                   size_t count,
+                                   const std::chrono::microseconds& responseTimeout,
+                                   const std::chrono::microseconds& frameTimeout,
+                                   TFrameCompletePred frame_complete = 0) override
+        {
+            if (Stream.empty()) {
+                throw TResponseTimeoutException();
+            }
+            TReadFrameResult res;
+            res.Count = std::min(count, Stream.size());
+            std::copy(Stream.begin(), Stream.begin() + res.Count, buf);
+            Stream.erase(Stream.begin(), Stream.begin() + res.Count);
+            if (res.Count > 6) {
+                Log += "R";
+            }
+            return res;
+        }
+
+        void SkipNoise() override
+        {}
+
+        void SleepSinceLastInteraction(const std::chrono::microseconds& us) override
+        {}
+
+        std::string GetDescription(bool verbose) const override
+        {
+            return std::string();
+        }
+    };
+
+    //! Port receiving a frame byte by byte, FrameTimeoutExpired is set if the frame is not recognized as complete
+    class TRtuFramePort: public TPortMock
+    {
+        std::vector<uint8_t> Frame;
+
+    public:
+        bool FrameTimeoutExpired = false;
+
+        TRtuFramePort(std::vector<uint8_t> frame): TPortMock(frame), Frame(frame)
+        {
+            auto crc = CRC16::CalculateCRC16(Frame.data(), Frame.size());
+            Frame.push_back(crc >> 8);
+            Frame.push_back(crc & 0xFF);
+        }
+
+        TReadFrameResult ReadFrame(uint8_t* buf,
+                                   size_t count,
+                                   const std::chrono::microseconds& responseTimeout,
+                                   const std::chrono::microseconds& frameTimeout,
+                                   TFrameCompletePred frame_complete = 0) override
+        {
+            TReadFrameResult res;
+            while (res.Count < std::min(count, Frame.size())) {
+                buf[res.Count] = Frame[res.Count];
+                ++res.Count;
+                if (frame_complete && frame_complete(buf, res.Count)) {
+                    return res;
+                }
+            }
+            FrameTimeoutExpired = (res.Count < count);
+            return res;
+        }
+    };
+
+    class TTestDevice: public TSerialDevice
+    {
+    public:
+        using TSerialDevice::TSerialDevice;
+
+        std::string ToString() const override
+        {
+            return "test";
+        }
+    };
 }
 
 class TModbusTCPTraitsTest: public testing::Test
@@ -199,3 +319,83 @@ TEST_F(TModbusTCPTraitsTest, ReadFrameTimeout)
 
     ASSERT_THROW(traits.ReadFrame(port, t, t, req, resp), TSerialDeviceTransientErrorException);
 }
+
+TEST_F(TModbusTCPTraitsTest, ReadFramePipelinedOutOfOrder)
+{
+    Modbus::TResponse resp2 = {0, 2, 0, 0, 0, 2, 100, 17};
+    Modbus::TResponse resp3 = {0, 3, 0, 0, 0, 2, 100, 18};
+    std::vector<uint8_t> r(resp3);
+    r.insert(r.end(), resp2.begin(), resp2.end());
+    TPortMock port(r);
+
+    Modbus::TModbusTCPTraits traits(std::make_shared<uint16_t>(1), 4);
+    ASSERT_EQ(traits.GetPipelineWindow(), 4);
+    std::chrono::milliseconds t(10);
+
+    Modbus::TRequest req2 = {0, 2, 0, 0, 0, 4, 100, 7, 8, 9};
+    Modbus::TRequest req3 = {0, 3, 0, 0, 0, 4, 100, 7, 8, 9};
+    Modbus::TRequest resp;
+
+    // Response to the later request is kept until it is requested
+    ASSERT_EQ(traits.ReadFrame(port, t, t, req2, resp).Count, 1);
+    TestEqual(resp, resp2);
+    ASSERT_EQ(traits.ReadFrame(port, t, t, req3, resp).Count, 1);
+    TestEqual(resp, resp3);
+
+    // Requests are sent one by one after out of order response
+    EXPECT_EQ(traits.GetPipelineWindow(), 1);
+}
+
+TEST(TModbusTCPPipeliningTest, WriteRegisters)
+{
+    auto port = std::make_shared<TModbusTcpSlavePort>();
+    auto device = std::make_shared<TTestDevice>(std::make_shared<TDeviceConfig>("test", "1"), port, nullptr);
+    std::vector<TRegisterWrite> writes;
+    for (uint32_t addr: {0, 2, 4, 6, 8}) {
+        writes.push_back({device->AddRegister(TRegister::Create(Modbus::REG_HOLDING, addr)), TRegisterValue(addr)});
+    }
+    Modbus::TModbusTCPTraits traits(std::make_shared<uint16_t>(0), 3);
+    Modbus::TRegisterCache cache;
+
+    EXPECT_EQ(Modbus::WriteRegisters(traits, *port, 1, writes, cache, [](const TRegisterWrite& write) {
+                  EXPECT_FALSE(write.Error);
+              }),
+              5);
+    // Three requests are sent together before reading responses
+    EXPECT_EQ(port->Log, "WRRRWRR");
+
+    // Lost response disables pipelining
+    port->Log.clear();
+    port->LostResponse = 6;
+    std::vector<PRegister> failed;
+    Modbus::WriteRegisters(traits, *port, 1, writes, cache, [&](const TRegisterWrite& write) {
+        if (write.Error) {
+            failed.push_back(write.Register);
+        }
+    });
+    EXPECT_EQ(port->Log, "WRRWRWR");
+    EXPECT_EQ(failed, std::vector<PRegister>({writes[1].Register}));
+    EXPECT_EQ(traits.GetPipelineWindow(), 1);
+}
+
+TEST(TModbusRTUTraitsTest, ReadFrameInfersSizeFromFunctionCode)
+{
+    Modbus::TModbusRTUTraits traits;
+    std::chrono::milliseconds t(10);
+    Modbus::TRequest req = {1, 3, 0, 0, 0, 2, 0, 0};
+
+    // Expected response for 2 registers, but the device answers with 1 register
+    TRtuFramePort shortPort({1, 3, 2, 0, 7});
+    Modbus::TResponse resp(traits.GetPacketSize(6));
+    EXPECT_EQ(traits.ReadFrame(shortPort, t, t, req, resp).Count, 4);
+    EXPECT_FALSE(shortPort.FrameTimeoutExpired);
+
+    TRtuFramePort exceptionPort({1, 0x83, 2});
+    EXPECT_EQ(traits.ReadFrame(exceptionPort, t, t, req, resp).Count, 2);
+    EXPECT_FALSE(exceptionPort.FrameTimeoutExpired);
+
+    // Unknown function code, the frame is completed by frame timeout
+    TRtuFramePort unknownPort({1, 0x41, 2, 0, 7});
+    EXPECT_EQ(traits.ReadFrame(unknownPort, t, t, req, resp).Count, 4);
+    EXPECT_TRUE(unknownPort.FrameTimeoutExpired);
+}
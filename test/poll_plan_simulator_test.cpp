@@ -0,0 +1,199 @@
+#include <wblib/testing/testlog.h>
+
+#include "poll_plan_simulator.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std::chrono_literals;
+using WBMQTT::Testing::TLoggedFixture;
+
+class TPollPlanSimulatorTest: public testing::Test
+{
+protected:
+    TSerialDeviceFactory DeviceFactory;
+
+    void SetUp() override
+    {
+        RegisterProtocols(DeviceFactory);
+    }
+
+    std::vector<TSimulatedPortStats> Simulate(const std::string& configPath,
+                                              std::chrono::seconds duration,
+                                              const std::set<uint8_t>& disconnectedSlaveIds = std::set<uint8_t>())
+    {
+        auto commonDeviceSchema(
+            WBMQTT::JSON::Parse(TLoggedFixture::GetDataFilePath("../wb-mqtt-serial-confed-common.schema.json")));
+        TTemplateMap templateMap(
+            LoadConfigTemplatesSchema(TLoggedFixture::GetDataFilePath("../wb-mqtt-serial-device-template.schema.json"),
+                                      commonDeviceSchema));
+        auto portsSchema(WBMQTT::JSON::Parse(TLoggedFixture::GetDataFilePath("../wb-mqtt-serial-ports.schema.json")));
+        TProtocolConfedSchemasMap protocolSchemas(TLoggedFixture::GetDataFilePath("../protocols"), commonDeviceSchema);
+
+        TPollPlanSimulator::TSettings settings;
+        settings.Duration = duration;
+        settings.DisconnectedSlaveIds = disconnectedSlaveIds;
+        TPollPlanSimulator simulator(settings);
+        auto config = LoadConfig(TLoggedFixture::GetDataFilePath(configPath),
+                                 DeviceFactory,
+                                 commonDeviceSchema,
+                                 templateMap,
+                                 std::make_shared<TRPCConfig>(),
+                                 portsSchema,
+                                 protocolSchemas,
+                                 simulator.GetPortFactory());
+        return simulator.Run(*config);
+    }
+};
+
+TEST_F(TPollPlanSimulatorTest, Capacity)
+{
+    auto stats = Simulate("configs/config-simulator-test.json", 30s);
+    ASSERT_EQ(stats.size(), 2);
+
+    // Fast port has enough capacity for all registers
+    const auto& fastPort = stats[0];
+    EXPECT_GE(fastPort.SimulationTime, 30s);
+    EXPECT_LT(fastPort.GetUtilization(), 0.5);
+    EXPECT_EQ(fastPort.TimeoutsCount, 0);
+    ASSERT_EQ(fastPort.Registers.size(), 2);
+    for (const auto& reg: fastPort.Registers) {
+        EXPECT_GT(reg.ReadCount, 290) << reg.Register->ToString();
+        EXPECT_EQ(reg.PollIntervalMissCount, 0) << reg.Register->ToString();
+        EXPECT_NEAR(std::chrono::duration_cast<std::chrono::milliseconds>(reg.GetAveragePeriod()).count(), 100, 5)
+            << reg.Register->ToString();
+    }
+    EXPECT_TRUE(fastPort.GetStarvedRegisters().empty());
+
+    // Slow port can't poll all registers with requested period
+    const auto& slowPort = stats[1];
+    EXPECT_GT(slowPort.GetUtilization(), 0.9);
+    EXPECT_EQ(slowPort.TimeoutsCount, 0);
+    ASSERT_EQ(slowPort.Registers.size(), 25);
+    size_t misses = 0;
+    for (const auto& reg: slowPort.Registers) {
+        if (reg.Register->ReadPeriod) {
+            EXPECT_GT(reg.GetAveragePeriod(), 100ms) << reg.Register->ToString();
+        }
+        misses += reg.PollIntervalMissCount;
+    }
+    EXPECT_GT(misses, 0);
+}
+
+TEST_F(TPollPlanSimulatorTest, Report)
+{
+    auto stats = Simulate("configs/config-simulator-test.json", 1s);
+    std::stringstream report;
+    PrintSimulationReport(report, stats);
+    EXPECT_NE(report.str().find("Port /dev/ttySIM0"), std::string::npos);
+    EXPECT_NE(report.str().find("Port /dev/ttySIM1"), std::string::npos);
+    EXPECT_NE(report.str().find("bus utilization"), std::string::npos);
+}
+
+TEST_F(TPollPlanSimulatorTest, BusTimeWeight)
+{
+    auto stats = Simulate("configs/config-simulator-bus-time-weight-test.json", 30s);
+    ASSERT_EQ(stats.size(), 1);
+
+    // Both devices can't be polled with requested period, bus time is shared according to weights 3:1
+    const auto& port = stats[0];
+    EXPECT_GT(port.GetUtilization(), 0.9);
+    ASSERT_EQ(port.DevicesBusyTime.size(), 2);
+    for (const auto& device: port.DevicesBusyTime) {
+        if (device.first->DeviceConfig()->BusTimeWeight == 3) {
+            EXPECT_NEAR(port.GetBusTimeShare(device.first), 0.75, 0.1) << device.first->ToString();
+        } else {
+            EXPECT_NEAR(port.GetBusTimeShare(device.first), 0.25, 0.1) << device.first->ToString();
+        }
+    }
+}
+
+TEST_F(TPollPlanSimulatorTest, AlarmPriorityClass)
+{
+    auto stats = Simulate("configs/config-simulator-priority-classes-test.json", 30s);
+    ASSERT_EQ(stats.size(), 1);
+
+    // Alarm channel is polled with default latency target of the class while bulk channels use the rest of bus time
+    const auto& port = stats[0];
+    EXPECT_GT(port.GetUtilization(), 0.9);
+    ASSERT_EQ(port.Registers.size(), 31);
+    for (const auto& reg: port.Registers) {
+        if (reg.Register->GetPriority() == TPriority::Alarm) {
+            EXPECT_NEAR(std::chrono::duration_cast<std::chrono::milliseconds>(reg.GetAveragePeriod()).count(), 100, 5);
+            EXPECT_LT(reg.MaxPeriod, 150ms);
+            EXPECT_EQ(reg.PollIntervalMissCount, 0);
+        } else {
+            EXPECT_GT(reg.ReadCount, 10) << reg.Register->ToString();
+        }
+    }
+}
+
+TEST_F(TPollPlanSimulatorTest, PollLookahead)
+{
+    auto stats = Simulate("configs/config-simulator-poll-lookahead-test.json", 30s);
+    ASSERT_EQ(stats.size(), 2);
+
+    // Adjacent registers with different periods are read by separate requests without look-ahead
+    // and together with look-ahead, all of them are still read not less often than requested
+    const auto& port = stats[0];
+    const auto& lookaheadPort = stats[1];
+    EXPECT_LT(lookaheadPort.RequestsCount * 2, port.RequestsCount);
+    for (const auto& portStats: stats) {
+        ASSERT_EQ(portStats.Registers.size(), 10);
+        for (const auto& reg: portStats.Registers) {
+            EXPECT_EQ(reg.PollIntervalMissCount, 0) << reg.Register->ToString();
+            EXPECT_LE(std::chrono::duration_cast<std::chrono::milliseconds>(reg.GetAveragePeriod()),
+                      *reg.Register->ReadPeriod + 5ms)
+                << reg.Register->ToString();
+        }
+    }
+}
+
+TEST_F(TPollPlanSimulatorTest, PollPhases)
+{
+    auto stats = Simulate("configs/config-simulator-poll-phases-test.json", 5s);
+    ASSERT_EQ(stats.size(), 1);
+
+    // First reads of devices registers are spread over read period,
+    // registers of the same device are read one after another
+    std::map<PSerialDevice, std::vector<std::chrono::steady_clock::time_point>> firstReads;
+    for (const auto& reg: stats[0].Registers) {
+        ASSERT_GT(reg.ReadCount, 0) << reg.Register->ToString();
+        EXPECT_EQ(reg.PollIntervalMissCount, 0) << reg.Register->ToString();
+        firstReads[reg.Register->Device()].push_back(reg.FirstReadTime);
+    }
+    ASSERT_EQ(firstReads.size(), 4);
+    std::vector<std::chrono::steady_clock::time_point> devicesFirstReads;
+    for (const auto& device: firstReads) {
+        ASSERT_EQ(device.second.size(), 2);
+        auto firstRead = std::min(device.second[0], device.second[1]);
+        auto lastRead = std::max(device.second[0], device.second[1]);
+        EXPECT_LT(lastRead - firstRead, 10ms) << device.first->ToString();
+        devicesFirstReads.push_back(firstRead);
+    }
+    std::sort(devicesFirstReads.begin(), devicesFirstReads.end());
+    for (size_t i = 1; i < devicesFirstReads.size(); ++i) {
+        EXPECT_NEAR(std::chrono::duration_cast<std::chrono::milliseconds>(devicesFirstReads[i] - devicesFirstReads[i - 1])
+                        .count(),
+                    250,
+                    10);
+    }
+}
+
+TEST_F(TPollPlanSimulatorTest, DisconnectedDeviceProbes)
+{
+    auto stats = Simulate("configs/config-simulator-disconnected-test.json", 60s, {2});
+    ASSERT_EQ(stats.size(), 2);
+
+    // Disconnected device is probed with growing interval and takes much less bus time from connected one
+    const auto& port = stats[0];
+    const auto& probePort = stats[1];
+    EXPECT_GT(port.DisconnectedDevicesBusTime, 20s);
+    EXPECT_LT(probePort.DisconnectedDevicesBusTime * 3, port.DisconnectedDevicesBusTime);
+    for (size_t i = 0; i < port.Registers.size(); ++i) {
+        if (port.Registers[i].Register->ReadPeriod) {
+            EXPECT_GT(probePort.Registers[i].ReadCount, port.Registers[i].ReadCount)
+                << probePort.Registers[i].Register->ToString();
+        }
+    }
+}
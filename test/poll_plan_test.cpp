@@ -1,6 +1,12 @@
+#include "modbus_common.h"
 #include "poll_plan.h"
+#include "pollable_device.h"
 #include "gtest/gtest.h"
+#include <algorithm>
 #include <chrono>
+#include <iostream>
+#include <map>
+#include <queue>
 #include <vector>
 
 using namespace std::chrono_literals;
@@ -97,15 +103,162 @@ TEST(PollPlanTest, PriorityQueueSchedule)
     EXPECT_FALSE(schedule.HasReadyItems(std::chrono::steady_clock::now()));
 }
 
-TEST(PollPlanTest, RateLimiter)
+TEST(PollPlanTest, PriorityQueueScheduleReschedule)
 {
-    TRateLimiter limiter(2);
-    limiter.NewItem(std::chrono::steady_clock::now());
-    EXPECT_FALSE(limiter.IsOverLimit(std::chrono::steady_clock::now()));
-    limiter.NewItem(std::chrono::steady_clock::now());
-    EXPECT_FALSE(limiter.IsOverLimit(std::chrono::steady_clock::now()));
-    limiter.NewItem(std::chrono::steady_clock::now());
-    EXPECT_TRUE(limiter.IsOverLimit(std::chrono::steady_clock::now()));
+    auto now = std::chrono::steady_clock::now();
+    TPriorityQueueSchedule<int, std::less<int>> schedule;
+    for (int i = 0; i < 10; ++i) {
+        schedule.AddEntry(i, now + std::chrono::milliseconds(i));
+    }
+    EXPECT_EQ(10, schedule.Size());
+    EXPECT_TRUE(schedule.Contains(5));
+    EXPECT_FALSE(schedule.Contains(10));
+
+    // Move entry to the head and to the tail of schedule
+    schedule.AddEntry(7, now - 1ms);
+    schedule.AddEntry(0, now + 100ms);
+    EXPECT_EQ(10, schedule.Size());
+
+    EXPECT_TRUE(schedule.Remove(3));
+    EXPECT_FALSE(schedule.Remove(3));
+    EXPECT_FALSE(schedule.Contains(3));
+
+    std::vector<int> order;
+    while (!schedule.IsEmpty()) {
+        order.push_back(schedule.GetTop().Data);
+        schedule.Pop();
+    }
+    EXPECT_EQ(std::vector<int>({7, 1, 2, 4, 5, 6, 8, 9, 0}), order);
+    EXPECT_FALSE(schedule.Contains(7));
+}
+
+TEST(PollPlanTest, PriorityQueueScheduleEqualDeadlines)
+{
+    auto now = std::chrono::steady_clock::now();
+    TPriorityQueueSchedule<int, std::less<int>> schedule;
+    std::priority_queue<TPriorityQueueSchedule<int, std::less<int>>::TItem> reference;
+    for (int i = 0; i < 20; ++i) {
+        auto deadline = now + std::chrono::milliseconds(i % 3);
+        schedule.AddEntry(i, deadline);
+        reference.push({i, deadline});
+    }
+    while (!reference.empty()) {
+        ASSERT_FALSE(schedule.IsEmpty());
+        EXPECT_EQ(reference.top().Data, schedule.GetTop().Data);
+        reference.pop();
+        schedule.Pop();
+    }
+    EXPECT_TRUE(schedule.IsEmpty());
+}
+
+namespace
+{
+    //! Previous implementation of TPriorityQueueSchedule with linear Contains
+    class TLinearContainsSchedule
+    {
+        using TItem = TPriorityQueueSchedule<int, std::less<int>>::TItem;
+
+        class TQueue: public std::priority_queue<TItem>
+        {
+        public:
+            bool Contains(int entry) const
+            {
+                return std::find_if(c.cbegin(), c.cend(), [&](const TItem& item) { return item.Data == entry; }) !=
+                       c.cend();
+            }
+        };
+
+        TQueue Entries;
+
+    public:
+        void AddEntry(int entry, std::chrono::steady_clock::time_point deadline)
+        {
+            Entries.push({entry, deadline});
+        }
+
+        bool Contains(int entry) const
+        {
+            return Entries.Contains(entry);
+        }
+
+        bool IsEmpty() const
+        {
+            return Entries.empty();
+        }
+
+        void Pop()
+        {
+            Entries.pop();
+        }
+    };
+
+    //! Schedules half of entries and then reschedules all of them like TPollableDevice::RescheduleAllRegisters
+    template<class TSchedule> std::chrono::microseconds RescheduleAll(size_t count)
+    {
+        TSchedule schedule;
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i += 2) {
+            schedule.AddEntry(i, now + std::chrono::microseconds(i));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            if (!schedule.Contains(i)) {
+                schedule.AddEntry(i, now);
+            }
+        }
+        while (!schedule.IsEmpty()) {
+            schedule.Pop();
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    }
+
+    //! Polls all entries with the same period several times like TPollableDevice does
+    template<class TSchedule, class TEntry> std::chrono::microseconds PollAll(const std::vector<TEntry>& entries)
+    {
+        const size_t POLL_CYCLES = 50;
+        TSchedule schedule;
+        auto now = std::chrono::steady_clock::time_point();
+        for (size_t i = 0; i < entries.size(); ++i) {
+            schedule.AddEntry(entries[i], now + std::chrono::milliseconds(i % 10));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < entries.size() * POLL_CYCLES; ++i) {
+            auto item = schedule.GetTop();
+            schedule.Pop();
+            schedule.AddEntry(item.Data, item.Deadline + std::chrono::milliseconds(10));
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(PollPlanTest, DISABLED_PriorityQueueScheduleBenchmark)
+{
+    for (size_t count: {100, 1000, 10000}) {
+        auto linear = RescheduleAll<TLinearContainsSchedule>(count);
+        auto indexed = RescheduleAll<TPriorityQueueSchedule<int, std::less<int>>>(count);
+        std::cout << count << " entries: linear " << linear.count() << "us, indexed " << indexed.count() << "us"
+                  << std::endl;
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(PollPlanTest, DISABLED_RegisterScheduleBenchmark)
+{
+    for (size_t count: {1000, 20000}) {
+        std::vector<PRegister> registers;
+        std::vector<TScheduledRegister> entries;
+        for (size_t i = 0; i < count; ++i) {
+            registers.push_back(std::make_shared<TRegister>(nullptr, TRegister::Create(Modbus::REG_HOLDING, i)));
+            entries.push_back(TScheduledRegister{static_cast<uint32_t>(i), static_cast<uint32_t>(i)});
+        }
+        auto byRegister = PollAll<TPriorityQueueSchedule<PRegister, TRegisterComparePredicate>>(registers);
+        auto byIndex =
+            PollAll<TPriorityQueueSchedule<TScheduledRegister, TScheduledRegisterComparePredicate, TScheduledRegisterHash>>(
+                entries);
+        std::cout << count << " registers: PRegister entries " << byRegister.count() << "us, indexed entries "
+                  << byIndex.count() << "us" << std::endl;
+    }
 }
 
 TEST(PollPlanTest, OneHighPriority)
@@ -253,3 +406,126 @@ TEST(PollPlanTest, LotsOfHighAndRareLow)
         now += 1ms;
     }
 }
+
+TEST(PollPlanTest, AlarmPriority)
+{
+    // Alarm items are selected first until they get more than 1 - (High + Low) share of time
+
+    auto init = std::chrono::steady_clock::time_point();
+    for (const auto& shares: {TPriorityShares(), TPriorityShares{0.1, 0.1}}) {
+        TScheduler<int, std::less<int>> scheduler(5ms, shares);
+        scheduler.AddEntry(1, init, TPriority::Alarm);
+        scheduler.AddEntry(2, init, TPriority::High);
+        scheduler.AddEntry(3, init, TPriority::Low);
+        Accumulator accumulator;
+
+        // Alarm is selected first
+        auto now = init + 1ms;
+        TakeHighPriorityItem(scheduler, now, accumulator, 1);
+        scheduler.UpdateSelectionTime(3ms, TPriority::Alarm);
+        scheduler.AddEntry(1, now, TPriority::Alarm);
+
+        std::map<int, std::chrono::milliseconds> selectionTime;
+        for (size_t i = 0; i < 1000; ++i) {
+            now += 3ms;
+            accumulator.Data.clear();
+            scheduler.AccumulateNext(now, accumulator, TItemSelectionPolicy::All);
+            ASSERT_EQ(accumulator.Data.size(), 1);
+            auto item = std::get<0>(accumulator.Data[0]);
+            auto priority = (item == 1) ? TPriority::Alarm : ((item == 2) ? TPriority::High : TPriority::Low);
+            scheduler.UpdateSelectionTime(3ms, priority);
+            scheduler.AddEntry(item, now, priority);
+            selectionTime[item] += 3ms;
+        }
+        auto alarmShare = 1 - shares.High - shares.Low;
+        EXPECT_NEAR(selectionTime[1].count() / 3000.0, alarmShare, 0.05);
+        EXPECT_NEAR(selectionTime[2].count() / 3000.0, (1 - alarmShare) / 2, 0.05);
+        EXPECT_NEAR(selectionTime[3].count() / 3000.0, (1 - alarmShare) / 2, 0.05);
+    }
+}
+
+TEST(PollPlanTest, LowPriorityShare)
+{
+    // Low priority items get Low / (High + Low) share of time, if high priority items are always ready
+
+    auto init = std::chrono::steady_clock::time_point();
+    TScheduler<int, std::less<int>> scheduler(5ms, TPriorityShares{0.6, 0.2});
+    scheduler.AddEntry(1, init, TPriority::High);
+    scheduler.AddEntry(2, init, TPriority::Low);
+    Accumulator accumulator;
+
+    auto now = init;
+    std::map<int, std::chrono::milliseconds> selectionTime;
+    for (size_t i = 0; i < 1000; ++i) {
+        now += 2ms;
+        accumulator.Data.clear();
+        scheduler.AccumulateNext(now, accumulator, TItemSelectionPolicy::All);
+        ASSERT_EQ(accumulator.Data.size(), 1);
+        auto item = std::get<0>(accumulator.Data[0]);
+        auto priority = (item == 1) ? TPriority::High : TPriority::Low;
+        scheduler.UpdateSelectionTime(2ms, priority);
+        scheduler.AddEntry(item, now, priority);
+        selectionTime[item] += 2ms;
+    }
+    EXPECT_NEAR(selectionTime[2].count() / 2000.0, 0.25, 0.05);
+}
+
+TEST(PollPlanTest, LowPriorityShareOfShortReads)
+{
+    // Scaled time of reads shorter than a millisecond is not rounded up, so shares are kept
+
+    auto init = std::chrono::steady_clock::time_point();
+    TScheduler<int, std::less<int>> scheduler(5ms, TPriorityShares{0.6, 0.2});
+    scheduler.AddEntry(1, init, TPriority::High);
+    scheduler.AddEntry(2, init, TPriority::Low);
+    Accumulator accumulator;
+
+    auto now = init;
+    std::map<int, size_t> selectionCount;
+    for (size_t i = 0; i < 1000; ++i) {
+        now += 300us;
+        accumulator.Data.clear();
+        scheduler.AccumulateNext(now, accumulator, TItemSelectionPolicy::All);
+        ASSERT_EQ(accumulator.Data.size(), 1);
+        auto item = std::get<0>(accumulator.Data[0]);
+        auto priority = (item == 1) ? TPriority::High : TPriority::Low;
+        scheduler.UpdateSelectionTime(300us, priority);
+        scheduler.AddEntry(item, now, priority);
+        ++selectionCount[item];
+    }
+    EXPECT_NEAR(selectionCount[2] / 1000.0, 0.25, 0.05);
+}
+
+TEST(PollPlanTest, DeficitRoundRobin)
+{
+    TDeficitRoundRobin<int> drr(100ms);
+    drr.SetWeight(1, 1);
+    drr.SetWeight(2, 3);
+
+    EXPECT_TRUE(drr.HasCredit(1));
+    EXPECT_TRUE(drr.HasCredit(2));
+    EXPECT_TRUE(drr.HasCredit(3));
+
+    // Slow client spends much more than its credit
+    drr.Spend(1, 450ms);
+    EXPECT_FALSE(drr.HasCredit(1));
+    drr.Spend(2, 300ms);
+    EXPECT_FALSE(drr.HasCredit(2));
+    EXPECT_DOUBLE_EQ(drr.GetShare(1), 0.6);
+    EXPECT_DOUBLE_EQ(drr.GetShare(2), 0.4);
+    EXPECT_DOUBLE_EQ(drr.GetShare(3), 0);
+
+    // Rounds are started until client 2 gets credit
+    drr.NextRound(std::vector<int>{1, 2});
+    EXPECT_FALSE(drr.HasCredit(1));
+    EXPECT_TRUE(drr.HasCredit(2));
+
+    // Client 1 gets credit, unused credit of client 2 is not accumulated
+    drr.NextRound(std::vector<int>{1});
+    EXPECT_TRUE(drr.HasCredit(1));
+    drr.Spend(2, 301ms);
+    EXPECT_FALSE(drr.HasCredit(2));
+
+    drr.ResetShares();
+    EXPECT_DOUBLE_EQ(drr.GetShare(1), 0);
+}
@@ -0,0 +1,281 @@
+#include "binary_semaphore.h"
+#include "port_reactor.h"
+#include "tcp_port.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+class TPortReactorTest: public testing::Test
+{
+protected:
+    int Fds[2] = {-1, -1};
+    TPortReactor Reactor{"test"};
+
+    void SetUp() override
+    {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, Fds), 0);
+    }
+
+    void TearDown() override
+    {
+        close(Fds[0]);
+        close(Fds[1]);
+    }
+};
+
+TEST_F(TPortReactorTest, WaitForFd)
+{
+    int res = -1;
+    microseconds waitTime;
+    int timeoutRes = -1;
+    microseconds timeoutWaitTime;
+    bool written = false;
+
+    Reactor.AddLoop([&]() {
+        auto start = steady_clock::now();
+        timeoutRes = WaitForFd(Fds[1], POLLIN, 20ms);
+        timeoutWaitTime = duration_cast<microseconds>(steady_clock::now() - start);
+
+        start = steady_clock::now();
+        res = WaitForFd(Fds[0], POLLIN, 5s);
+        waitTime = duration_cast<microseconds>(steady_clock::now() - start);
+        Reactor.Stop();
+    });
+    // The second loop runs while the first one waits
+    Reactor.AddLoop([&]() {
+        if (!written) {
+            SleepFor(50ms);
+            uint8_t byte = 1;
+            ASSERT_EQ(write(Fds[1], &byte, 1), 1);
+            written = true;
+        }
+        SleepFor(1ms);
+    });
+    Reactor.Run();
+
+    EXPECT_EQ(timeoutRes, 0);
+    EXPECT_GE(timeoutWaitTime, 20ms);
+    EXPECT_EQ(res, 1);
+    EXPECT_LT(waitTime, 1s);
+    EXPECT_FALSE(TPortReactor::InFiber());
+}
+
+TEST_F(TPortReactorTest, BinarySemaphore)
+{
+    TBinarySemaphore semaphore;
+    auto signal = semaphore.MakeSignal();
+    bool signaled = false;
+    microseconds waitTime;
+
+    Reactor.AddLoop([&]() {
+        auto start = steady_clock::now();
+        signaled = semaphore.Wait(start + 5s) && semaphore.GetSignalValue(signal);
+        waitTime = duration_cast<microseconds>(steady_clock::now() - start);
+        Reactor.Stop();
+    });
+    std::thread signalThread([&]() {
+        std::this_thread::sleep_for(20ms);
+        semaphore.Signal(signal);
+    });
+    Reactor.Run();
+    signalThread.join();
+
+    EXPECT_TRUE(signaled);
+    EXPECT_LT(waitTime, 1s);
+}
+
+TEST_F(TPortReactorTest, ExceptionStopsLoops)
+{
+    size_t cycles = 0;
+    bool completed = false;
+
+    Reactor.AddLoop([&]() {
+        SleepFor(10ms);
+        throw std::runtime_error("test");
+    });
+    // The second loop completes its cycle after the error
+    Reactor.AddLoop([&]() {
+        ++cycles;
+        SleepFor(50ms);
+        completed = true;
+    });
+
+    EXPECT_FALSE(Reactor.Run());
+    EXPECT_EQ(cycles, 1);
+    EXPECT_TRUE(completed);
+}
+
+namespace
+{
+    const size_t BENCHMARK_PORTS_COUNT = 200;
+
+    //! Answers Modbus TCP requests to all listeners with a single register value
+    void ServeSlaves(const std::vector<int>& listeners, const std::atomic<bool>& active)
+    {
+        int epollFd = epoll_create1(0);
+        for (int listener: listeners) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = (uint64_t(1) << 32) | listener;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, listener, &ev);
+        }
+        epoll_event events[256];
+        while (active) {
+            auto count = epoll_wait(epollFd, events, 256, 100);
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.u64 & 0xFFFFFFFF;
+                if (events[i].data.u64 >> 32) {
+                    epoll_event ev{};
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = accept(fd, nullptr, nullptr);
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, ev.data.u64, &ev);
+                    continue;
+                }
+                uint8_t request[256];
+                auto size = read(fd, request, sizeof(request));
+                if (size <= 0) {
+                    close(fd);
+                    continue;
+                }
+                for (ssize_t offset = 0; offset + 12 <= size; offset += 12) {
+                    uint8_t response[11] =
+                        {request[offset], request[offset + 1], 0, 0, 0, 5, request[offset + 6], 3, 2, 0, 1};
+                    if (write(fd, response, sizeof(response)) < 0) {
+                        break;
+                    }
+                }
+            }
+        }
+        close(epollFd);
+    }
+
+    std::string GetProcessStatus(const std::string& key)
+    {
+        std::ifstream file("/proc/self/status");
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.rfind(key, 0) == 0) {
+                return line;
+            }
+        }
+        return std::string();
+    }
+
+    double GetCpuTime()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    //! Poll local TCP slaves by a thread per port (threadsCount == 0) or by reactors
+    void PollSlaves(size_t threadsCount)
+    {
+        std::vector<int> listeners;
+        std::vector<std::shared_ptr<TTcpPort>> ports;
+        for (size_t i = 0; i < BENCHMARK_PORTS_COUNT; ++i) {
+            int listener = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+            ASSERT_EQ(listen(listener, 4), 0);
+            socklen_t addrSize = sizeof(addr);
+            getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addrSize);
+            listeners.push_back(listener);
+            ports.push_back(std::make_shared<TTcpPort>(TTcpPortSettings("127.0.0.1", ntohs(addr.sin_port))));
+        }
+        std::atomic<bool> slavesActive{true};
+        std::thread slaves([&]() { ServeSlaves(listeners, slavesActive); });
+
+        std::atomic<bool> active{true};
+        std::atomic<uint64_t> requestsCount{0};
+        std::vector<TBinarySemaphore> semaphores(BENCHMARK_PORTS_COUNT);
+        std::vector<uint16_t> transactionIds(BENCHMARK_PORTS_COUNT);
+        auto cycle = [&](size_t i) {
+            try {
+                if (!ports[i]->IsOpen() && !ports[i]->TryOpen()) {
+                    return;
+                }
+                auto id = ++transactionIds[i];
+                uint8_t request[12] = {uint8_t(id >> 8), uint8_t(id), 0, 0, 0, 6, 1, 3, 0, 0, 0, 1};
+                ports[i]->WriteBytes(request, sizeof(request));
+                uint8_t response[11];
+                ports[i]->ReadFrame(response, sizeof(response), 500ms, 20ms);
+                ++requestsCount;
+            } catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
+            // Poll interval, TSerialClient waits for writes the same way
+            semaphores[i].Wait(steady_clock::now() + 10ms);
+        };
+
+        std::vector<std::thread> threads;
+        std::vector<PPortReactor> reactors;
+        auto cpuStart = GetCpuTime();
+        auto start = steady_clock::now();
+        if (threadsCount == 0) {
+            for (size_t i = 0; i < BENCHMARK_PORTS_COUNT; ++i) {
+                threads.emplace_back([&, i]() {
+                    while (active) {
+                        cycle(i);
+                    }
+                });
+            }
+        } else {
+            for (size_t i = 0; i < threadsCount; ++i) {
+                reactors.push_back(std::make_shared<TPortReactor>("benchmark"));
+            }
+            for (size_t i = 0; i < BENCHMARK_PORTS_COUNT; ++i) {
+                reactors[i % threadsCount]->AddLoop([&, i]() { cycle(i); });
+            }
+            for (const auto& reactor: reactors) {
+                threads.emplace_back([reactor]() { reactor->Run(); });
+            }
+        }
+        std::this_thread::sleep_for(3s);
+        auto threadsStatus = GetProcessStatus("Threads");
+        auto rssStatus = GetProcessStatus("VmRSS");
+        auto sizeStatus = GetProcessStatus("VmSize");
+        std::this_thread::sleep_for(2s);
+        active = false;
+        for (const auto& reactor: reactors) {
+            reactor->Stop();
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        double duration = std::chrono::duration<double>(steady_clock::now() - start).count();
+        auto cpuTime = GetCpuTime() - cpuStart;
+
+        slavesActive = false;
+        slaves.join();
+        for (int listener: listeners) {
+            close(listener);
+        }
+
+        std::cout << (threadsCount ? std::to_string(threadsCount) + " reactor thread(s)" : "thread per port") << ": "
+                  << requestsCount / duration << " req/s, cpu " << cpuTime / duration * 100 << "%, " << threadsStatus
+                  << ", " << rssStatus << ", " << sizeStatus << std::endl;
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(TPortReactorBenchmarkTest, DISABLED_TcpPortsBenchmark)
+{
+    for (size_t threadsCount: {0, 1, 2}) {
+        PollSlaves(threadsCount);
+    }
+}
@@ -0,0 +1,110 @@
+#include "register_handler.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace
+{
+    std::vector<PRegisterHandler> CreateHandlers(size_t count, TPendingWritesQueue& queue)
+    {
+        std::vector<PRegisterHandler> res;
+        for (size_t i = 0; i < count; ++i) {
+            auto reg = std::make_shared<TRegister>(nullptr, TRegister::Create(0, i));
+            res.push_back(std::make_shared<TRegisterHandler>(nullptr, reg, queue));
+        }
+        return res;
+    }
+}
+
+TEST(TPendingWritesQueueTest, Order)
+{
+    TPendingWritesQueue queue;
+    auto handlers = CreateHandlers(3, queue);
+    EXPECT_TRUE(queue.Empty());
+
+    queue.Push(handlers[1].get());
+    queue.Push(handlers[0].get());
+    queue.Push(handlers[1].get());
+    queue.Push(handlers[2].get());
+    EXPECT_FALSE(queue.Empty());
+    EXPECT_EQ(queue.PopAll(),
+              std::vector<TRegisterHandler*>({handlers[1].get(), handlers[0].get(), handlers[2].get()}));
+    EXPECT_TRUE(queue.Empty());
+
+    // Popped handlers can be pushed again
+    queue.Push(handlers[1].get());
+    EXPECT_EQ(queue.PopAll(), std::vector<TRegisterHandler*>({handlers[1].get()}));
+}
+
+TEST(TPendingWritesQueueTest, ConcurrentPush)
+{
+    const size_t HANDLERS_COUNT = 100;
+    const size_t THREADS_COUNT = 4;
+    TPendingWritesQueue queue;
+    auto handlers = CreateHandlers(HANDLERS_COUNT, queue);
+
+    std::vector<size_t> popCount(HANDLERS_COUNT, 0);
+    auto pop = [&]() {
+        for (auto handler: queue.PopAll()) {
+            ++popCount[GetUint32RegisterAddress(handler->Register()->GetAddress())];
+        }
+    };
+
+    std::atomic<size_t> runningThreads(THREADS_COUNT);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS_COUNT; ++t) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; i < 1000; ++i) {
+                for (auto& handler: handlers) {
+                    queue.Push(handler.get());
+                }
+            }
+            --runningThreads;
+        });
+    }
+    while (runningThreads) {
+        pop();
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    pop();
+
+    EXPECT_TRUE(queue.Empty());
+    for (auto count: popCount) {
+        EXPECT_GT(count, 0);
+    }
+}
+
+TEST(TRegisterHandlerTest, Superseded)
+{
+    TPendingWritesQueue queue;
+    auto handler = CreateHandlers(1, queue)[0];
+    auto now = std::chrono::steady_clock::now();
+
+    EXPECT_FALSE(handler->SetTextValue("1"));
+    EXPECT_TRUE(handler->SetTextValue("2"));
+    EXPECT_EQ(handler->GetValueToFlush(now).Get<uint64_t>(), 2);
+
+    // The value being written is not replaced
+    EXPECT_FALSE(handler->SetTextValue("3"));
+    handler->CompleteFlush(TRegisterValue(2), nullptr);
+    EXPECT_TRUE(handler->NeedToFlush());
+    EXPECT_EQ(queue.PopAll(), std::vector<TRegisterHandler*>({handler.get()}));
+}
+
+TEST(TRegisterHandlerTest, MinWriteInterval)
+{
+    TPendingWritesQueue queue;
+    auto handler = CreateHandlers(1, queue)[0];
+    auto now = std::chrono::steady_clock::now();
+
+    handler->SetTextValue("1");
+    EXPECT_EQ(handler->GetNextWriteTime(), std::chrono::steady_clock::time_point::min());
+    handler->GetValueToFlush(now);
+    handler->CompleteFlush(TRegisterValue(1), nullptr);
+    EXPECT_EQ(handler->GetNextWriteTime(), std::chrono::steady_clock::time_point::min());
+
+    handler->Register()->MinWriteInterval = std::chrono::milliseconds(200);
+    EXPECT_EQ(handler->GetNextWriteTime(), now + std::chrono::milliseconds(200));
+}
@@ -188,6 +188,24 @@ TEST_F(TSerialPortTest, TestSkipNoise)
     FakeSerial->Flush(); // shouldn't change anything here, but shouldn't hang either
 }
 
+TEST_F(TSerialPortTest, TestSkipBufferedNoise)
+{
+    uint8_t buf[] = {1, 2, 3};
+    Serial->WriteBytes(buf, sizeof(buf));
+    usleep(300);
+    // All received bytes are read at once, 0x02 and 0x03 remain in port's receive buffer
+    ASSERT_EQ(SecondarySerial->ReadByte(std::chrono::milliseconds(1000)), 0x01);
+    SecondarySerial->SkipNoise();
+
+    buf[0] = 0x04;
+    // Should read 0x04, not 0x02
+    Serial->WriteBytes(buf, 1);
+    uint8_t read_back = SecondarySerial->ReadByte(std::chrono::milliseconds(1000));
+    ASSERT_EQ(read_back, buf[0]);
+
+    FakeSerial->Flush();
+}
+
 /* on imx6, a glitch with precise timing can trigger a bug in UART IP. This will result
 in continuously reception of FF bytes until either UART is reset or a couple of valid UART frames
 are received */
@@ -0,0 +1,64 @@
+#include "serial_port_timing.h"
+#include "gtest/gtest.h"
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+TEST(TSerialPortTimingEstimatorTest, Calibration)
+{
+    TSerialPortTimingEstimator timing;
+    for (size_t i = 0; i < 31; ++i) {
+        timing.AddFramePart(1000us, 100us);
+    }
+    EXPECT_FALSE(timing.IsCalibrated());
+
+    timing.AddFramePart(1000us, 100us);
+    ASSERT_TRUE(timing.IsCalibrated());
+    // Percentile + 50% + 1 ms
+    EXPECT_EQ(timing.GetFrameGap(), 2500us);
+    EXPECT_EQ(timing.GetDriverLatency(), 2350us);
+}
+
+TEST(TSerialPortTimingEstimatorTest, RareOutliersAreIgnored)
+{
+    TSerialPortTimingEstimator timing;
+    for (size_t i = 0; i < 256; ++i) {
+        timing.AddFramePart((i % 128 == 5) ? 50ms : 2ms, 1ms);
+    }
+    ASSERT_TRUE(timing.IsCalibrated());
+    EXPECT_EQ(timing.GetFrameGap(), 4ms);
+    EXPECT_EQ(timing.GetDriverLatency(), 2500us);
+}
+
+TEST(TSerialPortTimingEstimatorTest, FollowsLatencyIncrease)
+{
+    TSerialPortTimingEstimator timing;
+    for (size_t i = 0; i < 256; ++i) {
+        timing.AddFramePart(2ms, 1ms);
+    }
+    for (size_t i = 0; i < 256; ++i) {
+        timing.AddFramePart(6ms, 1ms);
+    }
+    EXPECT_EQ(timing.GetFrameGap(), 10ms);
+    EXPECT_EQ(timing.GetDriverLatency(), 8500us);
+}
+
+TEST(TSerialPortTimingEstimatorTest, ResetAfterFrameError)
+{
+    TSerialPortTimingEstimator timing;
+    for (size_t i = 0; i < 32; ++i) {
+        timing.AddFramePart(1ms, 100us);
+    }
+    ASSERT_TRUE(timing.IsCalibrated());
+
+    timing.Reset();
+    EXPECT_FALSE(timing.IsCalibrated());
+
+    // Twice more samples are required after an error
+    for (size_t i = 0; i < 63; ++i) {
+        timing.AddFramePart(1ms, 100us);
+    }
+    EXPECT_FALSE(timing.IsCalibrated());
+    timing.AddFramePart(1ms, 100us);
+    EXPECT_TRUE(timing.IsCalibrated());
+}
@@ -0,0 +1,111 @@
+#include "shared_rate_limiter.h"
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    //! Reads items as fast as allowed and returns count of read items
+    size_t ReadUntilLimit(TPortRateLimiter& limiter, std::chrono::steady_clock::time_point time)
+    {
+        size_t count = 0;
+        while (!limiter.IsOverLimit(time)) {
+            limiter.NewItem(time);
+            ++count;
+        }
+        return count;
+    }
+}
+
+TEST(SharedRateLimiterTest, Unlimited)
+{
+    auto limiter = std::make_shared<TSharedRateLimiter>(0);
+    auto port = limiter->AddPort("port", 0);
+    auto now = std::chrono::steady_clock::time_point() + 1s;
+    for (size_t i = 0; i < 10000; ++i) {
+        port->NewItem(now);
+    }
+    EXPECT_FALSE(port->IsOverLimit(now));
+    EXPECT_EQ(port->GetNextItemTime(now), now);
+}
+
+TEST(SharedRateLimiterTest, MinRates)
+{
+    auto limiter = std::make_shared<TSharedRateLimiter>(100);
+    auto port1 = limiter->AddPort("port1", 20);
+    auto port2 = limiter->AddPort("port2", 30);
+    auto now = std::chrono::steady_clock::time_point() + 1s;
+
+    // Buckets are full at start, port gets its reserved tokens and all common tokens
+    EXPECT_EQ(ReadUntilLimit(*port1, now), 70);
+    EXPECT_EQ(ReadUntilLimit(*port2, now), 30);
+
+    // Every second ports get their minimal rates and share the rest
+    for (size_t i = 0; i < 10; ++i) {
+        now += 1s;
+        auto count2 = ReadUntilLimit(*port2, now);
+        auto count1 = ReadUntilLimit(*port1, now);
+        EXPECT_GE(count1, 20);
+        EXPECT_GE(count2, 30);
+        EXPECT_EQ(count1 + count2, 100);
+    }
+}
+
+TEST(SharedRateLimiterTest, UnusedCapacity)
+{
+    auto limiter = std::make_shared<TSharedRateLimiter>(100);
+    auto busyPort = limiter->AddPort("busy", 50);
+    auto idlePort = limiter->AddPort("idle", 50);
+    auto now = std::chrono::steady_clock::time_point() + 1s;
+
+    ReadUntilLimit(*busyPort, now);
+    ASSERT_TRUE(busyPort->IsOverLimit(now));
+    EXPECT_EQ(busyPort->GetNextItemTime(now), now + 20ms);
+
+    // Idle port's reserved bucket is full, so its tokens go to busy port
+    size_t count = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        now += 10ms;
+        count += ReadUntilLimit(*busyPort, now);
+    }
+    EXPECT_NEAR(count, 1000, 1);
+
+    // Idle port still has its reserved tokens
+    EXPECT_EQ(ReadUntilLimit(*idlePort, now), 50);
+
+    auto stats = limiter->GetStats(now);
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_EQ(stats[0].Port, "busy");
+    EXPECT_EQ(stats[0].MinRateLimit, 50);
+    EXPECT_NEAR(stats[0].ItemsPerSecond, 100, 2);
+    EXPECT_EQ(stats[1].TotalItems, 50);
+}
+
+TEST(SharedRateLimiterTest, StatsOfIdlePort)
+{
+    auto limiter = std::make_shared<TSharedRateLimiter>(0);
+    auto port = limiter->AddPort("port", 0);
+    auto now = std::chrono::steady_clock::time_point() + 1s;
+    for (size_t i = 0; i < 100; ++i) {
+        port->NewItem(now + i * 10ms);
+    }
+    now += 1s;
+    port->NewItem(now);
+    EXPECT_EQ(limiter->GetStats(now)[0].ItemsPerSecond, 100);
+
+    // Reads are stopped, the last window is finished without new items
+    EXPECT_EQ(limiter->GetStats(now + 1s)[0].ItemsPerSecond, 1);
+    EXPECT_EQ(limiter->GetStats(now + 2s)[0].ItemsPerSecond, 0);
+    EXPECT_EQ(limiter->GetStats(now + 2s)[0].TotalItems, 101);
+}
+
+TEST(SharedRateLimiterTest, MinRatesExceedLimit)
+{
+    // Reserved rates are reduced proportionally
+    auto limiter = std::make_shared<TSharedRateLimiter>(100);
+    auto port1 = limiter->AddPort("port1", 150);
+    auto port2 = limiter->AddPort("port2", 50);
+    auto now = std::chrono::steady_clock::time_point() + 1s;
+    EXPECT_EQ(ReadUntilLimit(*port1, now), 75);
+    EXPECT_EQ(ReadUntilLimit(*port2, now), 25);
+}
@@ -0,0 +1,81 @@
+#include "serial_exc.h"
+#include "tcp_port.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class TTcpPortTest: public testing::Test
+{
+protected:
+    int ListenFd = -1;
+    uint16_t ListenPort = 0;
+
+    void SetUp() override
+    {
+        ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        ASSERT_EQ(bind(ListenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        socklen_t len = sizeof(addr);
+        getsockname(ListenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+        ListenPort = ntohs(addr.sin_port);
+    }
+
+    void TearDown() override
+    {
+        close(ListenFd);
+    }
+};
+
+TEST_F(TTcpPortTest, TryOpen)
+{
+    ASSERT_EQ(listen(ListenFd, 1), 0);
+    TTcpPort port(TTcpPortSettings("localhost", ListenPort));
+    for (int i = 0; i < 100 && !port.TryOpen(); ++i) {
+    }
+    ASSERT_TRUE(port.IsOpen());
+    EXPECT_THROW(port.TryOpen(), TSerialDeviceException);
+
+    int fd = accept(ListenFd, nullptr, nullptr);
+    ASSERT_GE(fd, 0);
+    uint8_t buf[3] = {1, 2, 3};
+    port.WriteBytes(buf, sizeof(buf));
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), 3);
+    close(fd);
+
+    port.Close();
+    EXPECT_FALSE(port.IsOpen());
+}
+
+TEST_F(TTcpPortTest, ConnectionRefused)
+{
+    // The socket is bound, but doesn't listen
+    TTcpPort port(TTcpPortSettings("127.0.0.1", ListenPort));
+    EXPECT_THROW(port.Open(), TSerialDeviceException);
+    EXPECT_FALSE(port.IsOpen());
+    EXPECT_THROW(
+        {
+            for (int i = 0; i < 100 && !port.TryOpen(); ++i) {
+            }
+        },
+        TSerialDeviceException);
+    EXPECT_FALSE(port.IsOpen());
+}
+
+TEST_F(TTcpPortTest, UnknownHost)
+{
+    // The name is resolved by another thread, TryOpen doesn't wait for it
+    TTcpPort port(TTcpPortSettings("no-such-host.invalid", ListenPort));
+    EXPECT_THROW(
+        {
+            for (int i = 0; i < 1000 && !port.TryOpen(); ++i) {
+            }
+        },
+        TSerialDeviceException);
+    EXPECT_FALSE(port.IsOpen());
+}